@@ -0,0 +1,247 @@
+#include "abc_archive_index.h"
+#include "csv_utils.h"
+#include "hash_utils.h"
+#include "misc.h"
+
+using namespace VR;
+
+uint64 AbcVoxelInfo::estimateMemoryUsage(int nsamples) const {
+	uint64 perSample=uint64(numVerts)*sizeof(Vector)*(hasVelocities? 2 : 1)+uint64(numNormals)*sizeof(Vector);
+	uint64 topology=uint64(numFaces)*3*sizeof(int)*(numNormals>0? 2 : 1);
+	uint64 mapping=uint64(numMapVerts)*sizeof(Vector)+uint64(numMapChannels)*uint64(numFaces)*3*sizeof(int);
+	return (perSample+topology+mapping)*uint64(nsamples);
+}
+
+int AbcArchiveIndex::findPreviewVoxel(MeshFile &abcFile) {
+	int numVoxels=abcFile.getNumVoxels();
+	for (int i=0; i<numVoxels; i++) {
+		if (abcFile.getVoxelFlags(i) & MVF_PREVIEW_VOXEL)
+			return i;
+	}
+	return -1;
+}
+
+// Return the name of the given shader set of the voxel.
+static std::string getShaderSetName(MeshFile &abcFile, MeshVoxel &voxel, int mtlID, VRayRenderer *vray) {
+	StringID strID=abcFile.getShaderSetStringID(&voxel, mtlID);
+	if (strID.id!=0)
+		strID=vray->getStringManager()->getStringID(strID.id);
+	CharString name(strID.str);
+	return std::string(name.empty()? "" : name.ptr());
+}
+
+// Return the longest path that both names are equal to or under, or an empty string if there is none.
+static std::string getCommonPath(const std::string &a, const std::string &b) {
+	size_t n=0;
+	while (n<a.size() && n<b.size() && a[n]==b[n])
+		n++;
+	if ((n==a.size() || a[n]=='/') && (n==b.size() || b[n]=='/'))
+		return a.substr(0, n);
+
+	size_t slash=(n>0)? a.rfind('/', n-1) : std::string::npos;
+	return (slash!=std::string::npos)? a.substr(0, slash) : std::string();
+}
+
+CharString AbcArchiveIndex::getObjectName(MeshFile &abcFile, MeshVoxel &voxel, VRayRenderer *vray) {
+	// Collect the different shader sets of the faces; the faces of a face set are usually next to each other.
+	Table<int, -1> mtlIDs;
+	const MeshChannel *faceInfoChannel=voxel.getChannel(FACE_INFO_CHANNEL);
+	if (faceInfoChannel && faceInfoChannel->data) {
+		const FaceInfoData *faceInfo=static_cast<FaceInfoData*>(faceInfoChannel->data);
+		for (int i=0; i<faceInfoChannel->numElements; i++) {
+			int mtlID=faceInfo[i].mtlID;
+			if (i>0 && mtlID==faceInfo[i-1].mtlID)
+				continue;
+
+			int k=0;
+			while (k<mtlIDs.count() && mtlIDs[k]!=mtlID)
+				k++;
+			if (k==mtlIDs.count())
+				mtlIDs+=mtlID;
+		}
+	}
+	if (mtlIDs.count()==0)
+		mtlIDs+=0;
+
+	std::string firstName=getShaderSetName(abcFile, voxel, mtlIDs[0], vray);
+	std::string name=firstName;
+	for (int i=1; i<mtlIDs.count() && !name.empty(); i++)
+		name=getCommonPath(name, getShaderSetName(abcFile, voxel, mtlIDs[i], vray));
+
+	// Names that are not paths have no common parent; fall back to the shader set of the first face.
+	if (name.empty())
+		name=firstName;
+	return CharString(name.c_str());
+}
+
+int AbcArchiveIndex::init(MeshFile &abcFile, const CharString &fileName) {
+	int numVoxels=abcFile.getNumVoxels();
+	if (isValidFor(fileName) && voxels.count()==numVoxels)
+		return false;
+
+	clear();
+
+	indexFileName=fileName;
+	voxels.setCount(numVoxels);
+	for (int i=0; i<numVoxels; i++) {
+		voxels[i]=AbcVoxelInfo();
+		voxels[i].flags=abcFile.getVoxelFlags(i);
+		if (previewVoxelIndex<0 && (voxels[i].flags & MVF_PREVIEW_VOXEL))
+			previewVoxelIndex=i;
+	}
+
+	return true;
+}
+
+int AbcArchiveIndex::isValidFor(const CharString &fileName) const {
+	return !indexFileName.empty() && indexFileName==fileName;
+}
+
+void AbcArchiveIndex::clear(void) {
+	indexFileName.clear();
+	voxels.clear();
+	nameToVoxel.clear();
+	previewVoxelIndex=-1;
+	scanned=false;
+}
+
+void AbcArchiveIndex::scan(MeshFile &abcFile, VRayRenderer *vray, float frame) {
+	int numVoxels=voxels.count();
+	for (int i=0; i<numVoxels; i++) {
+		AbcVoxelInfo &info=voxels[i];
+		if (info.hasMetadata)
+			continue;
+		if ((info.flags & MVF_PREVIEW_VOXEL) || 0==(info.flags & MVF_GEOMETRY_VOXEL) || 0!=(info.flags & MVF_INSTANCE_VOXEL))
+			continue;
+
+		// Read just one time sample for the metadata.
+		MeshVoxel *voxel=abcFile.getVoxel(i, 1<<16, NULL, NULL);
+		if (!voxel)
+			continue;
+
+		updateFromVoxel(i, *voxel, getObjectName(abcFile, *voxel, vray), frame);
+		abcFile.releaseVoxel(voxel);
+	}
+	scanned=true;
+}
+
+void AbcArchiveIndex::updateFromVoxel(int voxelIndex, MeshVoxel &voxel, const CharString &name, float frame) {
+	if (voxelIndex<0 || voxelIndex>=voxels.count())
+		return;
+
+	AbcVoxelInfo &info=voxels[voxelIndex];
+
+	if (!name.empty() && !(info.name==name)) {
+		info.name=name;
+		nameToVoxel[std::string(name.ptr())]=voxelIndex;
+	}
+
+	// The index is cleared when the file changes, so a voxel read again for the same frame has the same data.
+	if (info.hasMetadata && info.lastFrame==frame)
+		return;
+
+	voxel.getTM(info.tm);
+
+	info.bbox.init();
+	info.numVerts=0;
+
+	const MeshChannel *vertsChannel=voxel.getChannel(VERT_GEOM_CHANNEL);
+	if (vertsChannel && vertsChannel->data) {
+		const VertGeomData *verts=static_cast<VertGeomData*>(vertsChannel->data);
+		info.numVerts=vertsChannel->numElements;
+		for (int i=0; i<info.numVerts; i++) {
+			info.bbox+=Vector(verts[i]);
+		}
+	}
+
+	// Hashing all vertices on every read costs about as much as converting them; the transformation, the vertex
+	// count and the bounding box are enough to tell whether the object moved or deformed between frames.
+	uint64 geomHash=hashMemory(&info.tm, sizeof(info.tm));
+	geomHash=hashMemory(&info.numVerts, sizeof(info.numVerts), geomHash);
+	geomHash=hashMemory(&info.bbox, sizeof(info.bbox), geomHash);
+
+	const MeshChannel *facesChannel=voxel.getChannel(FACE_TOPO_CHANNEL);
+	info.numFaces=facesChannel? facesChannel->numElements : 0;
+
+	const MeshChannel *normalsChannel=voxel.getChannel(VERT_NORMAL_CHANNEL);
+	info.numNormals=normalsChannel? normalsChannel->numElements : 0;
+
+	const MeshChannel *velocitiesChannel=voxel.getChannel(VERT_VELOCITY_CHANNEL);
+	info.hasVelocities=(velocitiesChannel && velocitiesChannel->data && velocitiesChannel->numElements==info.numVerts);
+
+	info.numMapChannels=0;
+	info.numMapVerts=0;
+	for (int i=0; i<voxel.numChannels; i++) {
+		const MeshChannel &chan=voxel.channels[i];
+		if (chan.channelID>=VERT_TEX_CHANNEL0 && chan.channelID<VERT_TEX_TOPO_CHANNEL0) {
+			info.numMapChannels++;
+			info.numMapVerts+=chan.numElements;
+		}
+	}
+
+	// Update the constancy information if we have seen this voxel on a different frame.
+	if (info.hasMetadata && info.lastFrame!=frame) {
+		if (info.geomHash!=geomHash) info.isConstant=false;
+		else if (info.isConstant!=0) info.isConstant=true;
+	}
+
+	info.geomHash=geomHash;
+	info.lastFrame=frame;
+	info.hasMetadata=true;
+}
+
+int AbcArchiveIndex::findVoxel(const CharString &name) const {
+	if (name.empty())
+		return -1;
+
+	std::unordered_map<std::string, int>::const_iterator it=nameToVoxel.find(std::string(name.ptr()));
+	if (it==nameToVoxel.end())
+		return -1;
+
+	return it->second;
+}
+
+int AbcArchiveIndex::findVoxels(const tchar *pattern, Table<int, -1> &voxelIndices) const {
+	voxelIndices.clear();
+	if (!pattern)
+		return 0;
+
+	for (int i=0; i<voxels.count(); i++) {
+		const AbcVoxelInfo &info=voxels[i];
+		if (!info.name.empty() && matchWildcard(pattern, info.name.ptr()))
+			voxelIndices+=i;
+	}
+	return voxelIndices.count();
+}
+
+uint64 AbcArchiveIndex::estimateMemoryUsage(const Table<int, -1> &voxelIndices, int nsamples) const {
+	uint64 res=0;
+	for (int i=0; i<voxelIndices.count(); i++) {
+		int voxelIndex=voxelIndices[i];
+		if (voxelIndex>=0 && voxelIndex<voxels.count())
+			res+=voxels[voxelIndex].estimateMemoryUsage(nsamples);
+	}
+	return res;
+}
+
+ErrorCode AbcArchiveIndex::writeCSV(const tchar *csvFileName) const {
+	FILE *f=fopen(csvFileName, "wt");
+	if (!f)
+		return ErrorCode(__FUNCTION__, -1, "Cannot open file \"%s\" for writing", csvFileName);
+
+	fprintf(f, "voxel,name,flags,numVerts,numFaces,numNormals,numMapChannels,hasVelocities,constant,bboxMinX,bboxMinY,bboxMinZ,bboxMaxX,bboxMaxY,bboxMaxZ\n");
+	for (int i=0; i<voxels.count(); i++) {
+		const AbcVoxelInfo &info=voxels[i];
+		fprintf(f, "%i,", i);
+		writeCSVString(f, info.name.ptr());
+		fprintf(f, ",%u,%i,%i,%i,%i,%i,%i", info.flags, info.numVerts, info.numFaces, info.numNormals, info.numMapChannels, info.hasVelocities, info.isConstant);
+		if (info.bbox.isEmpty()) {
+			fprintf(f, ",,,,,,\n");
+		} else {
+			fprintf(f, ",%g,%g,%g,%g,%g,%g\n", info.bbox.pmin.x, info.bbox.pmin.y, info.bbox.pmin.z, info.bbox.pmax.x, info.bbox.pmax.y, info.bbox.pmax.z);
+		}
+	}
+
+	fclose(f);
+	return ErrorCode();
+}
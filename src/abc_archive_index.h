@@ -0,0 +1,115 @@
+#pragma once
+
+#include "utils.h"
+#include "charstring.h"
+#include "mesh_file.h"
+#include "vrayrenderer.h"
+
+#include <string>
+#include <unordered_map>
+
+/// Metadata about a single voxel of a .vrmesh/Alembic file.
+struct AbcVoxelInfo {
+	VR::CharString name; ///< The full Alembic name of the object; empty if the voxel was not read yet or has no name.
+	VR::uint32 flags; ///< The voxel flags (MVF_xxx).
+	VR::Box bbox; ///< The object-space bounding box of the vertices at the first time sample.
+	VR::Transform tm; ///< The object transformation at the first time sample.
+	int numVerts; ///< The number of vertices.
+	int numFaces; ///< The number of triangle faces.
+	int numNormals; ///< The number of explicit normals, or 0 if there are none.
+	int numMapChannels; ///< The number of UV/color sets.
+	int numMapVerts; ///< The total number of mapping vertices over all UV/color sets.
+	int hasVelocities; ///< true if the voxel has vertex velocities.
+	int isConstant; ///< 1 if the geometry was the same on all frames read so far, 0 if it changed, -1 if not known yet.
+	int hasMetadata; ///< true if the fields above (except flags) were filled in from the voxel data.
+	VR::uint64 geomHash; ///< A hash of the transformation, the vertex count and the bounding box; used to detect constancy.
+	float lastFrame; ///< The frame at which geomHash was computed.
+
+	/// Constructor.
+	AbcVoxelInfo(void):flags(0), numVerts(0), numFaces(0), numNormals(0), numMapChannels(0), numMapVerts(0), hasVelocities(false),
+		isConstant(-1), hasMetadata(false), geomHash(0), lastFrame(0.0f)
+	{
+		bbox.init();
+		tm.makeIdentity();
+	}
+
+	/// Estimate the memory (in bytes) that the converted geometry of this voxel will take, for the given number of time samples.
+	VR::uint64 estimateMemoryUsage(int nsamples) const;
+};
+
+/// An index with metadata about all voxels of a .vrmesh/Alembic file. The voxel flags are available as soon as the index
+/// is initialized; the rest of the metadata is filled in either by scan(), which reads the first time sample of every
+/// voxel, or as voxels are read during rendering through updateFromVoxel().
+struct AbcArchiveIndex {
+	/// Constructor.
+	AbcArchiveIndex(void):previewVoxelIndex(-1), scanned(false) {}
+
+	/// Initialize the index for the given file, if it is not already initialized for it. This only reads the voxel flags.
+	/// @retval true if the index was reset and false if it was already valid for the file.
+	int init(VR::MeshFile &abcFile, const VR::CharString &fileName);
+
+	/// Return true if the index is initialized for the given file.
+	int isValidFor(const VR::CharString &fileName) const;
+
+	/// Remove all information from the index.
+	void clear(void);
+
+	/// Fill in the metadata for all geometry voxels that don't have it yet, by reading the first time sample of each voxel.
+	/// @param abcFile The file to read; must be the one that the index was initialized with.
+	/// @param vray The V-Ray renderer; used to resolve the object names.
+	/// @param frame The current frame.
+	void scan(VR::MeshFile &abcFile, VR::VRayRenderer *vray, float frame);
+
+	/// Return true if scan() was called for the current file.
+	int isScanned(void) const { return scanned; }
+
+	/// Fill in the metadata for the given voxel from its data. Does nothing but update the name if the voxel was
+	/// already read for the same frame.
+	/// @param voxelIndex The index of the voxel.
+	/// @param voxel The voxel data for the first time sample.
+	/// @param name The Alembic name of the object.
+	/// @param frame The frame that the voxel was read for.
+	void updateFromVoxel(int voxelIndex, VR::MeshVoxel &voxel, const VR::CharString &name, float frame);
+
+	/// Return the number of voxels in the file.
+	int getNumVoxels(void) const { return voxels.count(); }
+
+	/// Return the metadata for the given voxel.
+	const AbcVoxelInfo& getVoxelInfo(int voxelIndex) const { return voxels[voxelIndex]; }
+
+	/// Return the index of the preview voxel, or -1 if there is none.
+	int getPreviewVoxelIndex(void) const { return previewVoxelIndex; }
+
+	/// Return the index of the voxel with the given Alembic name, or -1 if there is no such voxel (or its name is not known yet).
+	int findVoxel(const VR::CharString &name) const;
+
+	/// Find all voxels whose Alembic names match the given wildcard pattern.
+	/// @param pattern A pattern that may contain the wildcards * and ?
+	/// @param[out] voxelIndices Receives the indices of the matching voxels.
+	/// @retval The number of matching voxels.
+	int findVoxels(const tchar *pattern, VR::Table<int, -1> &voxelIndices) const;
+
+	/// Estimate the memory (in bytes) for the converted geometry of all the given voxels.
+	VR::uint64 estimateMemoryUsage(const VR::Table<int, -1> &voxelIndices, int nsamples) const;
+
+	/// Write the index into a CSV file, one line per voxel.
+	VR::ErrorCode writeCSV(const tchar *csvFileName) const;
+
+	/// Return the index of the first preview voxel in the given file, or -1 if there is none.
+	static int findPreviewVoxel(VR::MeshFile &abcFile);
+
+	/// Return the full Alembic name of the object in the given voxel. The name is stored as a shader set of the faces;
+	/// the faces in face sets have the shader sets of the face sets instead, which are child objects of the mesh, so
+	/// the name of the object is the common parent path of the shader sets of all faces.
+	/// @param abcFile The file that the voxel was read from.
+	/// @param voxel The voxel data.
+	/// @param vray The V-Ray renderer; used to resolve the names.
+	static VR::CharString getObjectName(VR::MeshFile &abcFile, VR::MeshVoxel &voxel, VR::VRayRenderer *vray);
+
+protected:
+	VR::CharString indexFileName; ///< The file the index was built for.
+	VR::Table<AbcVoxelInfo, -1> voxels; ///< The metadata for each voxel.
+	std::unordered_map<std::string, int> nameToVoxel; ///< A map from Alembic names to voxel indices.
+	int previewVoxelIndex; ///< The index of the preview voxel.
+	int scanned; ///< true if scan() was called.
+};
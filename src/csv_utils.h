@@ -0,0 +1,19 @@
+#pragma once
+
+#include "utils.h"
+
+#include <stdio.h>
+
+/// Write the given string to a CSV file as a quoted field, doubling any quotes in it, so that names with commas,
+/// quotes or line breaks are read back as a single field.
+/// @param f The file to write to.
+/// @param str The string to write; may be NULL, which is written as an empty field.
+inline void writeCSVString(FILE *f, const tchar *str) {
+	fputc('"', f);
+	for (const tchar *p=str; p && *p; p++) {
+		if (*p=='"')
+			fputc('"', f);
+		fputc(*p, f);
+	}
+	fputc('"', f);
+}
@@ -0,0 +1,671 @@
+#include "geomalembicreader.h"
+#include "geom_disk_cache.h"
+#include "hash_utils.h"
+
+#include <string>
+#include <thread>
+#include <functional>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace VR;
+
+#define GEOM_CACHE_MAGIC "VRABCGC1"
+#define GEOM_CACHE_VERSION 2
+#define GEOM_CACHE_ALIGNMENT 16
+
+/// The header at the start of a cache file.
+struct GeomCacheHeader {
+	char magic[8]; ///< GEOM_CACHE_MAGIC
+	uint32 version; ///< GEOM_CACHE_VERSION
+	uint32 numObjects; ///< The number of objects in the file.
+	uint64 sourceSize; ///< The size of the source file.
+	uint64 sourceMTime; ///< The modification time of the source file.
+	uint64 settingsHash; ///< A hash of the settings used to convert the geometry.
+	uint64 directoryOffset; ///< The offset of the object directory.
+	uint64 reserved[2];
+};
+
+/// An entry in the object directory at the end of a cache file.
+struct GeomCacheDirEntry {
+	int voxelIndex; ///< The voxel index of the object.
+	int reserved;
+	uint64 offset; ///< The offset of the object data in the file.
+};
+
+//*************************************************************
+// File utilities
+
+int getFileStamp(const tchar *fileName, FileStamp &stamp) {
+	if (!fileName || !fileName[0])
+		return false;
+
+#ifdef _WIN32
+	struct _stat64 st;
+	if (_stat64(fileName, &st)!=0)
+		return false;
+#else
+	struct stat st;
+	if (stat(fileName, &st)!=0)
+		return false;
+#endif
+
+	stamp.size=uint64(st.st_size);
+	stamp.mtime=uint64(st.st_mtime);
+	return true;
+}
+
+MappedFile::MappedFile(void):ptr(nullptr), numBytes(0) {
+#ifdef _WIN32
+	fileHandle=nullptr;
+	mappingHandle=nullptr;
+#endif
+}
+
+int MappedFile::open(const tchar *fileName) {
+	close();
+
+#ifdef _WIN32
+	HANDLE hFile=CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile==INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart==0) {
+		CloseHandle(hFile);
+		return false;
+	}
+
+	HANDLE hMapping=CreateFileMappingA(hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	if (!hMapping) {
+		CloseHandle(hFile);
+		return false;
+	}
+
+	void *view=MapViewOfFile(hMapping, FILE_MAP_COPY, 0, 0, 0);
+	if (!view) {
+		CloseHandle(hMapping);
+		CloseHandle(hFile);
+		return false;
+	}
+
+	fileHandle=hFile;
+	mappingHandle=hMapping;
+	ptr=static_cast<uint8*>(view);
+	numBytes=uint64(fileSize.QuadPart);
+#else
+	int fd=::open(fileName, O_RDONLY);
+	if (fd<0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st)!=0 || st.st_size==0) {
+		::close(fd);
+		return false;
+	}
+
+	// Map the file privately so that the data can be modified in memory without affecting the file.
+	void *view=mmap(NULL, size_t(st.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (view==MAP_FAILED)
+		return false;
+
+	ptr=static_cast<uint8*>(view);
+	numBytes=uint64(st.st_size);
+#endif
+
+	return true;
+}
+
+void MappedFile::close(void) {
+	if (!ptr)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(ptr);
+	CloseHandle(mappingHandle);
+	CloseHandle(fileHandle);
+	mappingHandle=nullptr;
+	fileHandle=nullptr;
+#else
+	munmap(ptr, size_t(numBytes));
+#endif
+
+	ptr=nullptr;
+	numBytes=0;
+}
+
+CharString getGeomCacheFileName(const CharString &sourceFile, const CharString &cacheDir, uint64 settingsHash, int frameNumber) {
+	CharString base;
+	if (cacheDir.empty()) {
+		base=sourceFile;
+	} else {
+		// Take just the file name of the source file and put it in the cache directory.
+		const tchar *srcName=sourceFile.ptr();
+		const tchar *fname=srcName;
+		for (const tchar *p=srcName; p && *p; p++) {
+			if (*p=='/' || *p=='\\')
+				fname=p+1;
+		}
+
+		base=cacheDir;
+		const tchar *dir=cacheDir.ptr();
+		int len=cacheDir.length();
+		if (len>0 && dir[len-1]!='/' && dir[len-1]!='\\')
+			base.append("/");
+		base.append(fname? fname : "");
+	}
+
+	tchar suffix[64];
+	vutils_sprintf_n(suffix, COUNT_OF(suffix), ".%08x.%i.abcgc", uint32(settingsHash ^ (settingsHash>>32)), frameNumber);
+	base.append(suffix);
+	return base;
+}
+
+// Return the index of the time sample closest to the given time.
+static int getSampleIndex(double time, const TimesList &sampleTimes) {
+	int res=0;
+	double minDist=-1.0;
+	for (int i=0; i<sampleTimes.count(); i++) {
+		double dist=fabs(sampleTimes[i]-time);
+		if (minDist<0.0 || dist<minDist) {
+			minDist=dist;
+			res=i;
+		}
+	}
+	return res;
+}
+
+// Return a suffix for the temporary cache file that is unique to the calling process and thread, so that readers in
+// other processes or threads that write the same cache file at the same time do not write into the same file.
+static CharString getTempFileSuffix(void) {
+#ifdef _WIN32
+	unsigned processId=unsigned(GetCurrentProcessId());
+#else
+	unsigned processId=unsigned(getpid());
+#endif
+	size_t threadHash=std::hash<std::thread::id>()(std::this_thread::get_id());
+
+	tchar suffix[64];
+	vutils_sprintf_n(suffix, COUNT_OF(suffix), ".%u.%08x.tmp", processId, uint32(uint64(threadHash) ^ (uint64(threadHash)>>32)));
+	return CharString(suffix);
+}
+
+//*************************************************************
+// GeomCacheWriter
+
+ErrorCode GeomCacheWriter::open(const tchar *fileName, const FileStamp &srcStamp, uint64 hash) {
+	abort();
+
+	sourceStamp=srcStamp;
+	settingsHash=hash;
+
+	cacheFileName=fileName;
+	tempFileName=fileName;
+	tempFileName.append(getTempFileSuffix());
+
+	file=fopen(tempFileName.ptr(), "wb");
+	if (!file)
+		return ErrorCode(__FUNCTION__, -1, "Cannot open file \"%s\" for writing", tempFileName.ptr());
+
+	// Reserve space for the header; it is written in close().
+	GeomCacheHeader header;
+	memset(&header, 0, sizeof(header));
+
+	offset=0;
+	write(&header, sizeof(header));
+	align();
+
+	return ErrorCode();
+}
+
+void GeomCacheWriter::write(const void *data, size_t size) {
+	if (size>0)
+		fwrite(data, 1, size, file);
+	offset+=size;
+}
+
+void GeomCacheWriter::writeInt(int value) {
+	write(&value, sizeof(value));
+}
+
+void GeomCacheWriter::align(void) {
+	static const uint8 zeros[GEOM_CACHE_ALIGNMENT]={ 0 };
+	size_t padding=size_t((GEOM_CACHE_ALIGNMENT-(offset%GEOM_CACHE_ALIGNMENT))%GEOM_CACHE_ALIGNMENT);
+	write(zeros, padding);
+}
+
+void GeomCacheWriter::writeArray(const void *data, int count, int elementSize) {
+	writeInt(count);
+	writeInt(elementSize);
+	align();
+	if (count>0)
+		write(data, size_t(count)*size_t(elementSize));
+	align();
+}
+
+void GeomCacheWriter::writeString(const CharString &str) {
+	int len=str.empty()? 0 : str.length();
+	writeArray(len>0? str.ptr() : nullptr, len, 1);
+}
+
+template<class T>
+void GeomCacheWriter::writeKeyframedList(AnimatedParam<T> &param, const TimesList &sampleTimes) {
+	int numKeyframes=param.getNumKeyframes();
+	writeInt(numKeyframes);
+	for (int i=0; i<numKeyframes; i++) {
+		T &data=param.getKeyframeData(i);
+		writeInt(getSampleIndex(param.getKeyframeTime(i), sampleTimes));
+		int count=data.count();
+		writeArray(count>0? &data[0] : nullptr, count, int(sizeof(data[0])));
+	}
+}
+
+void GeomCacheWriter::addObject(AlembicMeshSource &meshSource, const AlembicMeshInstance &meshInstance, const TimesList &sampleTimes) {
+	if (!file)
+		return;
+
+	align();
+	voxelIndices+=meshSource.voxelIndex;
+	objectOffsets+=offset;
+
+	writeInt(meshSource.voxelIndex);
+	writeString(meshInstance.abcName);
+
+	// The instance transformations and their time sample indices.
+	int numTMs=meshInstance.tms.count();
+	writeArray(numTMs>0? &meshInstance.tms[0] : nullptr, numTMs, int(sizeof(Transform)));
+
+	Table<int, -1> timeIndices;
+	timeIndices.setCount(meshInstance.times.count());
+	for (int i=0; i<meshInstance.times.count(); i++)
+		timeIndices[i]=getSampleIndex(meshInstance.times[i], sampleTimes);
+	writeArray(timeIndices.count()>0? &timeIndices[0] : nullptr, timeIndices.count(), int(sizeof(int)));
+
+	writeKeyframedList(meshSource.verticesParam, sampleTimes);
+	writeKeyframedList(meshSource.facesParam, sampleTimes);
+	writeKeyframedList(meshSource.normalsParam, sampleTimes);
+	writeKeyframedList(meshSource.faceNormalsParam, sampleTimes);
+	writeKeyframedList(meshSource.velocitiesParam, sampleTimes);
+
+	// Mapping channels.
+	AnimatedMapChannelsParam &mapChannelsParam=meshSource.mapChannelsParam;
+	writeInt(mapChannelsParam.getNumKeyframes());
+	for (int i=0; i<mapChannelsParam.getNumKeyframes(); i++) {
+		AbcMapChannelsList &mapChannels=mapChannelsParam.getKeyframeData(i);
+		writeInt(getSampleIndex(mapChannelsParam.getKeyframeTime(i), sampleTimes));
+		writeInt(mapChannels.count());
+		for (int j=0; j<mapChannels.count(); j++) {
+			AbcMapChannel &mapChannel=mapChannels[j];
+			writeInt(mapChannel.idx);
+			writeArray(mapChannel.verts.count()>0? &mapChannel.verts[0] : nullptr, mapChannel.verts.count(), int(sizeof(Vector)));
+			writeArray(mapChannel.faces.count()>0? &mapChannel.faces[0] : nullptr, mapChannel.faces.count(), int(sizeof(int)));
+		}
+	}
+
+	// Mapping channel names.
+	AnimatedStringListParam &mapChannelNamesParam=meshSource.mapChannelNamesParam;
+	writeInt(mapChannelNamesParam.getNumKeyframes());
+	for (int i=0; i<mapChannelNamesParam.getNumKeyframes(); i++) {
+		StringList &names=mapChannelNamesParam.getKeyframeData(i);
+		writeInt(getSampleIndex(mapChannelNamesParam.getKeyframeTime(i), sampleTimes));
+		writeInt(names.count());
+		for (int j=0; j<names.count(); j++)
+			writeString(names[j]);
+	}
+
+	// Face sets.
+	writeKeyframedList(meshSource.faceMtlIDsParam, sampleTimes);
+	writeInt(meshSource.faceSetNames.count());
+	for (int i=0; i<meshSource.faceSetNames.count(); i++)
+		writeString(meshSource.faceSetNames[i]);
+}
+
+ErrorCode GeomCacheWriter::close(void) {
+	if (!file)
+		return ErrorCode(__FUNCTION__, -1, "No cache file is open");
+
+	// Write the object directory.
+	align();
+	uint64 directoryOffset=offset;
+	for (int i=0; i<objectOffsets.count(); i++) {
+		GeomCacheDirEntry entry;
+		entry.voxelIndex=voxelIndices[i];
+		entry.reserved=0;
+		entry.offset=objectOffsets[i];
+		write(&entry, sizeof(entry));
+	}
+
+	// Rewrite the header with the number of objects and the directory offset.
+	GeomCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, GEOM_CACHE_MAGIC, sizeof(header.magic));
+	header.version=GEOM_CACHE_VERSION;
+	header.numObjects=uint32(objectOffsets.count());
+	header.sourceSize=sourceStamp.size;
+	header.sourceMTime=sourceStamp.mtime;
+	header.settingsHash=settingsHash;
+	header.directoryOffset=directoryOffset;
+
+	fseek(file, 0, SEEK_SET);
+	fwrite(&header, 1, sizeof(header), file);
+
+	int writeError=ferror(file);
+	fclose(file);
+	file=nullptr;
+
+	if (writeError) {
+		remove(tempFileName.ptr());
+		return ErrorCode(__FUNCTION__, -1, "Failed to write cache file \"%s\"", cacheFileName.ptr());
+	}
+
+	// Replace the cache file with the new one.
+	remove(cacheFileName.ptr());
+	if (rename(tempFileName.ptr(), cacheFileName.ptr())!=0) {
+		remove(tempFileName.ptr());
+		return ErrorCode(__FUNCTION__, -1, "Cannot rename \"%s\" to \"%s\"", tempFileName.ptr(), cacheFileName.ptr());
+	}
+
+	voxelIndices.clear();
+	objectOffsets.clear();
+	return ErrorCode();
+}
+
+void GeomCacheWriter::abort(void) {
+	if (file) {
+		fclose(file);
+		file=nullptr;
+		remove(tempFileName.ptr());
+	}
+	voxelIndices.clear();
+	objectOffsets.clear();
+}
+
+//*************************************************************
+// GeomCacheReader
+
+/// A helper to read data from the mapped cache file with bounds checking.
+struct GeomCacheCursor {
+	const uint8 *base; ///< The start of the file.
+	uint64 size; ///< The size of the file.
+	uint64 offset; ///< The current offset.
+	int ok; ///< false if we tried to read past the end of the file.
+
+	GeomCacheCursor(const uint8 *data, uint64 dataSize, uint64 startOffset):base(data), size(dataSize), offset(startOffset), ok(true) {}
+
+	int readInt(void) {
+		int res=0;
+		if (offset+sizeof(int)>size) {
+			ok=false;
+			return 0;
+		}
+		memcpy(&res, base+offset, sizeof(int));
+		offset+=sizeof(int);
+		return res;
+	}
+
+	void align(void) {
+		offset+=(GEOM_CACHE_ALIGNMENT-(offset%GEOM_CACHE_ALIGNMENT))%GEOM_CACHE_ALIGNMENT;
+	}
+
+	/// Return a pointer to the data of the next array in the file.
+	void* readArray(int expectedElementSize, int &count) {
+		count=readInt();
+		int elementSize=readInt();
+		align();
+		if (!ok || count<0 || (count>0 && elementSize!=expectedElementSize)) {
+			ok=false;
+			count=0;
+			return nullptr;
+		}
+
+		uint64 numBytes=uint64(count)*uint64(elementSize);
+		if (offset+numBytes>size) {
+			ok=false;
+			count=0;
+			return nullptr;
+		}
+
+		void *res=const_cast<uint8*>(base+offset);
+		offset+=numBytes;
+		align();
+		return res;
+	}
+
+	CharString readString(void) {
+		int len=0;
+		const tchar *str=static_cast<const tchar*>(readArray(1, len));
+		CharString res;
+		if (str && len>0)
+			res=std::string(str, len).c_str();
+		return res;
+	}
+};
+
+ErrorCode GeomCacheReader::open(const tchar *cacheFileName, const FileStamp &sourceStamp, uint64 settingsHash) {
+	close();
+
+	if (!mappedFile.open(cacheFileName))
+		return ErrorCode(__FUNCTION__, -1, "Cannot map cache file \"%s\"", cacheFileName);
+
+	const uint8 *data=mappedFile.data();
+	uint64 size=mappedFile.size();
+
+	GeomCacheHeader header;
+	if (size<sizeof(header)) {
+		close();
+		return ErrorCode(__FUNCTION__, -1, "Invalid cache file \"%s\"", cacheFileName);
+	}
+	memcpy(&header, data, sizeof(header));
+
+	if (0!=memcmp(header.magic, GEOM_CACHE_MAGIC, sizeof(header.magic)) || header.version!=GEOM_CACHE_VERSION) {
+		close();
+		return ErrorCode(__FUNCTION__, -1, "Invalid cache file \"%s\"", cacheFileName);
+	}
+
+	if (header.sourceSize!=sourceStamp.size || header.sourceMTime!=sourceStamp.mtime || header.settingsHash!=settingsHash) {
+		close();
+		return ErrorCode(__FUNCTION__, -1, "Cache file \"%s\" is out of date", cacheFileName);
+	}
+
+	uint64 directorySize=uint64(header.numObjects)*sizeof(GeomCacheDirEntry);
+	if (header.directoryOffset+directorySize>size) {
+		close();
+		return ErrorCode(__FUNCTION__, -1, "Invalid cache file \"%s\"", cacheFileName);
+	}
+
+	voxelIndices.setCount(header.numObjects);
+	objectOffsets.setCount(header.numObjects);
+	for (uint32 i=0; i<header.numObjects; i++) {
+		GeomCacheDirEntry entry;
+		memcpy(&entry, data+header.directoryOffset+i*sizeof(GeomCacheDirEntry), sizeof(entry));
+		voxelIndices[i]=entry.voxelIndex;
+		objectOffsets[i]=entry.offset;
+	}
+
+	return ErrorCode();
+}
+
+void GeomCacheReader::close(void) {
+	mappedFile.close();
+	voxelIndices.clear();
+	objectOffsets.clear();
+}
+
+// Read a keyframed vector list that points into the mapped file.
+static void readKeyframedVectorList(GeomCacheCursor &cursor, AnimatedVectorListParam &param, const TimesList &sampleTimes) {
+	int numKeyframes=cursor.readInt();
+	for (int i=0; i<numKeyframes && cursor.ok; i++) {
+		int sampleIdx=cursor.readInt();
+		int count=0;
+		Vector *data=static_cast<Vector*>(cursor.readArray(int(sizeof(Vector)), count));
+		if (cursor.ok && sampleIdx>=0 && sampleIdx<sampleTimes.count())
+			param.addKeyframe(sampleTimes[sampleIdx], VectorList(data, count));
+	}
+}
+
+// Read a keyframed integer list that points into the mapped file.
+static void readKeyframedIntList(GeomCacheCursor &cursor, AnimatedIntListParam &param, const TimesList &sampleTimes) {
+	int numKeyframes=cursor.readInt();
+	for (int i=0; i<numKeyframes && cursor.ok; i++) {
+		int sampleIdx=cursor.readInt();
+		int count=0;
+		int *data=static_cast<int*>(cursor.readArray(int(sizeof(int)), count));
+		if (cursor.ok && sampleIdx>=0 && sampleIdx<sampleTimes.count())
+			param.addKeyframe(sampleTimes[sampleIdx], IntList(data, count));
+	}
+}
+
+// Return true if all indices in the keyframes of the given index list are below the number of elements in every
+// keyframe of the given list, so that a corrupt cache file cannot make the mesh reference data past its end.
+template<class T>
+static int checkIndices(AnimatedIntListParam &indicesParam, AnimatedParam<T> &elementsParam) {
+	int numIndexKeyframes=indicesParam.getNumKeyframes();
+	if (numIndexKeyframes==0)
+		return true;
+
+	int numElements=-1;
+	for (int i=0; i<elementsParam.getNumKeyframes(); i++) {
+		int count=elementsParam.getKeyframeData(i).count();
+		if (numElements<0 || count<numElements)
+			numElements=count;
+	}
+	if (numElements<0)
+		numElements=0;
+
+	for (int i=0; i<numIndexKeyframes; i++) {
+		IntList &indices=indicesParam.getKeyframeData(i);
+		for (int j=0; j<indices.count(); j++) {
+			if (indices[j]<0 || indices[j]>=numElements)
+				return false;
+		}
+	}
+	return true;
+}
+
+// Return true if all face indices of the given map channel are below its number of vertices.
+static int checkMapChannelIndices(const AbcMapChannel &mapChannel) {
+	int numVerts=mapChannel.verts.count();
+	for (int i=0; i<mapChannel.faces.count(); i++) {
+		if (mapChannel.faces[i]<0 || mapChannel.faces[i]>=numVerts)
+			return false;
+	}
+	return true;
+}
+
+AlembicMeshSource* GeomCacheReader::loadObject(int objectIndex, const TimesList &sampleTimes, AlembicMeshInstance &meshInstance) {
+	if (!isOpen() || objectIndex<0 || objectIndex>=objectOffsets.count())
+		return nullptr;
+
+	GeomCacheCursor cursor(mappedFile.data(), mappedFile.size(), objectOffsets[objectIndex]);
+
+	AlembicMeshSource *meshSource=new AlembicMeshSource;
+	meshSource->setNumTimeSteps(sampleTimes.count());
+	meshSource->voxelIndex=cursor.readInt();
+	meshInstance.abcName=cursor.readString();
+	meshSource->abcName=meshInstance.abcName;
+	meshSource->usesMappedData=true;
+
+	int numTMs=0;
+	const Transform *tms=static_cast<const Transform*>(cursor.readArray(int(sizeof(Transform)), numTMs));
+	int numTimes=0;
+	const int *timeIndices=static_cast<const int*>(cursor.readArray(int(sizeof(int)), numTimes));
+	if (cursor.ok && numTMs==numTimes) {
+		meshInstance.tms.setCount(numTMs);
+		meshInstance.times.setCount(numTimes);
+		for (int i=0; i<numTMs; i++) {
+			meshInstance.tms[i]=tms[i];
+			int sampleIdx=timeIndices[i];
+			meshInstance.times[i]=(sampleIdx>=0 && sampleIdx<sampleTimes.count())? sampleTimes[sampleIdx] : 0.0;
+		}
+	} else {
+		cursor.ok=false;
+	}
+
+	readKeyframedVectorList(cursor, meshSource->verticesParam, sampleTimes);
+	readKeyframedIntList(cursor, meshSource->facesParam, sampleTimes);
+	readKeyframedVectorList(cursor, meshSource->normalsParam, sampleTimes);
+	readKeyframedIntList(cursor, meshSource->faceNormalsParam, sampleTimes);
+	readKeyframedVectorList(cursor, meshSource->velocitiesParam, sampleTimes);
+
+	// Mapping channels.
+	int numMapKeyframes=cursor.readInt();
+	for (int i=0; i<numMapKeyframes && cursor.ok; i++) {
+		int sampleIdx=cursor.readInt();
+		int numChannels=cursor.readInt();
+		if (sampleIdx<0 || sampleIdx>=sampleTimes.count() || numChannels<0) {
+			cursor.ok=false;
+			break;
+		}
+
+		AbcMapChannelsList &mapChannels=meshSource->mapChannelsParam.addKeyframe(sampleTimes[sampleIdx]);
+		mapChannels.setCount(numChannels);
+		for (int j=0; j<numChannels && cursor.ok; j++) {
+			AbcMapChannel &mapChannel=mapChannels[j];
+			mapChannel.idx=cursor.readInt();
+
+			int numVerts=0;
+			Vector *verts=static_cast<Vector*>(cursor.readArray(int(sizeof(Vector)), numVerts));
+			mapChannel.verts=VectorList(verts, numVerts);
+
+			int numFaceIndices=0;
+			int *faces=static_cast<int*>(cursor.readArray(int(sizeof(int)), numFaceIndices));
+			mapChannel.faces=IntList(faces, numFaceIndices);
+
+			if (!checkMapChannelIndices(mapChannel))
+				cursor.ok=false;
+		}
+	}
+
+	// Mapping channel names.
+	int numNameKeyframes=cursor.readInt();
+	for (int i=0; i<numNameKeyframes && cursor.ok; i++) {
+		int sampleIdx=cursor.readInt();
+		int numNames=cursor.readInt();
+		if (sampleIdx<0 || sampleIdx>=sampleTimes.count() || numNames<0) {
+			cursor.ok=false;
+			break;
+		}
+
+		StringList &names=meshSource->mapChannelNamesParam.addKeyframe(sampleTimes[sampleIdx]);
+		names.setCount(numNames);
+		for (int j=0; j<numNames && cursor.ok; j++)
+			names[j]=cursor.readString();
+	}
+
+	// Face sets.
+	readKeyframedIntList(cursor, meshSource->faceMtlIDsParam, sampleTimes);
+	int numFaceSets=cursor.readInt();
+	if (numFaceSets<0) {
+		cursor.ok=false;
+	} else {
+		meshSource->faceSetNames.setCount(numFaceSets);
+		for (int i=0; i<numFaceSets && cursor.ok; i++)
+			meshSource->faceSetNames[i]=cursor.readString();
+	}
+
+	// The faces are used without further checks, so an index past the vertices would read outside the mapped file.
+	if (cursor.ok) {
+		cursor.ok=
+			checkIndices(meshSource->facesParam, meshSource->verticesParam) &&
+			checkIndices(meshSource->faceNormalsParam, meshSource->normalsParam);
+	}
+
+	if (!cursor.ok) {
+		delete meshSource;
+		return nullptr;
+	}
+
+	return meshSource;
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "utils.h"
+#include "charstring.h"
+
+struct AlembicMeshSource;
+struct AlembicMeshInstance;
+template<class T> struct AnimatedParam;
+
+typedef VR::Table<double, -1> TimesList;
+
+/// The size and modification time of a file, used to detect changes to it.
+struct FileStamp {
+	VR::uint64 size; ///< The file size in bytes.
+	VR::uint64 mtime; ///< The last modification time.
+
+	/// Constructor.
+	FileStamp(void):size(0), mtime(0) {}
+
+	bool operator==(const FileStamp &other) const { return size==other.size && mtime==other.mtime; }
+	bool operator!=(const FileStamp &other) const { return !(*this==other); }
+};
+
+/// Read the size and modification time of the given file.
+/// @retval true if successful and false if the file does not exist.
+int getFileStamp(const tchar *fileName, FileStamp &stamp);
+
+/// A read-only, copy-on-write memory mapping of a whole file.
+struct MappedFile {
+	/// Constructor.
+	MappedFile(void);
+
+	/// Destructor.
+	~MappedFile(void) { close(); }
+
+	/// Map the given file into memory.
+	/// @retval true if successful and false otherwise.
+	int open(const tchar *fileName);
+
+	/// Unmap the file.
+	void close(void);
+
+	/// Return the start of the mapped memory; the address is aligned to the system page size.
+	const VR::uint8* data(void) const { return ptr; }
+
+	/// Return the size of the mapped memory in bytes.
+	VR::uint64 size(void) const { return numBytes; }
+
+protected:
+	VR::uint8 *ptr; ///< The mapped memory.
+	VR::uint64 numBytes; ///< The size of the mapped memory.
+#ifdef _WIN32
+	void *fileHandle; ///< The file handle.
+	void *mappingHandle; ///< The file mapping handle.
+#endif
+};
+
+/// Return the file name of the converted geometry cache for the given source file and frame.
+/// @param sourceFile The .vrmesh/Alembic file.
+/// @param cacheDir The directory for the cache files; if empty, the cache files are placed next to the source file.
+/// @param settingsHash A hash of the settings that affect the converted geometry.
+/// @param frameNumber The frame number.
+VR::CharString getGeomCacheFileName(const VR::CharString &sourceFile, const VR::CharString &cacheDir, VR::uint64 settingsHash, int frameNumber);
+
+/// Writes the converted geometry for one frame into a cache file. All arrays in the file are aligned to 16 bytes,
+/// so that when the file is memory-mapped at a page-aligned address they can be used directly.
+/// The data is written into a temporary file which replaces the cache file in close(). The name of the temporary file
+/// includes the process and thread ids, so that several writers of the same cache file do not clash.
+struct GeomCacheWriter {
+	/// Constructor.
+	GeomCacheWriter(void):file(nullptr), offset(0), settingsHash(0) {}
+
+	/// Destructor.
+	~GeomCacheWriter(void) { abort(); }
+
+	/// Start writing a new cache file.
+	/// @param cacheFileName The name of the cache file.
+	/// @param sourceStamp The stamp of the source file.
+	/// @param settingsHash A hash of the settings that affect the converted geometry.
+	VR::ErrorCode open(const tchar *cacheFileName, const FileStamp &sourceStamp, VR::uint64 settingsHash);
+
+	/// Return true if a cache file is being written.
+	int isOpen(void) const { return file!=nullptr; }
+
+	/// Append the geometry of an object to the cache file.
+	/// @param meshSource The mesh source; its keyframe times must be the times from sampleTimes.
+	/// @param meshInstance The instance with the name and the transformations of the object.
+	/// @param sampleTimes The times of the time samples for the current frame.
+	void addObject(AlembicMeshSource &meshSource, const AlembicMeshInstance &meshInstance, const TimesList &sampleTimes);
+
+	/// Finish writing the cache file.
+	VR::ErrorCode close(void);
+
+	/// Stop writing and delete the temporary file.
+	void abort(void);
+
+protected:
+	FILE *file; ///< The temporary file being written.
+	VR::uint64 offset; ///< The current offset in the file.
+	VR::CharString cacheFileName; ///< The final name of the cache file.
+	VR::CharString tempFileName; ///< The name of the temporary file.
+	FileStamp sourceStamp; ///< The stamp of the source file.
+	VR::uint64 settingsHash; ///< The hash of the settings used to convert the geometry.
+	VR::Table<int, -1> voxelIndices; ///< The voxel index of each object written so far.
+	VR::Table<VR::uint64, -1> objectOffsets; ///< The offset of each object written so far.
+
+	void write(const void *data, size_t size);
+	void writeInt(int value);
+	void align(void);
+	void writeArray(const void *data, int count, int elementSize);
+	void writeString(const VR::CharString &str);
+
+	template<class T>
+	void writeKeyframedList(AnimatedParam<T> &param, const TimesList &sampleTimes);
+};
+
+/// Reads the converted geometry for one frame from a cache file written by GeomCacheWriter. The vertices, faces, normals,
+/// velocities and UV/color sets of the loaded objects point directly into the mapped file, so the reader must stay open
+/// for as long as the objects are used.
+struct GeomCacheReader {
+	/// Open and validate the given cache file.
+	/// @param cacheFileName The name of the cache file.
+	/// @param sourceStamp The stamp of the source file; the cache is rejected if it was created from a different file.
+	/// @param settingsHash A hash of the settings; the cache is rejected if it was created with different settings.
+	/// This includes the visibility and channel rules from the rules file, rather than the stamp of the file.
+	VR::ErrorCode open(const tchar *cacheFileName, const FileStamp &sourceStamp, VR::uint64 settingsHash);
+
+	/// Close the cache file.
+	void close(void);
+
+	/// Return true if a cache file is open.
+	int isOpen(void) const { return mappedFile.data()!=nullptr; }
+
+	/// Return the number of objects in the cache file.
+	int getNumObjects(void) const { return objectOffsets.count(); }
+
+	/// Create a mesh source for the given object.
+	/// @param objectIndex The index of the object in the cache file.
+	/// @param sampleTimes The times of the time samples for the current frame.
+	/// @param[out] meshInstance Receives the name and the transformations of the object.
+	/// @retval The new mesh source, or nullptr if the data is corrupt.
+	AlembicMeshSource* loadObject(int objectIndex, const TimesList &sampleTimes, AlembicMeshInstance &meshInstance);
+
+protected:
+	MappedFile mappedFile; ///< The mapped cache file.
+	VR::Table<int, -1> voxelIndices; ///< The voxel index of each object.
+	VR::Table<VR::uint64, -1> objectOffsets; ///< The offset of each object in the file.
+};
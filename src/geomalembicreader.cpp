@@ -1,4 +1,11 @@
 #include "geomalembicreader.h"
+#include "hash_utils.h"
+#include "shared_geometry.h"
+
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 using namespace VR;
 
@@ -6,19 +13,22 @@ using namespace VR;
 // GeomAlembicReaderInstance
 
 struct GeomAlembicReaderInstance: VRayStaticGeometry {
-	GeomAlembicReaderInstance(GeomAlembicReader *abcReader):reader(abcReader) {
+	GeomAlembicReaderInstance(GeomAlembicReader *abcReader):reader(abcReader), volume(NULL), lightList(NULL), compiledVRay(NULL) {
 	}
 
 	void compileGeometry(VR::VRayRenderer *vray, const VR::Transform *_tm, double *_times, int _tmCount) VRAY_OVERRIDE {
-		createMeshInstances(vray, renderID, NULL, NULL, Transform(1), objectID, userAttrs.ptr(), primaryVisibility);
+		createMeshInstances(vray, renderID, volume, lightList, Transform(1), objectID, userAttrs.ptr(), primaryVisibility);
 
 		const VRayFrameData &fdata=vray->getFrameData();
 
-		// Scratchpad arrays for computing transformation matrices
-		TransformsList transforms;
-
-		// Allocate memory for mesh transformations
-		// Transform *tms=(Transform*) alloca(tmCount*sizeof(Transform));
+		// Remember the Node transformations so that single mesh instances can be recompiled later.
+		compiledVRay=vray;
+		nodeTransforms.setCount(_tmCount);
+		nodeTimes.setCount(_tmCount);
+		for (int i=0; i<_tmCount; i++) {
+			nodeTransforms[i]=_tm[i];
+			nodeTimes[i]=_times[i];
+		}
 
 		int numInstances=reader->meshInstances.count();
 		for (int i=0; i<numInstances; i++) {
@@ -26,16 +36,7 @@ struct GeomAlembicReaderInstance: VRayStaticGeometry {
 			if (!abcInstance || !abcInstance->meshInstance)
 				continue;
 
-			// Compute the transformations for this mesh
-			double *times=&(abcInstance->times[0]);
-			
-			// Apply the transformation of the main alembic reader to the local transformations of the instances.
-			// Note that both may have a different number of time steps, so the blending is a bit more convoluted.
-			multiplyTransforms(transforms, abcInstance->tms, abcInstance->times, _tm, _times, _tmCount);
-
-			vassert(transforms.count()==abcInstance->times.count());
-
-			abcInstance->meshInstance->compileGeometry(vray, &transforms[0], times, transforms.count());
+			compileMeshInstance(*abcInstance);
 		}
 	}
 
@@ -49,17 +50,69 @@ struct GeomAlembicReaderInstance: VRayStaticGeometry {
 			abcInstance->meshInstance->clearGeometry(vray);
 		}
 		deleteMeshInstances();
+
+		// Objects added before the next compileGeometry(), f.e. by progressive loading when the frame starts again,
+		// are instanced there along with the rest.
+		compiledVRay=NULL;
 	}
 
 	void updateMaterial(MaterialInterface *mtl, BSDFInterface *bsdf, int renderID, VolumetricInterface *volume, LightList *lightList, int objectID) VRAY_OVERRIDE {
+		this->renderID=renderID;
+		this->objectID=objectID;
+		this->volume=volume;
+		this->lightList=lightList;
+
+		// Pick up any changes to the file and the material inputs first; the objects keep their own material assignments.
+		reader->updateChangedGeometry();
+		reader->addProgressiveObjects();
+		reader->updateMaterialBindings();
+		rebindMaterials(true /* all */);
+	}
+
+	/// Update the material of the mesh instances whose material assignment changed.
+	/// @param all true to update all mesh instances, f.e. if the render ID or the object ID changed.
+	/// @retval The number of updated mesh instances.
+	int rebindMaterials(int all) {
+		int numRebound=0;
 		int numInstances=reader->meshInstances.count();
 		for (int i=0; i<numInstances; i++) {
 			AlembicMeshInstance *abcInstance=reader->meshInstances[i];
 			if (!abcInstance || !abcInstance->meshInstance)
 				continue;
 
-			abcInstance->meshInstance->updateMaterial(mtl, bsdf, renderID, volume, lightList, objectID);
+			VRayPlugin *mtlPlugin=reader->getMaterialPluginForInstance(*abcInstance);
+			if (!all && mtlPlugin==abcInstance->mtlPlugin)
+				continue;
+
+			abcInstance->meshInstance->updateMaterial(getMaterial(mtlPlugin), getBSDF(mtlPlugin), renderID, volume, lightList, objectID);
+			abcInstance->mtlPlugin=mtlPlugin;
+			numRebound++;
 		}
+		return numRebound;
+	}
+
+	/// Delete the mesh instance of the given object, before its geometry plugin is replaced.
+	void clearMeshInstance(AlembicMeshInstance &abcInstance) {
+		if (!abcInstance.meshInstance)
+			return;
+
+		if (compiledVRay)
+			abcInstance.meshInstance->clearGeometry(compiledVRay);
+
+		StaticGeomSourceInterface *geom=static_cast<StaticGeomSourceInterface*>(GET_INTERFACE(abcInstance.meshSource->getGeomPlugin(), EXT_STATIC_GEOM_SOURCE));
+		if (geom)
+			geom->deleteInstance(abcInstance.meshInstance);
+		abcInstance.meshInstance=NULL;
+	}
+
+	/// Create and compile a new mesh instance for the given object, after its geometry plugin was replaced.
+	void recreateMeshInstance(AlembicMeshInstance &abcInstance) {
+		if (!compiledVRay || abcInstance.meshInstance)
+			return;
+
+		createMeshInstance(compiledVRay, abcInstance, renderID, volume, lightList, Transform(1), objectID, userAttrs.ptr(), primaryVisibility);
+		if (abcInstance.meshInstance)
+			compileMeshInstance(abcInstance);
 	}
 
 	VRayShadeData* getShadeData(const VRayContext &rc) VRAY_OVERRIDE { return NULL; }
@@ -69,12 +122,20 @@ struct GeomAlembicReaderInstance: VRayStaticGeometry {
 	void setRenderID(int id) { renderID=id; }
 	void setObjectID(int id) { objectID=id; }
 	void setUserAttrs(const tchar *str) { userAttrs=str; }
+	void setVolume(VolumetricInterface *vol) { volume=vol; }
+	void setLightList(LightList *lights) { lightList=lights; }
 protected:
 	GeomAlembicReader *reader;
 	int primaryVisibility;
 	int renderID;
 	int objectID;
 	CharString userAttrs;
+	VolumetricInterface *volume; ///< The volumetric shader of the Node.
+	LightList *lightList; ///< The lights that illuminate the Node, with light linking.
+
+	VRayRenderer *compiledVRay; ///< The renderer that the geometry was last compiled for.
+	TransformsList nodeTransforms; ///< The Node transformations that the geometry was last compiled with.
+	TimesList nodeTimes; ///< The times of nodeTransforms.
 
 	static MaterialInterface* getMaterial(VRayPlugin *mtl) {
 		return static_cast<MaterialInterface*>(GET_INTERFACE(mtl, EXT_MATERIAL));
@@ -91,29 +152,48 @@ protected:
 			if (!abcInstance)
 				continue;
 
-			VRayPlugin *geomPlugin=abcInstance->meshSource->getGeomPlugin();
+			createMeshInstance(vray, *abcInstance, renderID, volume, lightList, baseTM, objectID, userAttr, primaryVisibility);
+		}
+	}
 
-			StaticGeomSourceInterface *geom=static_cast<StaticGeomSourceInterface*>(GET_INTERFACE(geomPlugin, EXT_STATIC_GEOM_SOURCE));
-			if (geom) {
-				VRayPlugin *mtlPlugin=reader->getMaterialPluginForInstance(abcInstance->abcName);
-				NewInstanceParameters params(
-					getMaterial(mtlPlugin),
-					getBSDF(mtlPlugin),
-					renderID,
-					NULL,
-					lightList,
-					baseTM,
-					objectID,
-					userAttr,
-					primaryVisibility,
-					vray
-				);
-				abcInstance->meshInstance=geom->newInstance(params);
-				VR::registerRenderInstance2(vray, geom, renderID, mtlPlugin, userAttr);
-			}
+	void createMeshInstance(VRayRenderer* vray, AlembicMeshInstance &abcInstance, int renderID, VolumetricInterface *volume, LightList *lightList, const Transform &baseTM, int objectID, const tchar *userAttr, int primaryVisibility) {
+		VRayPlugin *geomPlugin=abcInstance.meshSource->getGeomPlugin();
+
+		StaticGeomSourceInterface *geom=static_cast<StaticGeomSourceInterface*>(GET_INTERFACE(geomPlugin, EXT_STATIC_GEOM_SOURCE));
+		if (geom) {
+			VRayPlugin *mtlPlugin=reader->getMaterialPluginForInstance(abcInstance);
+			NewInstanceParameters params(
+				getMaterial(mtlPlugin),
+				getBSDF(mtlPlugin),
+				renderID,
+				volume,
+				lightList,
+				baseTM,
+				objectID,
+				userAttr,
+				primaryVisibility,
+				vray
+			);
+			abcInstance.meshInstance=geom->newInstance(params);
+			abcInstance.mtlPlugin=mtlPlugin;
+			VR::registerRenderInstance2(vray, geom, renderID, mtlPlugin, userAttr);
 		}
 	}
 
+	void compileMeshInstance(AlembicMeshInstance &abcInstance) {
+		// Scratchpad arrays for computing transformation matrices
+		TransformsList transforms;
+		TimesList transformTimes;
+
+		// Apply the transformation of the main alembic reader to the local transformations of the instances.
+		// Note that both may have a different number of time steps, so the blending is a bit more convoluted.
+		multiplyTransforms(transforms, transformTimes, abcInstance.tms, abcInstance.times, &nodeTransforms[0], &nodeTimes[0], nodeTransforms.count());
+
+		vassert(transforms.count()==transformTimes.count());
+
+		abcInstance.meshInstance->compileGeometry(compiledVRay, &transforms[0], &transformTimes[0], transforms.count());
+	}
+
 	void deleteMeshInstances(void) {
 		int numInstances=reader->meshInstances.count();
 		for (int i=0; i<numInstances; i++) {
@@ -130,8 +210,11 @@ protected:
 	}
 
 	/// Multiply an array of local transformations with an array of global transforms.
+	/// If there is a single local transformation (f.e. for a static object), the result is sampled at
+	/// the times of the global transforms so that the motion of the node itself is preserved.
 	void multiplyTransforms(
-		TransformsList &result, ///< The result is stored here and has the same number of elements as localTransforms.
+		TransformsList &result, ///< The result is stored here.
+		TimesList &resultTimes, ///< The times for the transforms in result.
 		const TransformsList &localTransforms, ///< The list of local transforms.
 		const TimesList &localTimes, ///< The times when the local transforms were sampled, in increasing order.
 		const Transform *tms, ///< An array of global transforms.
@@ -139,10 +222,22 @@ protected:
 		int tmCount ///< The number of global transforms.
 	) const {
 		int numLocalTMs=localTransforms.count();
+		if (numLocalTMs==1 && tmCount>1) {
+			result.setCount(tmCount);
+			resultTimes.setCount(tmCount);
+			for (int i=0; i<tmCount; i++) {
+				result[i]=tms[i]*localTransforms[0];
+				resultTimes[i]=times[i];
+			}
+			return;
+		}
+
 		result.setCount(numLocalTMs);
+		resultTimes.setCount(numLocalTMs);
 		for (int i=0; i<numLocalTMs; i++) {
 			double localTime=localTimes[i];
 			result[i]=getInterpolatedTransform(tms, times, tmCount, localTime)*localTransforms[i];
+			resultTimes[i]=localTime;
 		}
 	}
 
@@ -195,6 +290,9 @@ VRayStaticGeometry* GeomAlembicReader::newInstance(
 	abcReaderInstance->setObjectID(objectID);
 	abcReaderInstance->setPrimaryVisibility(primaryVisibility);
 	abcReaderInstance->setUserAttrs(userAttr);
+	abcReaderInstance->setVolume(volume);
+	abcReaderInstance->setLightList(lightList);
+	readerInstances+=abcReaderInstance;
 	return abcReaderInstance;
 }
 
@@ -207,6 +305,13 @@ void GeomAlembicReader::deleteInstance(VRayStaticGeometry *instance) {
 		return;
 
 	GeomAlembicReaderInstance *abcReaderInstance=static_cast<GeomAlembicReaderInstance*>(instance);
+	for (int i=0; i<readerInstances.count(); i++) {
+		if (readerInstances[i]==abcReaderInstance) {
+			readerInstances[i]=readerInstances.last();
+			readerInstances.setCount(readerInstances.count()-1);
+			break;
+		}
+	}
 	delete abcReaderInstance;
 }
 
@@ -222,15 +327,99 @@ void GeomAlembicReader::preRenderBegin(VR::VRayRenderer *vray) {
 	VRayScene *vrayScene=vraySceneAccess->getScene();
 	if (!vrayScene) return;
 
-	const VRaySequenceData &sdata=vray->getSequenceData();
+	vrayRenderer=vray;
 
 	// Read the parameters explicitly as there is no-one to do it for us here.
 	paramList->cacheParams();
 
+	// Load the materials and the material assignments. Nothing uses the materials read for the previous render.
+	readMaterialInputs(vray, *vrayScene);
+	deleteReplacedMaterialDefinitions(*vrayScene);
+
+	// The visibility rules may have changed, so the cached voxel visibility is no longer valid.
+	resetVoxelVisibility();
+
+	// The file may have changed since the last render, so rebuild the metadata index on the first frame.
+	archiveIndex.clear();
+
+	// The frames of this render are not related to the ones of the previous render.
+	hasLastLoadedFrame=false;
+
+	// Create a default material.
+	defaultMtl=createDefaultMaterial();
+}
+
+void GeomAlembicReader::postRenderEnd(VR::VRayRenderer *vray) {
+	// Geometry prefetched for a frame that will not be rendered is no longer needed.
+	discardPrefetch();
+
+	// A progressively loaded frame may have been kept after frameEnd().
+	if (meshSources.count()>0)
+		unloadGeometry(vray);
+	stopProgressiveLoading();
+	freeRetainedMeshSources();
+	boundarySamples.freeMem();
+	freeFaceSetMaterials();
+	vrayRenderer=nullptr;
+
+	if (!plugman) return;
+
+	// Delete all the plugins that we created in preRenderBegin().
+	for (PluginsSet::iterator it=plugins.begin(); it!=plugins.end(); it++) {
+		VRayPlugin *plugin=it.key();
+			plugman->deletePlugin(plugin);
+	}
+	plugins.clear();
+
+	// The material plugins were deleted above, so their names can be used again.
+	numFaceSetMtlPlugins=0;
+
+	// No plugin uses the shared edge length and subdivision parameters any more.
+	sharedPluginParams.freeValueParams();
+
+	// Clear all the plugin parameters that we created.
+	factory.clear();
+
+	plugman=NULL;
+}
+
+void GeomAlembicReader::frameBegin(VR::VRayRenderer *vray) {
+	VRayStaticGeomSource::frameBegin(vray);
+	double time=vray->getFrameData().t;
+
+	// The material files may have been edited since the previous frame.
+	updateMaterialBindings();
+
+	// An interactive render that renders the same frame again keeps the objects that were loaded progressively, and
+	// the objects read in the background since then are added now; see frameEnd().
+	int frameNumber=vray->getFrameData().currentFrame;
+	if (meshSources.count()>0) {
+		if (progressiveData.frameNumber==frameNumber) {
+			updateChangedGeometry();
+			addProgressiveObjects();
+			return;
+		}
+		unloadGeometry(vray);
+	}
+
+	loadGeometry(frameNumber, vray);
+}
+
+void GeomAlembicReader::readMaterialInputs(VRayRenderer *vray, VRayScene &vrayScene) {
+	const VRaySequenceData &sdata=vray->getSequenceData();
+
+	// The face set materials reference the materials that are about to be replaced.
+	replaceFaceSetMaterials();
+
+	// The plugins of the previous read are deleted once the objects use the new ones.
+	for (int i=0; i<mtlDefsPlugins.count(); i++)
+		replacedMtlDefsPlugins+=mtlDefsPlugins[i];
+	mtlDefsPlugins.clear();
+
 	// Load the materials .vrscene file, if there is one specified
 	mtlsPrefix.clear();
 	if (!mtlDefsFileName.empty()) {
-		ErrorCode err=readMaterialDefinitions(mtlDefsFileName, sdata.progress, mtlsPrefix, *vrayScene);
+		ErrorCode err=readMaterialDefinitions(mtlDefsFileName, mtlDefsGeneration++, sdata.progress, mtlsPrefix, vrayScene, mtlDefsPlugins);
 		if (err.error()) {
 			CharString errStr=err.getErrorString();
 			sdata.progress->warning("Failed to read material definitions file \"%s\": %s", mtlDefsFileName.ptr(), errStr.ptr());
@@ -245,39 +434,281 @@ void GeomAlembicReader::preRenderBegin(VR::VRayRenderer *vray) {
 			sdata.progress->warning("Failed to read XML material assignments file \"%s\": %s", mtlAssignmentsFileName.ptr(), errStr.ptr());
 		} else {
 			// Parse the material assignments from the control file.
-			mtlAssignments.readFromXML(pxml, *vrayScene, mtlsPrefix, sdata.progress);
+			mtlAssignments.readFromXML(pxml, vrayScene, mtlsPrefix, sdata.progress);
 		}
 	}
 
-	// Create a default material.
-	defaultMtl=createDefaultMaterial();
+	// Remember the stamps of the files so that changes can be detected.
+	mtlDefsStamp=FileStamp();
+	if (!mtlDefsFileName.empty())
+		getFileStamp(mtlDefsFileName.ptr(), mtlDefsStamp);
+
+	mtlAssignmentsStamp=FileStamp();
+	if (!mtlAssignmentsFileName.empty())
+		getFileStamp(mtlAssignmentsFileName.ptr(), mtlAssignmentsStamp);
 }
 
-void GeomAlembicReader::postRenderEnd(VR::VRayRenderer *vray) {
-	if (!plugman) return;
+int GeomAlembicReader::materialInputsChanged(void) const {
+	FileStamp stamp;
+	if (!mtlDefsFileName.empty() && getFileStamp(mtlDefsFileName.ptr(), stamp) && stamp!=mtlDefsStamp)
+		return true;
 
-	// Delete all the plugins that we created in preRenderBegin().
-	for (PluginsSet::iterator it=plugins.begin(); it!=plugins.end(); it++) {
-		VRayPlugin *plugin=it.key();
-			plugman->deletePlugin(plugin);
+	stamp=FileStamp();
+	if (!mtlAssignmentsFileName.empty() && getFileStamp(mtlAssignmentsFileName.ptr(), stamp) && stamp!=mtlAssignmentsStamp)
+		return true;
+
+	return false;
+}
+
+int GeomAlembicReader::updateChangedGeometry(void) {
+	if (!incrementalReload || !vrayRenderer || !plugman || loadInfo.fileName.empty())
+		return false;
+
+	FileStamp stamp;
+	if (!getFileStamp(loadInfo.fileName.ptr(), stamp) || stamp==loadInfo.fileStamp)
+		return false;
+
+	VRayRenderer *vray=vrayRenderer;
+	const VRaySequenceData &sdata=vray->getSequenceData();
+
+	AlembicParams abcParams=loadInfo.abcParams;
+	MeshFile *alembicFile=openMeshFile(loadInfo.fileName.ptr(), loadInfo.frameNumber, loadInfo.fps, abcParams, vray, sdata.threadManager, sdata.progress);
+	if (!alembicFile)
+		return false;
+
+	loadInfo.fileStamp=stamp;
+
+	// All objects are read again below, including the ones that progressive loading did not add yet. The background
+	// threads use the metadata index and the voxel visibility that are rebuilt below, and the prefetched frame was
+	// read from the old file contents.
+	stopProgressiveLoading();
+	discardPrefetch();
+
+	// The objects in the file may be different now, so rebuild the metadata index and the voxel visibility.
+	archiveIndex.clear();
+	resetVoxelVisibility();
+	initArchiveIndex(*alembicFile, vray, loadInfo.frameNumber);
+
+	DefaultMeshSetsData setsData;
+	readMeshSetsData(*alembicFile, archiveIndex.getPreviewVoxelIndex(), loadInfo.readParams.nsamples, setsData);
+
+	AlembicReadParams readParams=loadInfo.readParams;
+	readParams.meshSets=&setsData;
+	readParams.computeGeometryHash=true;
+	readParams.archiveIndex=&archiveIndex;
+	readParams.voxelVisibility=&voxelVisibility;
+
+	Table<AlembicMeshSource*, -1> newSources;
+	Table<AlembicMeshInstance*, -1> newInstances;
+	initVoxelVisibility(*alembicFile);
+	readAllMeshSources(readParams, *alembicFile, voxelVisibility, newSources, newInstances);
+
+	readParams.meshSets=nullptr;
+	deleteDefaultMeshFile(alembicFile);
+
+	// Match the objects in the file to the loaded ones by name.
+	std::unordered_map<std::string, int> loadedIndices;
+	for (int i=0; i<meshInstances.count(); i++) {
+		const CharString &abcName=meshInstances[i]->abcName;
+		if (!abcName.empty())
+			loadedIndices[std::string(abcName.ptr())]=i;
 	}
-	plugins.clear();
 
-	// Clear all the plugin parameters that we created.
-	factory.clear();
+	std::vector<char> keepLoaded(meshInstances.count(), false);
+	Table<AlembicMeshInstance*, -1> addedInstances;
+	int numAdded=0, numTopologyChanged=0, numPointsChanged=0;
+	for (int i=0; i<newInstances.count(); i++) {
+		AlembicMeshInstance *newInstance=newInstances[i];
+
+		int loadedIndex=-1;
+		if (!newInstance->abcName.empty()) {
+			auto it=loadedIndices.find(std::string(newInstance->abcName.ptr()));
+			if (it!=loadedIndices.end())
+				loadedIndex=it->second;
+		}
 
-	plugman=NULL;
+		if (loadedIndex>=0) {
+			AlembicMeshInstance *loadedInstance=meshInstances[loadedIndex];
+			if (loadedInstance->geometryHash!=0 && loadedInstance->geometryHash==newInstance->geometryHash) {
+				// The object did not change; keep its plugins and instances.
+				keepLoaded[loadedIndex]=true;
+				delete newInstance->meshSource;
+				delete newInstance;
+				continue;
+			}
+
+			if (loadedInstance->topologyHash!=newInstance->topologyHash) numTopologyChanged++;
+			else numPointsChanged++;
+		} else {
+			numAdded++;
+		}
+		addedInstances+=newInstance;
+	}
+
+	// Drop the instances of the removed and changed objects from all Nodes.
+	for (int i=0; i<meshInstances.count(); i++) {
+		if (keepLoaded[i])
+			continue;
+
+		for (int j=0; j<readerInstances.count(); j++)
+			readerInstances[j]->clearMeshInstance(*meshInstances[i]);
+	}
+
+	// Delete them along with the meshes that are not used by the remaining objects; automatically
+	// instanced objects may share the mesh of an object that did not change.
+	std::unordered_map<AlembicMeshSource*, int> usedSources;
+	int numKept=0;
+	for (int i=0; i<meshInstances.count(); i++) {
+		AlembicMeshInstance *abcMeshInstance=meshInstances[i];
+		if (keepLoaded[i]) {
+			usedSources[abcMeshInstance->meshSource]=1;
+			abcMeshInstance->meshIndex=numKept;
+			meshInstances[numKept++]=abcMeshInstance;
+		} else {
+			delete abcMeshInstance;
+		}
+	}
+	int numRemoved=meshInstances.count()-numKept-numTopologyChanged-numPointsChanged;
+	meshInstances.setCount(numKept);
+
+	int numKeptSources=0;
+	for (int i=0; i<meshSources.count(); i++) {
+		AlembicMeshSource *abcMeshSource=meshSources[i];
+		if (usedSources.find(abcMeshSource)!=usedSources.end()) {
+			meshSources[numKeptSources++]=abcMeshSource;
+		} else {
+			deleteMeshPlugins(*abcMeshSource);
+			delete abcMeshSource;
+		}
+	}
+	meshSources.setCount(numKeptSources);
+
+	// The added and changed objects go through the same choices as the objects loaded with the frame.
+	Table<AlembicMeshSource*, -1> addedSources;
+	for (int i=0; i<addedInstances.count(); i++)
+		addedSources+=addedInstances[i]->meshSource;
+	applyGeometryPolicy(addedSources, addedInstances, loadInfo.readParams.lodCamera, sdata.progress);
+
+	// Create the plugins for the added and changed objects and instance them in all Nodes.
+	for (int i=0; i<addedInstances.count(); i++) {
+		AlembicMeshInstance *abcMeshInstance=addedInstances[i];
+		AlembicMeshSource *abcMeshSource=abcMeshInstance->meshSource;
+
+		if (!createMeshPlugins(*abcMeshSource, meshSources.count())) {
+			deleteMeshPlugins(*abcMeshSource);
+			delete abcMeshSource;
+			delete abcMeshInstance;
+			continue;
+		}
+
+		abcMeshInstance->meshIndex=meshInstances.count();
+		meshSources+=abcMeshSource;
+		meshInstances+=abcMeshInstance;
+
+		for (int j=0; j<readerInstances.count(); j++)
+			readerInstances[j]->recreateMeshInstance(*abcMeshInstance);
+	}
+
+	if (sdata.progress) {
+		sdata.progress->info("File \"%s\" changed: %i objects added, %i removed, %i with changed topology, %i with changed points, %i unchanged",
+			loadInfo.fileName.ptr(), numAdded, numRemoved, numTopologyChanged, numPointsChanged, numKept);
+	}
+
+	return true;
 }
 
-void GeomAlembicReader::frameBegin(VR::VRayRenderer *vray) {
-	VRayStaticGeomSource::frameBegin(vray);
-	double time=vray->getFrameData().t;
+int GeomAlembicReader::updateMaterialBindings(void) {
+	if (!watchMaterialFiles || !vrayRenderer || !plugman || !materialInputsChanged())
+		return false;
+
+	VRayRendererSceneAccess *vraySceneAccess=static_cast<VRayRendererSceneAccess*>(GET_INTERFACE(vrayRenderer, EXT_VRAYRENDERER_SCENEACCESS));
+	VRayScene *vrayScene=vraySceneAccess? vraySceneAccess->getScene() : nullptr;
+	if (!vrayScene)
+		return false;
+
+	ProgressCallback *prog=vrayRenderer->getSequenceData().progress;
 
-	loadGeometry(vray->getFrameData().currentFrame, vray);
+	// The background threads look up the rules that are about to be replaced. The prefetched geometry was read with
+	// the old ones; progressive loading continues with the new ones.
+	discardPrefetch();
+	pauseProgressiveLoading();
+
+	uint64 visibilityHash=mtlAssignments.getVisibilityHash();
+	readMaterialInputs(vrayRenderer, *vrayScene);
+
+	if (mtlAssignments.getVisibilityHash()!=visibilityHash) {
+		resetVoxelVisibility();
+		if (prog) {
+			prog->warning("The object visibility rules changed; the change takes effect when the geometry is loaded again");
+		}
+	}
+
+	// Find the objects whose displacement/subdivision settings changed; they need new wrapper plugins.
+	Table<int, -1> changedSources;
+	for (int i=0; i<meshSources.count(); i++) {
+		AlembicMeshSource *abcMeshSource=meshSources[i];
+		if (!abcMeshSource->geomStaticMesh)
+			continue;
+
+		DisplacementSubdivParams displSubdivParams;
+		getDisplacementSubdivParams(abcMeshSource->abcName, displSubdivParams);
+		if (!displSubdivParams.isSameAs(abcMeshSource->displSubdivParams))
+			changedSources+=i;
+	}
+
+	// Drop the instances of these objects from all Nodes, then recreate their plugins.
+	for (int i=0; i<changedSources.count(); i++) {
+		int sourceIndex=changedSources[i];
+		AlembicMeshSource *abcMeshSource=meshSources[sourceIndex];
+		for (int j=0; j<meshInstances.count(); j++) {
+			AlembicMeshInstance *abcMeshInstance=meshInstances[j];
+			if (abcMeshInstance->meshSource!=abcMeshSource)
+				continue;
+
+			for (int k=0; k<readerInstances.count(); k++)
+				readerInstances[k]->clearMeshInstance(*abcMeshInstance);
+		}
+
+		deleteMeshPlugins(*abcMeshSource);
+		abcMeshSource->tessellationKey=0;
+		createMeshPlugins(*abcMeshSource, sourceIndex);
+
+		for (int j=0; j<meshInstances.count(); j++) {
+			AlembicMeshInstance *abcMeshInstance=meshInstances[j];
+			if (abcMeshInstance->meshSource!=abcMeshSource)
+				continue;
+
+			for (int k=0; k<readerInstances.count(); k++)
+				readerInstances[k]->recreateMeshInstance(*abcMeshInstance);
+		}
+	}
+
+	// Update the materials of the rest of the objects in place.
+	int numRebound=0;
+	for (int i=0; i<readerInstances.count(); i++)
+		numRebound+=readerInstances[i]->rebindMaterials(false /* all */);
+
+	if (prog) {
+		prog->info("Material inputs changed: updated the material of %i objects, rebuilt the displacement/subdivision of %i objects", numRebound, changedSources.count());
+	}
+
+	// All objects use the new materials now.
+	deleteReplacedFaceSetMaterials();
+	deleteReplacedMaterialDefinitions(*vrayScene);
+
+	resumeProgressiveLoading();
+
+	return true;
 }
 
 void GeomAlembicReader::frameEnd(VR::VRayRenderer *vray) {
 	VRayStaticGeomSource::frameEnd(vray);
+
+	// Keep a progressively loaded frame until all of its objects are added, so that frameBegin() can add the rest
+	// instead of reading all objects again when the interactive render restarts the frame.
+	if (hasPendingProgressiveObjects())
+		return;
+
 	unloadGeometry(vray);
 }
 
@@ -297,31 +728,170 @@ void GeomAlembicReader::deletePlugin(VRayPlugin *plugin) {
 	}
 }
 
-void GeomAlembicReader::loadGeometry(int frameNumber, VRayRenderer *vray) {
-	VRaySequenceData &sdata=vray->getSequenceDataNoConst();
-	const VRayFrameData &fdata=vray->getFrameData();
-
-	const tchar *fname=fileName.ptr();
-	if (!fname) fname="";
-
+MeshFile* GeomAlembicReader::openMeshFile(
+	const tchar *fname,
+	int frameNumber,
+	float fps,
+	AlembicParams &abcParams,
+	VRayRenderer *vray,
+	ThreadManager *threadManager,
+	ProgressCallback *prog
+) {
 	// Create a reader suitable for the given file name (vrmesh or Alembic)
 	MeshFile *alembicFile=newDefaultMeshFile(fname);
 	if (!alembicFile) {
-		if (sdata.progress) {
-			sdata.progress->error("Cannot open file \"%s\"", fname);
+		if (prog) {
+			prog->error("Cannot open file \"%s\"", fname);
 		}
-		return;
+		return nullptr;
 	}
 
 	// Set some parameters for the Alembic reader before we read the file
 	alembicFile->setStringManager(vray->getStringManager());
-	alembicFile->setThreadManager(vray->getSequenceData().threadManager);
+	alembicFile->setThreadManager(threadManager);
 	alembicFile->setUseFullNames(true); // We want to get the full names from the Alembic file
+	alembicFile->setFramesPerSecond(fps);
+	alembicFile->setAdditionalParams(&abcParams);
+
+	ErrorCode res=alembicFile->init(fname);
+	if (res.error()) {
+		if (prog) {
+			CharString errStr=res.getErrorString();
+			prog->error("Cannot initialize file \"%s\": %s", fname, errStr.ptr());
+		}
+		deleteDefaultMeshFile(alembicFile);
+		return nullptr;
+	}
+
+	float time=float(frameNumber);
+	alembicFile->setCurrentFrame(time);
+
+	return alembicFile;
+}
+
+void GeomAlembicReader::readMeshSetsData(MeshFile &abcFile, int previewVoxelIndex, int nsamples, DefaultMeshSetsData &setsData) {
+	// Read the information about UV and color sets from the preview voxel.
+	if (previewVoxelIndex<0)
+		return;
+
+	MeshVoxel *previewVoxel=abcFile.getVoxel(previewVoxelIndex, nsamples<<16, NULL, NULL);
+	if (previewVoxel) {
+		VUtils::MeshChannel *mayaInfoChannel=previewVoxel->getChannel(MAYA_INFO_CHANNEL);
+		if (mayaInfoChannel) {
+			setsData.readFromBuffer((uint8*) mayaInfoChannel->data, mayaInfoChannel->elementSize*mayaInfoChannel->numElements);
+		}
+		abcFile.releaseVoxel(previewVoxel);
+	}
+}
+
+void GeomAlembicReader::initArchiveIndex(MeshFile &abcFile, VRayRenderer *vray, int frameNumber) {
+	archiveIndex.init(abcFile, fileName);
+
+	if (scanArchive && !archiveIndex.isScanned()) {
+		archiveIndex.scan(abcFile, vray, float(frameNumber));
+	}
+}
+
+void GeomAlembicReader::writeArchiveIndex(int frameNumber, float fps, const AlembicParams &abcParams, VRayRenderer *vray) {
+	const VRaySequenceData &sdata=vray->getSequenceData();
+
+	// The geometry may have come from the prefetch, the disk cache or another reader without opening the file.
+	if (!archiveIndex.isValidFor(fileName)) {
+		AlembicParams indexAbcParams=abcParams;
+		MeshFile *alembicFile=openMeshFile(fileName.ptr(), frameNumber, fps, indexAbcParams, vray, sdata.threadManager, sdata.progress);
+		if (!alembicFile)
+			return;
+
+		initArchiveIndex(*alembicFile, vray, frameNumber);
+		deleteDefaultMeshFile(alembicFile);
+	}
+
+	ErrorCode err=archiveIndex.writeCSV(archiveIndexFileName.ptr());
+	if (err.error() && sdata.progress) {
+		CharString errStr=err.getErrorString();
+		sdata.progress->warning("Failed to write the archive index file \"%s\": %s", archiveIndexFileName.ptr(), errStr.ptr());
+	}
+}
+
+int GeomAlembicReader::initVoxelVisibility(MeshFile &abcFile) {
+	int numVoxels=abcFile.getNumVoxels();
+
+	// Make sure the cached voxel visibility refers to the current file.
+	if (voxelVisibilityFile!=fileName || voxelVisibility.count()!=numVoxels) {
+		voxelVisibilityFile=fileName;
+		voxelVisibility.setCount(numVoxels);
+		for (int i=0; i<numVoxels; i++)
+			voxelVisibility[i]=-1;
+	}
+
+	// Resolve the visibility of the voxels whose names are already known from the metadata index.
+	if (archiveIndex.isValidFor(fileName) && archiveIndex.getNumVoxels()==numVoxels) {
+		for (int i=0; i<numVoxels; i++) {
+			if (voxelVisibility[i]!=-1)
+				continue;
+
+			const AbcVoxelInfo &voxelInfo=archiveIndex.getVoxelInfo(i);
+			if (voxelInfo.hasMetadata)
+				voxelVisibility[i]=mtlAssignments.isObjectVisible(voxelInfo.name);
+		}
+	}
+
+	return numVoxels;
+}
+
+int GeomAlembicReader::isMeshVoxel(MeshFile &abcFile, int voxelIndex, const Table<int, -1> &visibility) {
+	// Determine if this voxel contains a mesh
+	uint32 flags=abcFile.getVoxelFlags(voxelIndex);
+	if (flags & MVF_PREVIEW_VOXEL) // We don't care about the preview voxel
+		return false;
+	if (0==(flags & MVF_GEOMETRY_VOXEL)) // Not a mesh voxel; will deal with hair/particles later on
+		return false;
+	if (0!=(flags & MVF_INSTANCE_VOXEL)) // We are only interested in the source meshes here, we deal with instances separately
+		return false;
+	if (voxelIndex<visibility.count() && visibility[voxelIndex]==0) // Excluded by the visibility rules; don't read it at all
+		return false;
+	return true;
+}
+
+void GeomAlembicReader::readAllMeshSources(
+	const AlembicReadParams &readParams,
+	MeshFile &abcFile,
+	const Table<int, -1> &visibility,
+	Table<AlembicMeshSource*, -1> &sources,
+	Table<AlembicMeshInstance*, -1> &instances
+) {
+	int numVoxels=abcFile.getNumVoxels();
+	for (int i=0; i<numVoxels; i++) {
+		if (!isMeshVoxel(abcFile, i, visibility))
+			continue;
+
+		AlembicMeshInstance *abcMeshInstance=new AlembicMeshInstance;
+		AlembicMeshSource *abcMeshSource=readMeshSource(readParams, abcFile, i, *abcMeshInstance);
+		if (!abcMeshSource) {
+			delete abcMeshInstance;
+			continue;
+		}
+
+		if (readParams.computeGeometryHash)
+			computeGeometryHashes(*abcMeshSource, *abcMeshInstance);
+		applyLod(*abcMeshSource, *abcMeshInstance, readParams);
+
+		abcMeshInstance->meshSource=abcMeshSource;
+		sources+=abcMeshSource;
+		instances+=abcMeshInstance;
+	}
+}
+
+void GeomAlembicReader::loadGeometry(int frameNumber, VRayRenderer *vray) {
+	VRaySequenceData &sdata=vray->getSequenceDataNoConst();
+	const VRayFrameData &fdata=vray->getFrameData();
+
+	const tchar *fname=fileName.ptr();
+	if (!fname) fname="";
 
 	float fps=24.0f;
 	SequenceDataUnitsInfo *unitsInfo=static_cast<SequenceDataUnitsInfo*>(GET_INTERFACE(&sdata, EXT_SDATA_UNITSINFO));
 	if (unitsInfo) fps=unitsInfo->framesScale;
-	alembicFile->setFramesPerSecond(fps);
 
 	int numTimeSamples=geomSamples;
 	if (!sdata.params.moblur.on) numTimeSamples=1; // No motion blur
@@ -334,71 +904,475 @@ void GeomAlembicReader::loadGeometry(int frameNumber, VRayRenderer *vray) {
 	abcParams.mbDuration=sdata.params.moblur.duration;
 	abcParams.mbIntervalCenter=sdata.params.moblur.intervalCenter;
 
-	alembicFile->setAdditionalParams(&abcParams);
+	AlembicReadParams readParams;
+	readParams.vray=vray;
+	readParams.initSampleTimes(numTimeSamples, fdata.frameStart, fdata.frameEnd, fdata.t);
+	readParams.readVelocities=sdata.params.moblur.on;
+	readParams.lodCamera.init(fdata);
+	readParams.frame=float(frameNumber);
+	readParams.detectRigidMotion=detectRigidMotion;
+	readParams.rigidMotionTolerance=rigidMotionTolerance;
+	readParams.computeGeometryHash=incrementalReload;
+	readParams.archiveIndex=&archiveIndex;
+	readParams.voxelVisibility=&voxelVisibility;
+
+	// The file stamp and the settings identify the geometry for the disk cache and for sharing between readers.
+	FileStamp sourceStamp;
+	CharString cacheFileName;
+	uint64 settingsHash=0;
+	int hasSourceStamp=(useDiskCache || shareGeometry || reuseBoundarySamples || incrementalReload) && getFileStamp(fname, sourceStamp);
+	if (hasSourceStamp) {
+		settingsHash=computeGeometrySettingsHash(readParams, abcParams, fps);
+	}
 
-	ErrorCode res=alembicFile->init(fname);
-	if (res.error()) {
+	// Check for a valid disk cache for this frame.
+	int diskCacheEnabled=useDiskCache && hasSourceStamp;
+	if (diskCacheEnabled) {
+		cacheFileName=getGeomCacheFileName(fileName, diskCacheDir, settingsHash, frameNumber);
+	}
+
+	SharedGeometryRegistry &sharedRegistry=SharedGeometryRegistry::getInstance();
+	int shareEnabled=shareGeometry && hasSourceStamp;
+
+	// If the geometry for this frame was already read in the background, just use it.
+	if (usePrefetchedGeometry(frameNumber, readParams, abcParams, fps)) {
+		// Nothing else to do.
+	} else if (shareEnabled && (sharedGeometry=sharedRegistry.acquire(fileName, sourceStamp, frameNumber, settingsHash))!=nullptr) {
+		useSharedGeometry(*sharedGeometry, readParams);
 		if (sdata.progress) {
-			CharString errStr=res.getErrorString();
-			sdata.progress->error("Cannot initialize file \"%s\": %s", fname, errStr.ptr());
+			sdata.progress->info("Using geometry shared with another reader of \"%s\"", fname);
+		}
+	} else if (diskCacheEnabled && loadFromDiskCache(cacheFileName, sourceStamp, settingsHash, readParams)) {
+		if (sdata.progress) {
+			sdata.progress->info("Loaded geometry from cache file \"%s\"", cacheFileName.ptr());
 		}
 	} else {
-		float time=float(frameNumber);
-		alembicFile->setCurrentFrame(time);
+		MeshFile *alembicFile=openMeshFile(fname, frameNumber, fps, abcParams, vray, sdata.threadManager, sdata.progress);
+		if (alembicFile) {
+			// Make sure we have the metadata index for this file.
+			initArchiveIndex(*alembicFile, vray, frameNumber);
+
+			// First read the information about UV and color sets from the preview voxel.
+			DefaultMeshSetsData setsData;
+			readMeshSetsData(*alembicFile, archiveIndex.getPreviewVoxelIndex(), numTimeSamples, setsData);
+			readParams.meshSets=&setsData;
+
+			// With progressive loading, only some of the objects are read here, so the geometry is neither cached nor shared.
+			// Either a fraction below 1 or a time budget can leave objects for the background thread.
+			int progressive=progressiveLoading && (progressiveFraction<1.0f || progressiveTimeBudget>0.0f);
+
+			// The objects read in the background are only added on interactive updates, so a final render must read all of them here.
+			if (progressive && !interactiveRender) {
+				progressive=false;
+				if (sdata.progress) {
+					sdata.progress->warning("progressive_loading is only used for interactive renders (interactive_render); all objects are read before rendering");
+				}
+			}
 
-		int numVoxels=alembicFile->getNumVoxels();
+			// Write the converted geometry to the disk cache as we go.
+			GeomCacheWriter cacheWriter;
+			if (diskCacheEnabled && !progressive) {
+				ErrorCode err=cacheWriter.open(cacheFileName.ptr(), sourceStamp, settingsHash);
+				if (err.error() && sdata.progress) {
+					CharString errStr=err.getErrorString();
+					sdata.progress->warning("Cannot create geometry cache file: %s", errStr.ptr());
+				}
+			}
 
-		// First find out the preview voxel and read the information about
-		// UV and color sets from it.
-		DefaultMeshSetsData setsData;
-		for (int i=0; i<numVoxels; i++) {
-			uint32 flags=alembicFile->getVoxelFlags(i);
-			if (flags & MVF_PREVIEW_VOXEL) {
-				MeshVoxel *previewVoxel=alembicFile->getVoxel(i, numTimeSamples<<16, NULL, NULL);
-				if (previewVoxel) {
-					VUtils::MeshChannel *mayaInfoChannel=previewVoxel->getChannel(MAYA_INFO_CHANNEL);
-					if (mayaInfoChannel) {
-						setsData.readFromBuffer((uint8*) mayaInfoChannel->data, mayaInfoChannel->elementSize*mayaInfoChannel->numElements);
-					}
-					alembicFile->releaseVoxel(previewVoxel);
+			// Other readers of the same file can use the geometry once it is read.
+			if (shareEnabled && !progressive) {
+				sharedGeometry=sharedRegistry.create(fileName, sourceStamp, frameNumber, settingsHash);
+			}
+
+			// Reuse the last samples of the previous frame and keep the last samples of this one.
+			if (reuseBoundarySamples && hasSourceStamp && numTimeSamples>1) {
+				boundarySamples.begin(fileName, sourceStamp, settingsHash);
+				readParams.boundarySamples=&boundarySamples;
+			}
+
+			// Go through all the voxels and create the corresponding geometry.
+			int numVoxels=initVoxelVisibility(*alembicFile);
+			Table<int, -1> voxelIndices;
+			for (int i=0; i<numVoxels; i++) {
+				if (isMeshVoxel(*alembicFile, i, voxelVisibility))
+					voxelIndices+=i;
+			}
+
+			// Read the objects that are largest on screen first, and leave the rest for the background thread
+			// once enough of them are read.
+			int numToRead=voxelIndices.count();
+			if (progressive) {
+				sortVoxelsByImportance(voxelIndices, readParams.lodCamera);
+				numToRead=Min(numToRead, Max(1, int(ceilf(float(numToRead)*Max(progressiveFraction, 0.0f)))));
+			}
+
+			std::chrono::steady_clock::time_point readStart=std::chrono::steady_clock::now();
+			int numRead=0;
+			for (; numRead<voxelIndices.count(); numRead++) {
+				if (progressive && numRead>0) {
+					double seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-readStart).count();
+					if (numRead>=numToRead || (progressiveTimeBudget>0.0f && seconds>=double(progressiveTimeBudget)))
+						break;
+				}
+
+				// Read the geometry for this voxel
+				AlembicMeshSource *abcMeshSource=createGeomStaticMesh(readParams, *alembicFile, voxelIndices[numRead], true, cacheWriter.isOpen()? &cacheWriter : nullptr, sharedGeometry);
+				if (abcMeshSource) {
+					meshSources+=abcMeshSource;
 				}
-				break;
 			}
+
+			// Remember the objects that were not read yet; they are read in the background after the rest of the frame setup.
+			for (int i=numRead; i<voxelIndices.count(); i++)
+				progressiveData.pendingVoxels+=voxelIndices[i];
+
+			if (progressive && sdata.progress) {
+				sdata.progress->info("Progressive loading: read %i of %i objects before rendering", numRead, voxelIndices.count());
+			}
+
+			sharedRegistry.publish(sharedGeometry);
+
+			if (readParams.boundarySamples) {
+				boundarySamples.end();
+				readParams.boundarySamples=nullptr;
+			}
+
+			if (cacheWriter.isOpen()) {
+				ErrorCode err=cacheWriter.close();
+				if (err.error() && sdata.progress) {
+					CharString errStr=err.getErrorString();
+					sdata.progress->warning("Cannot write geometry cache file: %s", errStr.ptr());
+				}
+			}
+
+			readParams.meshSets=nullptr;
+			deleteDefaultMeshFile(alembicFile);
 		}
+	}
 
-		// Go through all the voxels and create the corresponding geometry.
-		for (int i=0; i<numVoxels; i++) {
-			// Determine if this voxel contains a mesh
-			uint32 flags=alembicFile->getVoxelFlags(i);
-			if (flags & MVF_PREVIEW_VOXEL) // We don't care about the preview voxel
-				continue;
-			if (0==(flags & MVF_GEOMETRY_VOXEL)) // Not a mesh voxel; will deal with hair/particles later on
-				continue;
-			if (0!=(flags & MVF_INSTANCE_VOXEL)) // We are only interested in the source meshes here, we deal with instances separately
-				continue;
+	// Write out the metadata index for pipeline tools, if requested; this is done for every frame, however it was loaded.
+	if (!archiveIndexFileName.empty()) {
+		writeArchiveIndex(frameNumber, fps, abcParams, vray);
+	}
 
-			// Create a GeomStaticMesh plugin for this voxel
-			AlembicMeshSource *abcMeshSource=createGeomStaticMesh(
-				vray,
-				*alembicFile,
-				i,
-				true,
-				setsData,
-				numTimeSamples,
-				fdata.frameStart,
-				fdata.frameEnd,
-				fdata.t
-			);
-			if (abcMeshSource) {
-				meshSources+=abcMeshSource;
+	// Replace duplicated meshes with instances.
+	if (autoInstancing) {
+		autoInstanceMeshSources(sdata.progress);
+	}
+
+	// Combine small objects into larger meshes. Incremental reload matches the objects by name, so they are kept apart then.
+	if (mergeSmallObjects && !incrementalReload) {
+		mergeSmallMeshSources(sdata.progress);
+	}
+
+	// Split very large objects into chunks; as above, not with incremental reload.
+	if (splitMinTriangles>0 && !incrementalReload) {
+		splitLargeMeshSources(sdata.progress);
+	}
+
+	// Decide which meshes should use static geometry and keep the tessellation within the triangle budget.
+	applyGeometryPolicy(meshSources, meshInstances, readParams.lodCamera, sdata.progress);
+
+	// Create the V-Ray plugins for all the meshes.
+	createAllMeshPlugins();
+
+	// Report the memory used by the largest objects.
+	if (memoryReportCount>0 || !memoryReportFileName.empty()) {
+		reportMemoryUsage(sdata.progress);
+	}
+
+	// Remember how the geometry was loaded, so that only the changed objects are read again if the file changes.
+	if (incrementalReload && hasSourceStamp) {
+		loadInfo.fileName=fileName;
+		loadInfo.fileStamp=sourceStamp;
+		loadInfo.frameNumber=frameNumber;
+		loadInfo.fps=fps;
+		loadInfo.abcParams=abcParams;
+		loadInfo.readParams=readParams;
+		loadInfo.readParams.meshSets=nullptr;
+		loadInfo.readParams.boundarySamples=nullptr;
+		loadInfo.readParams.archiveIndex=nullptr;
+		loadInfo.readParams.voxelVisibility=nullptr;
+	}
+
+	// Read the rest of the objects while the frame is rendering.
+	if (progressiveData.pendingVoxels.count()>0) {
+		startProgressiveLoading(frameNumber, vray, readParams, fps, abcParams);
+	}
+
+	// Start reading the next frame while this one is rendering. The frame step is guessed from the frames loaded so far.
+	int frameStep=(hasLastLoadedFrame && frameNumber>lastLoadedFrame)? frameNumber-lastLoadedFrame : 1;
+	lastLoadedFrame=frameNumber;
+	hasLastLoadedFrame=true;
+	if (prefetchNextFrame) {
+		startPrefetch(frameNumber+frameStep, vray, readParams, fps, abcParams);
+	}
+}
+
+uint64 GeomAlembicReader::computeGeometrySettingsHash(const AlembicReadParams &readParams, const AlembicParams &abcParams, float fps) {
+	uint64 hash=hashSeed;
+	hash=hashMemory(&readParams.nsamples, sizeof(readParams.nsamples), hash);
+	hash=hashMemory(&readParams.readVelocities, sizeof(readParams.readVelocities), hash);
+	hash=hashMemory(&abcParams.mbOn, sizeof(abcParams.mbOn), hash);
+	hash=hashMemory(&abcParams.mbDuration, sizeof(abcParams.mbDuration), hash);
+	hash=hashMemory(&abcParams.mbIntervalCenter, sizeof(abcParams.mbIntervalCenter), hash);
+	hash=hashMemory(&fps, sizeof(fps), hash);
+	hash=hashMemory(&readParams.detectRigidMotion, sizeof(readParams.detectRigidMotion), hash);
+	if (readParams.detectRigidMotion) {
+		hash=hashMemory(&readParams.rigidMotionTolerance, sizeof(readParams.rigidMotionTolerance), hash);
+	}
+
+	// The visibility rules determine which objects are read. Only these rules are hashed, so that readers
+	// with different material assignments can still share the geometry.
+	uint64 visibilityHash=mtlAssignments.getVisibilityHash();
+	hash=hashMemory(&visibilityHash, sizeof(visibilityHash), hash);
+
+	// The channel rules determine which mesh channels are read.
+	uint64 channelsHash=mtlAssignments.getChannelsHash();
+	hash=hashMemory(&channelsHash, sizeof(channelsHash), hash);
+
+	return hash;
+}
+
+int GeomAlembicReader::loadFromDiskCache(const CharString &cacheFileName, const FileStamp &sourceStamp, uint64 settingsHash, const AlembicReadParams &readParams) {
+	ErrorCode err=diskCacheReader.open(cacheFileName.ptr(), sourceStamp, settingsHash);
+	if (err.error())
+		return false;
+
+	int numObjects=diskCacheReader.getNumObjects();
+	int firstInstance=meshInstances.count();
+	int firstSource=meshSources.count();
+	for (int i=0; i<numObjects; i++) {
+		AlembicMeshInstance *abcMeshInstance=new AlembicMeshInstance;
+		AlembicMeshSource *abcMeshSource=diskCacheReader.loadObject(i, readParams.sampleTimes, *abcMeshInstance);
+		if (!abcMeshSource) {
+			// The cache file is truncated or corrupt; drop what was loaded from it and delete it, so that the
+			// geometry is read from the source file and the cache is written again.
+			delete abcMeshInstance;
+
+			for (int j=firstInstance; j<meshInstances.count(); j++)
+				delete meshInstances[j];
+			meshInstances.setCount(firstInstance);
+
+			for (int j=firstSource; j<meshSources.count(); j++)
+				delete meshSources[j];
+			meshSources.setCount(firstSource);
+
+			diskCacheReader.close();
+			remove(cacheFileName.ptr());
+
+			ProgressCallback *prog=readParams.vray? readParams.vray->getSequenceData().progress : nullptr;
+			if (prog) {
+				prog->warning("Cannot load object %i from cache file \"%s\"; the cache file is discarded", i, cacheFileName.ptr());
 			}
+			return false;
 		}
+
+		if (!mtlAssignments.isObjectVisible(abcMeshInstance->abcName)) {
+			delete abcMeshSource;
+			delete abcMeshInstance;
+			continue;
+		}
+
+		if (readParams.computeGeometryHash)
+			computeGeometryHashes(*abcMeshSource, *abcMeshInstance);
+		applyLod(*abcMeshSource, *abcMeshInstance, readParams);
+
+		abcMeshInstance->meshIndex=meshInstances.count();
+		abcMeshInstance->meshSource=abcMeshSource;
+		meshSources+=abcMeshSource;
+		meshInstances+=abcMeshInstance;
 	}
 
-	deleteDefaultMeshFile(alembicFile);
+	return true;
+}
+
+void GeomAlembicReader::useSharedGeometry(SharedGeometry &shared, const AlembicReadParams &readParams) {
+	for (int i=0; i<shared.meshSources.count(); i++) {
+		if (!mtlAssignments.isObjectVisible(shared.meshInstances[i]->abcName))
+			continue;
+
+		AlembicMeshInstance *abcMeshInstance=nullptr;
+		AlembicMeshSource *abcMeshSource=shared.createSharedCopy(i, abcMeshInstance);
+
+		if (readParams.computeGeometryHash)
+			computeGeometryHashes(*abcMeshSource, *abcMeshInstance);
+		applyLod(*abcMeshSource, *abcMeshInstance, readParams);
+
+		abcMeshInstance->meshIndex=meshInstances.count();
+		meshSources+=abcMeshSource;
+		meshInstances+=abcMeshInstance;
+	}
+}
+
+void GeomAlembicReader::releaseSharedGeometry(void) {
+	SharedGeometryRegistry::getInstance().release(sharedGeometry);
+	sharedGeometry=nullptr;
+}
+
+uint64 GeomAlembicReader::computePrefetchSettingsHash(const AlembicReadParams &readParams, const AlembicParams &abcParams, float fps) {
+	uint64 hash=computeGeometrySettingsHash(readParams, abcParams, fps);
+	uint64 lodHash=mtlAssignments.getLodHash();
+	return hashMemory(&lodHash, sizeof(lodHash), hash);
+}
+
+int GeomAlembicReader::usePrefetchedGeometry(int frameNumber, const AlembicReadParams &readParams, const AlembicParams &abcParams, float fps) {
+	waitForPrefetch();
+
+	if (prefetchData.meshSources.count()==0) {
+		prefetchData.freeMem();
+		return false;
+	}
+
+	// The geometry must have been read from the same file contents with the same settings. The camera only matters
+	// if objects are decimated for it.
+	FileStamp stamp;
+	getFileStamp(fileName.ptr(), stamp);
+	int matches=
+		prefetchData.frameNumber==frameNumber &&
+		prefetchData.nsamples==readParams.nsamples &&
+		prefetchData.fileName==fileName &&
+		prefetchData.fileStamp==stamp &&
+		prefetchData.settingsHash==computePrefetchSettingsHash(readParams, abcParams, fps) &&
+		(!mtlAssignments.hasLodRules() || prefetchData.lodCamera.isSameAs(readParams.lodCamera));
+
+	if (!matches) {
+		prefetchData.freeMem();
+		return false;
+	}
+
+	for (int i=0; i<prefetchData.meshInstances.count(); i++) {
+		AlembicMeshInstance *abcMeshInstance=prefetchData.meshInstances[i];
+		AlembicMeshSource *abcMeshSource=abcMeshInstance->meshSource;
+
+		// Replace the time sample indices with the actual times for this frame.
+		abcMeshSource->retimeKeyframes(readParams.sampleTimes);
+		abcMeshInstance->retimeTransforms(readParams.sampleTimes);
+
+		abcMeshInstance->meshIndex=meshInstances.count();
+		meshSources+=abcMeshSource;
+		meshInstances+=abcMeshInstance;
+	}
+
+	// The geometry is now owned by the meshSources and meshInstances tables.
+	prefetchData.meshSources.clear();
+	prefetchData.meshInstances.clear();
+
+	return true;
+}
+
+void GeomAlembicReader::startPrefetch(int frameNumber, VRayRenderer *vray, const AlembicReadParams &readParams, float fps, const AlembicParams &abcParams) {
+	discardPrefetch();
+
+	// Don't read two frames at once; progressive loading is still reading the objects of the current one.
+	if (progressiveThread.joinable() && !progressiveData.finished) {
+		prefetchData.deferred=true;
+		prefetchData.frameNumber=frameNumber;
+		prefetchData.fps=fps;
+		prefetchData.abcParams=abcParams;
+		prefetchData.readParams=readParams;
+		prefetchData.readParams.vray=vray;
+		prefetchData.readParams.meshSets=nullptr;
+		prefetchData.readParams.boundarySamples=nullptr;
+		prefetchData.readParams.archiveIndex=nullptr;
+		prefetchData.readParams.voxelVisibility=nullptr;
+		return;
+	}
+
+	prefetchData.fileName=fileName;
+	prefetchData.fileStamp=FileStamp();
+	getFileStamp(fileName.ptr(), prefetchData.fileStamp);
+	prefetchData.frameNumber=frameNumber;
+	prefetchData.nsamples=readParams.nsamples;
+	prefetchData.settingsHash=computePrefetchSettingsHash(readParams, abcParams, fps);
+	prefetchData.lodCamera=readParams.lodCamera;
+
+	CharString prefetchFileName(fileName);
+	int nsamples=readParams.nsamples;
+	int readVelocities=readParams.readVelocities;
+	LodCamera lodCamera=readParams.lodCamera;
+	int detectRigidMotion=readParams.detectRigidMotion;
+	float rigidMotionTolerance=readParams.rigidMotionTolerance;
+	int computeGeometryHash=readParams.computeGeometryHash;
+
+	// The background thread uses its own copy of the voxel visibility and doesn't record anything in the metadata
+	// index, which the main thread keeps using while the frame renders.
+	std::vector<int> visibilitySnapshot;
+	if (voxelVisibilityFile==fileName && voxelVisibility.count()>0)
+		visibilitySnapshot.assign(&voxelVisibility[0], &voxelVisibility[0]+voxelVisibility.count());
+	int indexPreviewVoxel=archiveIndex.isValidFor(fileName)? archiveIndex.getPreviewVoxelIndex() : -1;
+
+	prefetchThread=std::thread([=]() {
+		const tchar *fname=prefetchFileName.ptr();
+		if (!fname)
+			return;
+
+		// Don't use the V-Ray thread manager; it is busy rendering the current frame.
+		// Errors are reported when the frame is actually loaded, so no progress callback here.
+		AlembicParams prefetchAbcParams=abcParams;
+		MeshFile *alembicFile=openMeshFile(fname, frameNumber, fps, prefetchAbcParams, vray, nullptr, nullptr);
+		if (!alembicFile)
+			return;
+
+		// The keyframe times are the time sample indices; the actual times are set in usePrefetchedGeometry().
+		AlembicReadParams prefetchParams;
+		prefetchParams.vray=vray;
+		prefetchParams.readVelocities=readVelocities;
+		prefetchParams.lodCamera=lodCamera;
+		prefetchParams.frame=float(frameNumber);
+		prefetchParams.detectRigidMotion=detectRigidMotion;
+		prefetchParams.rigidMotionTolerance=rigidMotionTolerance;
+		prefetchParams.computeGeometryHash=computeGeometryHash;
+		prefetchParams.nsamples=nsamples;
+		prefetchParams.sampleTimes.setCount(nsamples);
+		for (int i=0; i<nsamples; i++)
+			prefetchParams.sampleTimes[i]=double(i);
+
+		// The metadata index is only used if the main thread already initialized it for this file.
+		int previewVoxelIndex=(indexPreviewVoxel>=0)? indexPreviewVoxel : AbcArchiveIndex::findPreviewVoxel(*alembicFile);
+
+		DefaultMeshSetsData setsData;
+		readMeshSetsData(*alembicFile, previewVoxelIndex, nsamples, setsData);
+		prefetchParams.meshSets=&setsData;
+
+		// The snapshot is only used if it was made for the same voxels.
+		Table<int, -1> visibility;
+		int numVoxels=alembicFile->getNumVoxels();
+		visibility.setCount(numVoxels);
+		for (int i=0; i<numVoxels; i++)
+			visibility[i]=(int(visibilitySnapshot.size())==numVoxels)? visibilitySnapshot[i] : -1;
+
+		readAllMeshSources(prefetchParams, *alembicFile, visibility, prefetchData.meshSources, prefetchData.meshInstances);
+
+		deleteDefaultMeshFile(alembicFile);
+	});
+}
+
+void GeomAlembicReader::waitForPrefetch(void) {
+	if (prefetchThread.joinable())
+		prefetchThread.join();
+}
+
+void GeomAlembicReader::discardPrefetch(void) {
+	waitForPrefetch();
+	prefetchData.freeMem();
+}
+
+void GeomAlembicReader::startDeferredPrefetch(void) {
+	if (!prefetchData.deferred || !progressiveData.finished)
+		return;
+
+	int frameNumber=prefetchData.frameNumber;
+	float fps=prefetchData.fps;
+	AlembicParams abcParams=prefetchData.abcParams;
+	AlembicReadParams readParams=prefetchData.readParams;
+	startPrefetch(frameNumber, readParams.vray, readParams, fps, abcParams);
 }
 
 void GeomAlembicReader::unloadGeometry(VRayRenderer *vray) {
+	// The objects that are still being read for this frame are not needed any more.
+	stopProgressiveLoading();
+
 	int numMeshInstances=meshInstances.count();
 	for (int i=0; i<numMeshInstances; i++) {
 		AlembicMeshInstance *abcMeshInstance=meshInstances[i];
@@ -412,19 +1386,31 @@ void GeomAlembicReader::unloadGeometry(VRayRenderer *vray) {
 		if (!abcMeshSource)
 			continue;
 
-		if (abcMeshSource->displSubdivPlugin) {
-			deletePlugin(abcMeshSource->displSubdivPlugin);
-			abcMeshSource->displSubdivPlugin=nullptr;
+		// Keep the plugins of static pre-tessellated meshes for the next frame; they may not need to be created again.
+		if (reuseTessellation && abcMeshSource->tessellationKey!=0 && abcMeshSource->displSubdivPlugin) {
+			abcMeshSource->detachMappedData();
+			retainedMeshSources+=abcMeshSource;
+			continue;
 		}
 
-		if (abcMeshSource->geomStaticMesh) {
-			deletePlugin(abcMeshSource->geomStaticMesh);
-			abcMeshSource->geomStaticMesh=nullptr;
-		}
+		deleteMeshPlugins(*abcMeshSource);
 		delete abcMeshSource;
 	}
 
 	meshSources.clear();
+
+	// The mesh sources loaded from the disk cache referenced the mapped file.
+	diskCacheReader.close();
+
+	// The mesh sources don't reference the shared geometry any more.
+	releaseSharedGeometry();
+
+	loadInfo.fileName.clear();
+}
+
+void GeomAlembicReader::resetVoxelVisibility(void) {
+	voxelVisibility.clear();
+	voxelVisibilityFile.clear();
 }
 
 VRayPlugin* GeomAlembicReader::createDefaultMaterial(void) {
@@ -474,6 +1460,9 @@ const tchar *ignoredPlugins[]={
 };
 
 struct FilterCallback: ScenePluginFilter {
+	// The names of the plugins that were not skipped, without the prefix.
+	StringList names;
+
 	// If the given plugin type starts with any of the prefixes listed in the ingoredPlugins[] array,
 	// skip it.
 	int filter(const CharString &type, CharString &name, Object *object) VRAY_OVERRIDE {
@@ -482,25 +1471,41 @@ struct FilterCallback: ScenePluginFilter {
 				return false;
 			}
 		}
+		names+=name;
 		return true;
 	}
 };
 
-ErrorCode GeomAlembicReader::readMaterialDefinitions(const CharString &fname, ProgressCallback *prog, CharString &mtlPrefix, VRayScene &vrayScene) {
+ErrorCode GeomAlembicReader::readMaterialDefinitions(const CharString &fname, int generation, ProgressCallback *prog, CharString &mtlPrefix, VRayScene &vrayScene, Table<VRayPlugin*, -1> &mtlPlugins) {
 	ErrorCode res;
 
 	// For the moment, prefix all plugins in the scene with the name of the
 	// material definitions file. In this way, materials with the same name
 	// coming out of different material definition files will not mess up with
-	// each other.
+	// each other. When the file is read again, the plugins of the previous read
+	// still exist, so the prefix also includes the number of the read.
 	CharString prefix=fname;
 	prefix.append("_");
+	if (generation>0) {
+		tchar generationStr[32];
+		vutils_sprintf_n(generationStr, COUNT_OF(generationStr), "%i_", generation);
+		prefix.append(generationStr);
+	}
 
 	// Append the material definition .vrscene file to the current scene; filter out
 	// any plugins that we are not interested in (render settings, cameras, geometry etc).
 	FilterCallback filterCallback;
 	res=vrayScene.readFileEx(fname.ptr(), &filterCallback, prefix.ptr(), true /* create plugins */, prog);
 
+	// Remember the created plugins, even if the file was read only partially.
+	for (int i=0; i<filterCallback.names.count(); i++) {
+		CharString pluginName=prefix;
+		pluginName.append(filterCallback.names[i]);
+		VRayPlugin *plugin=vrayScene.findPlugin(pluginName.ptr());
+		if (plugin)
+			mtlPlugins+=plugin;
+	}
+
 	if (!res.error())
 		mtlPrefix=prefix; // If the file was read successfully, use the prefix.
 	else
@@ -509,6 +1514,12 @@ ErrorCode GeomAlembicReader::readMaterialDefinitions(const CharString &fname, Pr
 	return res;
 }
 
+void GeomAlembicReader::deleteReplacedMaterialDefinitions(VRayScene &vrayScene) {
+	for (int i=0; i<replacedMtlDefsPlugins.count(); i++)
+		vrayScene.deletePlugin(replacedMtlDefsPlugins[i]);
+	replacedMtlDefsPlugins.clear();
+}
+
 ErrorCode GeomAlembicReader::readMtlAssignmentsFile(const CharString &fname, PXML &pxml) {
 	ErrorCode res=pxml.ParseFileStrict(fname.ptr());
 	if (res.error())
@@ -516,17 +1527,106 @@ ErrorCode GeomAlembicReader::readMtlAssignmentsFile(const CharString &fname, PXM
 	return ErrorCode();
 }
 
-// Return the material plugin to use for the given Alembic file name
-VRayPlugin* GeomAlembicReader::getMaterialPluginForInstance(const CharString &abcName) {
-	VRayPlugin *res=mtlAssignments.getMaterialPlugin(abcName);
+// Return the material plugin to use for the given Alembic object
+VRayPlugin* GeomAlembicReader::getMaterialPluginForInstance(const AlembicMeshInstance &abcMeshInstance) {
+	VRayPlugin *res=mtlAssignments.getMaterialPlugin(abcMeshInstance.abcName);
 	if (!res)
 		res=defaultMtl;
 
+	const AlembicMeshSource *meshSource=abcMeshInstance.meshSource;
+	if (meshSource && meshSource->faceSetNames.count()>1)
+		res=getFaceSetMaterial(*meshSource, res);
+
 	return res;
 }
 
+VRayPlugin* GeomAlembicReader::getFaceSetMaterial(const AlembicMeshSource &meshSource, VRayPlugin *objectMtl) {
+	// Face sets without a rule of their own use the material of the object.
+	int numFaceSets=meshSource.faceSetNames.count();
+	Table<VRayPlugin*, -1> mtls;
+	mtls.setCount(numFaceSets);
+	int sameMtl=true;
+	for (int i=0; i<numFaceSets; i++) {
+		VRayPlugin *mtl=mtlAssignments.getMaterialPlugin(meshSource.faceSetNames[i]);
+		mtls[i]=mtl? mtl : objectMtl;
+		if (mtls[i]!=mtls[0])
+			sameMtl=false;
+	}
+
+	if (numFaceSets==0 || sameMtl)
+		return numFaceSets>0? mtls[0] : objectMtl;
+
+	// Reuse the multi-material of another object with the same face set materials.
+	for (int i=0; i<faceSetMaterials.count(); i++) {
+		const FaceSetMaterial &faceSetMtl=*faceSetMaterials[i];
+		if (faceSetMtl.mtls.count()==numFaceSets && 0==memcmp(&faceSetMtl.mtls[0], &mtls[0], numFaceSets*sizeof(mtls[0])))
+			return faceSetMtl.mtlPlugin;
+	}
+
+	tchar mtlPluginName[64]="";
+	vutils_sprintf_n(mtlPluginName, COUNT_OF(mtlPluginName), "faceSetMtl_%i", numFaceSetMtlPlugins++);
+
+	VRayPlugin *mtlPlugin=newPlugin("MtlMulti", mtlPluginName);
+	if (!mtlPlugin)
+		return objectMtl;
+
+	// The face material IDs are the indices of the face sets.
+	PluginListParam *mtlsParam=new PluginListParam("mtls_list");
+	mtlsParam->plugins.copy(mtls);
+
+	IntList ids(numFaceSets);
+	for (int i=0; i<numFaceSets; i++)
+		ids[i]=i;
+	AnimatedIntListParam *idsParam=new AnimatedIntListParam("ids_list");
+	idsParam->addKeyframe(0.0, ids);
+
+	mtlPlugin->setParameter(factory.saveInFactory(mtlsParam));
+	mtlPlugin->setParameter(factory.saveInFactory(idsParam));
+
+	FaceSetMaterial *faceSetMtl=new FaceSetMaterial;
+	faceSetMtl->mtls.copy(mtls);
+	faceSetMtl->mtlPlugin=mtlPlugin;
+	faceSetMaterials+=faceSetMtl;
+
+	return mtlPlugin;
+}
+
+void GeomAlembicReader::freeFaceSetMaterials(void) {
+	for (int i=0; i<faceSetMaterials.count(); i++)
+		delete faceSetMaterials[i];
+	faceSetMaterials.clear();
+
+	for (int i=0; i<replacedFaceSetMaterials.count(); i++)
+		delete replacedFaceSetMaterials[i];
+	replacedFaceSetMaterials.clear();
+}
+
+void GeomAlembicReader::replaceFaceSetMaterials(void) {
+	for (int i=0; i<faceSetMaterials.count(); i++)
+		replacedFaceSetMaterials+=faceSetMaterials[i];
+	faceSetMaterials.clear();
+}
+
+void GeomAlembicReader::deleteReplacedFaceSetMaterials(void) {
+	for (int i=0; i<replacedFaceSetMaterials.count(); i++) {
+		deletePlugin(replacedFaceSetMaterials[i]->mtlPlugin);
+		delete replacedFaceSetMaterials[i];
+	}
+	replacedFaceSetMaterials.clear();
+}
+
 void GeomAlembicReader::getDisplacementSubdivParams(const VR::CharString &abcName, DisplacementSubdivParams &params) {
 	params.displacementTex=mtlAssignments.getDisplacementTexturePlugin(abcName, params.displacementAmount);
 	params.hasSubdivision=mtlAssignments.getSubdivisionEnabled(abcName);
+
+	const TessellationAssignmentRule *tessellationRule=mtlAssignments.getTessellationRule(abcName);
+	if (tessellationRule) {
+		params.edgeLength=tessellationRule->edgeLength;
+		params.maxSubdivs=tessellationRule->maxSubdivs;
+		params.staticTessellation=tessellationRule->staticTessellation;
+	}
 }
 
+int GeomAlembicReader::getLodParams(const VR::CharString &abcName, LodParams &params) {
+	return mtlAssignments.getLodSettings(abcName, params.maxPixels, params.cellPixels);
+}
@@ -19,22 +19,49 @@
 #include "sceneparser.h"
 
 #include "mtl_assignment_rules.h"
+#include "abc_archive_index.h"
+#include "geom_disk_cache.h"
+#include "plugin_params.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 struct GeomAlembicReader;
+struct GeomAlembicReaderInstance;
+struct GeomCacheWriter;
+struct SharedGeometry;
 
 typedef VR::Table<VR::CharString> StringList;
+typedef VR::Table<VR::Transform, -1> TransformsList;
+typedef VR::Table<double, -1> TimesList;
 
-/// A single map channel for AnimatedMapChannelsParam.
+/// A single map channel for AnimatedMapChannelsParam. Like the vertex and face lists of the mesh, the lists may
+/// reference external memory (see AlembicMeshSource::usesMappedData).
 struct AbcMapChannel {
 	int idx; ///< Index of the channel.
-	VUtils::Table<VUtils::Vector> verts; ///< Texture vertices.
-	VUtils::Table<int> faces; ///< Texture faces.
+	VR::VectorList verts; ///< Texture vertices.
+	VR::IntList faces; ///< Texture faces.
+
+	/// Constructor.
+	AbcMapChannel(void):idx(0) {}
 
-	/// Assignment operator.
+	/// Copy constructor; makes own copies of the lists.
+	AbcMapChannel(const AbcMapChannel &mapChan) { *this=mapChan; }
+
+	/// Assignment operator; makes own copies of the lists.
 	void operator=(const AbcMapChannel &mapChan) {
 		idx=mapChan.idx;
-		verts.copy(mapChan.verts);
-		faces.copy(mapChan.faces);
+
+		VR::VectorList vertsCopy(mapChan.verts.count());
+		for (int i=0; i<mapChan.verts.count(); i++)
+			vertsCopy[i]=mapChan.verts[i];
+		verts=vertsCopy;
+
+		VR::IntList facesCopy(mapChan.faces.count());
+		for (int i=0; i<mapChan.faces.count(); i++)
+			facesCopy[i]=mapChan.faces[i];
+		faces=facesCopy;
 	}
 };
 
@@ -52,6 +79,39 @@ inline void copyKeyframeData(StringList &dst, const StringList &src) {
 	dst.copy(src);
 }
 
+/// Return true if the data of two keyframes is the same.
+template<class T>
+inline int isKeyframeDataEqual(const T &a, const T &b) {
+	if (a.count()!=b.count())
+		return false;
+	return a.count()==0 || memcmp(&a[0], &b[0], a.count()*sizeof(a[0]))==0;
+}
+
+inline int isKeyframeDataEqual(const AbcMapChannelsList &a, const AbcMapChannelsList &b) {
+	if (a.count()!=b.count())
+		return false;
+
+	for (int i=0; i<a.count(); i++) {
+		if (a[i].idx!=b[i].idx || !isKeyframeDataEqual(a[i].verts, b[i].verts) || !isKeyframeDataEqual(a[i].faces, b[i].faces))
+			return false;
+	}
+	return true;
+}
+
+inline int isKeyframeDataEqual(const StringList &a, const StringList &b) {
+	if (a.count()!=b.count())
+		return false;
+
+	// The names of unnamed sets are empty strings, whose ptr() is NULL.
+	for (int i=0; i<a.count(); i++) {
+		const tchar *nameA=a[i].empty()? "" : a[i].ptr();
+		const tchar *nameB=b[i].empty()? "" : b[i].ptr();
+		if (0!=strcmp(nameA, nameB))
+			return false;
+	}
+	return true;
+}
+
 /// Generic animated parameter based on keyframes. Does not perform any interpolation,
 /// just returns the closest keyframe to the requested time values.
 template<class T>
@@ -91,6 +151,54 @@ struct AnimatedParam: VR::VRayPluginParameter {
 		return keyframe.data;
 	}
 
+	/// Return the number of keyframes.
+	int getNumKeyframes(void) const {
+		return keyframes.count();
+	}
+
+	/// Return the data for the given keyframe so that it can be modified in place.
+	T& getKeyframeData(int keyframeIdx) {
+		return keyframes[keyframeIdx].data;
+	}
+
+	/// Return the time of the given keyframe.
+	double getKeyframeTime(int keyframeIdx) const {
+		return keyframes[keyframeIdx].time;
+	}
+
+	/// Remove all keyframes.
+	void clearKeyframes(void) {
+		keyframes.clear();
+	}
+
+	/// If all keyframes have the same data, remove all of them except the first one.
+	/// @retval true if the parameter has at most one keyframe after the call.
+	int collapseConstantKeyframes(void) {
+		for (int i=1; i<keyframes.count(); i++) {
+			if (!isKeyframeDataEqual(keyframes[i].data, keyframes[0].data))
+				return false;
+		}
+
+		collapseToFirstKeyframe();
+		return true;
+	}
+
+	/// Remove all keyframes except the first one.
+	void collapseToFirstKeyframe(void) {
+		if (keyframes.count()>1)
+			keyframes.setCount(1);
+	}
+
+	/// Replace the time of each keyframe with the respective time from the given list. The current
+	/// keyframe times must be time sample indices, as used for geometry prefetched for a future frame.
+	void retimeKeyframes(const TimesList &sampleTimes) {
+		for (int i=0; i<keyframes.count(); i++) {
+			int sampleIdx=int(keyframes[i].time+0.5);
+			if (sampleIdx>=0 && sampleIdx<sampleTimes.count())
+				keyframes[i].time=sampleTimes[sampleIdx];
+		}
+	}
+
 protected:
 	const tchar *paramName;
 
@@ -112,7 +220,9 @@ protected:
 
 	VR::Table<Keyframe<T>, -1> keyframes;
 
-	int getKeyframeIndex(double time) {
+	/// Return the index of the keyframe for the given time, or -1 if there are no keyframes. This and
+	/// the other methods that only read the keyframes are safe to call from several threads at once.
+	int getKeyframeIndex(double time) const {
 		if (keyframes.count()==0)
 			return -1;
 
@@ -197,77 +307,165 @@ struct AnimatedStringListParam: AnimatedSimpleListParam<StringList> {
 	}
 };
 
+/// A position in the nested lists of an AnimatedMapChannelsParam. The position is encoded in the list handles
+/// returned by AnimatedMapChannelsParam::openList(), so that the parameter itself does not keep any state.
+struct MapChannelsListPos {
+	int level; ///< 0 for the list of channels, 1 inside a channel and 2 inside the index, vertex or face list of a channel.
+	int chanIdx; ///< The index of the channel (for level 1 and 2).
+	int innerIdx; ///< 0 for the channel index, 1 for the vertices and 2 for the faces (for level 2).
+
+	/// Constructor; the position is at the top level.
+	MapChannelsListPos(void):level(0), chanIdx(0), innerIdx(0) {}
+
+	/// Return the position for the list with the given index inside this one.
+	MapChannelsListPos getChild(int listIdx) const {
+		MapChannelsListPos res(*this);
+		res.level=level+1;
+		if (res.level==1) res.chanIdx=listIdx;
+		else if (res.level==2) res.innerIdx=listIdx;
+		return res;
+	}
+
+	/// Return the position of the list that contains this one.
+	MapChannelsListPos getParent(void) const {
+		MapChannelsListPos res(*this);
+		if (res.level>0)
+			res.level--;
+		if (res.level<2) res.innerIdx=0;
+		if (res.level<1) res.chanIdx=0;
+		return res;
+	}
+
+	/// Encode the position as a list handle; the handle is never NULL.
+	VR::ListHandle toHandle(void) const {
+		size_t bits=1 | (size_t(level&3)<<1) | (size_t(innerIdx&3)<<3) | (size_t(chanIdx)<<5);
+		return reinterpret_cast<VR::ListHandle>(bits);
+	}
+
+	/// Decode a position from a list handle returned by toHandle().
+	static MapChannelsListPos fromHandle(VR::ListHandle handle) {
+		size_t bits=reinterpret_cast<size_t>(handle);
+		MapChannelsListPos res;
+		res.level=int((bits>>1)&3);
+		res.innerIdx=int((bits>>3)&3);
+		res.chanIdx=int(bits>>5);
+		return res;
+	}
+};
+
 /// Animated map channels parameter.
-/// Blatant copy of the DefMapChannelsParam; need to improve this in the V-Ray SDK.
+/// Based on the DefMapChannelsParam from the V-Ray SDK, but without any state in the parameter: the nested list
+/// that is being read is encoded in the list handles and the list that a thread has opened is kept per thread,
+/// so several threads can read the same parameter at the same time. The methods that take a MapChannelsListPos
+/// can be used directly without opening any lists.
 struct AnimatedMapChannelsParam: AnimatedParam<AbcMapChannelsList> {
 	/// Constructor.
 	/// @param paramName The name of the parameter.
-	/// @param ownName This flag is equal to 1 if the object owns the name and 0 otherwise.
-	AnimatedMapChannelsParam(const tchar *paramName):AnimatedParam<AbcMapChannelsList>(paramName), level(0)
+	AnimatedMapChannelsParam(const tchar *paramName):AnimatedParam<AbcMapChannelsList>(paramName)
 	{}
 
 	int getCount(double time) VRAY_OVERRIDE {
-		AbcMapChannelsList *mapChannels=getMapChannels(time);
-		if (!mapChannels)
-			return -1;
-
-		if (level==0) return mapChannels->count();
-		else if (level==1) return 3;
-		else if (level==2) {
-			if (innerIdx==0) return -1;
-			else if (innerIdx==1) return (*mapChannels)[chanIdx].verts.count();
-			else if (innerIdx==2) return (*mapChannels)[chanIdx].faces.count();
-		}
-		return mapChannels->count();
+		return getCount(getThreadListPos(), time);
 	}
 
 	VR::ListHandle openList(int listIdx) VRAY_OVERRIDE {
-		level++;
-		if (level==1) chanIdx=listIdx;
-		else if (level==2) innerIdx=listIdx;
-		// vs2015 warns about assigning 32-bit signed int to pointer
-		return reinterpret_cast<VR::ListHandle>(static_cast<size_t>(level)); // Any non-NULL value would do.
+		MapChannelsListPos pos=getThreadListPos().getChild(listIdx);
+		ThreadListCursor &cursor=getThreadListCursor();
+		cursor.param=this;
+		cursor.handle=pos.toHandle();
+		return cursor.handle;
 	}
 
-	void closeList(VR::ListHandle) VRAY_OVERRIDE { level--; }
+	void closeList(VR::ListHandle handle) VRAY_OVERRIDE {
+		ThreadListCursor &cursor=getThreadListCursor();
+		if (cursor.param!=this || !handle)
+			return;
+
+		MapChannelsListPos pos=MapChannelsListPos::fromHandle(handle).getParent();
+		if (pos.level==0) {
+			cursor.param=nullptr;
+			cursor.handle=nullptr;
+		} else {
+			cursor.handle=pos.toHandle();
+		}
+	}
 
 	int getInt(int index, double time) VRAY_OVERRIDE {
-		AbcMapChannelsList *mapChannels=getMapChannels(time);
+		return getInt(getThreadListPos(), time);
+	}
+
+	VR::IntList getIntList(double time) VRAY_OVERRIDE {
+		return getIntList(getThreadListPos(), time);
+	}
+
+	VR::VectorList getVectorList(double time) VRAY_OVERRIDE {
+		return getVectorList(getThreadListPos(), time);
+	}
+
+	VR::VRayParameterType getType(int index, double time) VRAY_OVERRIDE {
+		return getType(getThreadListPos(), index);
+	}
+
+	/// Return the number of elements in the list at the given position, or -1 if it is not a list.
+	int getCount(const MapChannelsListPos &pos, double time) const {
+		const AbcMapChannelsList *mapChannels=getMapChannels(time);
+		if (!mapChannels)
+			return -1;
+
+		if (pos.level==0) return mapChannels->count();
+		else if (pos.level==1) return 3;
+		else if (pos.level==2) {
+			if (pos.innerIdx==0) return -1;
+			else if (pos.innerIdx==1) return (*mapChannels)[pos.chanIdx].verts.count();
+			else if (pos.innerIdx==2) return (*mapChannels)[pos.chanIdx].faces.count();
+		}
+		return mapChannels->count();
+	}
+
+	/// Return the index of the channel at the given position.
+	int getInt(const MapChannelsListPos &pos, double time) const {
+		const AbcMapChannelsList *mapChannels=getMapChannels(time);
 		if (!mapChannels)
 			return 0;
 
-		if (level==1 || level==2) return (*mapChannels)[chanIdx].idx;
+		if (pos.level==1 || pos.level==2) return (*mapChannels)[pos.chanIdx].idx;
 		else return 0;
 	}
 
-	VR::IntList getIntList(double time) VRAY_OVERRIDE {
-		AbcMapChannelsList *mapChannels=getMapChannels(time);
+	/// Return the faces of the channel at the given position. The list references the data of the parameter.
+	VR::IntList getIntList(const MapChannelsListPos &pos, double time) const {
+		const AbcMapChannelsList *mapChannels=getMapChannels(time);
 		if (!mapChannels)
 			return VR::IntList();
 
-		if (level==2 && innerIdx==2) return VR::IntList(&((*mapChannels)[chanIdx].faces[0]), (*mapChannels)[chanIdx].faces.count());
+		if (pos.level==2 && pos.innerIdx==2)
+			return (*mapChannels)[pos.chanIdx].faces;
 		return VR::IntList();
 	}
 
-	VR::VectorList getVectorList(double time) VRAY_OVERRIDE {
-		AbcMapChannelsList *mapChannels=getMapChannels(time);
+	/// Return the vertices of the channel at the given position. The list references the data of the parameter.
+	VR::VectorList getVectorList(const MapChannelsListPos &pos, double time) const {
+		const AbcMapChannelsList *mapChannels=getMapChannels(time);
 		if (!mapChannels)
 			return VR::VectorList();
 
-		if (level==2 && innerIdx==1) return VR::VectorList(&((*mapChannels)[chanIdx].verts[0]), (*mapChannels)[chanIdx].verts.count());
+		if (pos.level==2 && pos.innerIdx==1)
+			return (*mapChannels)[pos.chanIdx].verts;
 		return VR::VectorList();
 	}
 
-	VR::VRayParameterType getType(int index, double time) VRAY_OVERRIDE {
-		if (level==0) return VR::paramtype_list;
+	/// Return the type of the element with the given index (or of all elements, if the index is -1) in the
+	/// list at the given position.
+	VR::VRayParameterType getType(const MapChannelsListPos &pos, int index) const {
+		if (pos.level==0) return VR::paramtype_list;
 		else {
 			if (index==-1) {
-				if (level==1)
+				if (pos.level==1)
 					return VR::paramtype_list;
 				else {
-					if (innerIdx == 0) return VR::paramtype_int;
-					else if (innerIdx == 1) return VR::paramtype_vector;
-					else if (innerIdx == 2) return VR::paramtype_int;
+					if (pos.innerIdx == 0) return VR::paramtype_int;
+					else if (pos.innerIdx == 1) return VR::paramtype_vector;
+					else if (pos.innerIdx == 2) return VR::paramtype_int;
 					return VR::paramtype_unspecified;
 				}
 			}
@@ -287,22 +485,32 @@ struct AnimatedMapChannelsParam: AnimatedParam<AbcMapChannelsList> {
 		return &(keyframes[keyframeIdx].data);
 	}
 
+	/// Returns the list of mapping channels for reading.
+	const AbcMapChannelsList* getMapChannels(double time) const {
+		int keyframeIdx=getKeyframeIndex(time);
+		if (keyframeIdx==-1)
+			return NULL;
+
+		return &(keyframes[keyframeIdx].data);
+	}
+
+	/// The methods below modify the data in the list that the calling thread has opened;
+	/// they must not be called while other threads read the parameter.
 	void reserve(int count, double time) {
 		AbcMapChannelsList *mapChannels=getMapChannels(time);
 		if (!mapChannels)
 			return;
 
-		if (level == 0) {
+		MapChannelsListPos pos=getThreadListPos();
+		if (pos.level == 0) {
 			mapChannels->setCount(count, true);
 			mapChannels->clear();
-		} else if (level==2) {
-			if(innerIdx == 1) {
-				(*mapChannels)[chanIdx].verts.setCount(count, true);
-				(*mapChannels)[chanIdx].verts.clear();
+		} else if (pos.level==2) {
+			if(pos.innerIdx == 1) {
+				(*mapChannels)[pos.chanIdx].verts=VR::VectorList(count);
 			}
-			else if (innerIdx==2) {
-				(*mapChannels)[chanIdx].faces.setCount(count, true);
-				(*mapChannels)[chanIdx].faces.clear();
+			else if (pos.innerIdx==2) {
+				(*mapChannels)[pos.chanIdx].faces=VR::IntList(count);
 			}
 		}
 	}
@@ -312,12 +520,12 @@ struct AnimatedMapChannelsParam: AnimatedParam<AbcMapChannelsList> {
 		if (!mapChannels)
 			return;
 
-		if (level == 1) {
-			(*mapChannels)[chanIdx].idx = value;
-		} else if (level==2) {
-			if (innerIdx==2) {
-				if(index>=0 && index<(*mapChannels)[chanIdx].faces.count()) (*mapChannels)[chanIdx].faces[index] = value;
-				else (*mapChannels)[chanIdx].faces[index]+=value;
+		MapChannelsListPos pos=getThreadListPos();
+		if (pos.level == 1) {
+			(*mapChannels)[pos.chanIdx].idx = value;
+		} else if (pos.level==2) {
+			if (pos.innerIdx==2) {
+				if(index>=0 && index<(*mapChannels)[pos.chanIdx].faces.count()) (*mapChannels)[pos.chanIdx].faces[index] = value;
 			}
 		}
 	}
@@ -327,16 +535,32 @@ struct AnimatedMapChannelsParam: AnimatedParam<AbcMapChannelsList> {
 		if (!mapChannels)
 			return;
 
-		if (level == 2 && innerIdx == 1) {
-			if(index >= 0 && index < (*mapChannels)[chanIdx].verts.count()) (*mapChannels)[chanIdx].verts[index] = value;
-			else (*mapChannels)[chanIdx].verts[index] += value;
+		MapChannelsListPos pos=getThreadListPos();
+		if (pos.level == 2 && pos.innerIdx == 1) {
+			if(index >= 0 && index < (*mapChannels)[pos.chanIdx].verts.count()) (*mapChannels)[pos.chanIdx].verts[index] = value;
 		}
 	}
 
 protected:
-	int chanIdx;
-	int innerIdx;
-	int level;
+	/// The list of a map channels parameter that a thread has opened.
+	struct ThreadListCursor {
+		const AnimatedMapChannelsParam *param; ///< The parameter with the open list, or nullptr if there is none.
+		VR::ListHandle handle; ///< The handle of the innermost open list.
+	};
+
+	/// Return the open list of the calling thread.
+	static ThreadListCursor& getThreadListCursor(void) {
+		static thread_local ThreadListCursor cursor={ nullptr, nullptr };
+		return cursor;
+	}
+
+	/// Return the position of the list that the calling thread has opened in this parameter.
+	MapChannelsListPos getThreadListPos(void) const {
+		const ThreadListCursor &cursor=getThreadListCursor();
+		if (cursor.param!=this || !cursor.handle)
+			return MapChannelsListPos();
+		return MapChannelsListPos::fromHandle(cursor.handle);
+	}
 };
 
 /// A structure with parameters for displacement/subdivision
@@ -344,9 +568,75 @@ struct DisplacementSubdivParams {
 	VR::VRayPlugin *displacementTex; ///< The displacement texture.
 	float displacementAmount; ///< The displacement amount.
 	int hasSubdivision; ///< true to subdivide the object.
+	float edgeLength; ///< The target edge length of the tessellated triangles, in pixels.
+	int maxSubdivs; ///< The maximum number of subdivisions of an original triangle edge.
+	int staticTessellation; ///< true to tessellate the object before rendering and false to tessellate it on demand.
+
+	/// Constructor.
+	DisplacementSubdivParams(void): displacementTex(nullptr), hasSubdivision(false), displacementAmount(0.0f),
+		edgeLength(4.0f), maxSubdivs(256), staticTessellation(true) {}
+
+	/// Return true if the object needs a displacement or subdivision wrapper plugin.
+	int hasDisplacementOrSubdivision(void) const {
+		return hasSubdivision || displacementTex!=nullptr;
+	}
+
+	/// Return true if the tessellation of two objects is done with the same settings.
+	int isSameAs(const DisplacementSubdivParams &other) const {
+		return displacementTex==other.displacementTex && displacementAmount==other.displacementAmount &&
+			hasSubdivision==other.hasSubdivision && edgeLength==other.edgeLength && maxSubdivs==other.maxSubdivs &&
+			staticTessellation==other.staticTessellation;
+	}
+};
+
+/// A rough estimate of the memory used by one triangle of static geometry, including
+/// the copy of the vertices and the acceleration structure.
+const size_t staticBytesPerTriangle=64;
+
+/// A structure with parameters for the level of detail of an object.
+struct LodParams {
+	float maxPixels; ///< Objects whose projected size (in pixels) is below this threshold are decimated.
+	float cellPixels; ///< The size (in pixels) of a vertex clustering cell when decimating.
+
+	/// Constructor.
+	LodParams(void): maxPixels(0.0f), cellPixels(1.0f) {}
+};
+
+/// Camera parameters used to estimate the projected size of objects.
+struct LodCamera {
+	VR::Vector pos; ///< The camera position in world space.
+	float fov; ///< The horizontal field of view, in radians.
+	int imgWidth; ///< The image width in pixels.
+
+	/// Constructor.
+	LodCamera(void): fov(0.0f), imgWidth(0) { pos.makeZero(); }
+
+	/// Take the camera parameters from the given frame data.
+	void init(const VR::VRayFrameData &fdata) {
+		pos=fdata.camToWorld.offs;
+		fov=fdata.fov;
+		imgWidth=fdata.imgWidth;
+	}
+
+	/// Return true if the given camera parameters are the same as these.
+	int isSameAs(const LodCamera &other) const {
+		return pos==other.pos && fov==other.fov && imgWidth==other.imgWidth;
+	}
+};
+
+/// The parameters of the displacement/subdivision plugin of an object that reference other plugins or have
+/// a value specific to the object.
+struct DisplSubdivPluginParams {
+	VR::DefPluginParam sourceMeshParam; ///< The parameter with the source mesh plugin.
+	VR::DefPluginParam displTextureParam; ///< The displacement texture.
+	VR::DefFloatParam displAmountParam; ///< The displacement amount parameter.
 
 	/// Constructor.
-	DisplacementSubdivParams(void): displacementTex(nullptr), hasSubdivision(false), displacementAmount(0.0f) {}
+	DisplSubdivPluginParams(void):
+		sourceMeshParam("mesh", nullptr),
+		displTextureParam("displacement_tex_color", nullptr),
+		displAmountParam("displacement_amount", 0.0f)
+	{}
 };
 
 /// Information about a GeomStaticMesh plugin created for each object from the Alembic file.
@@ -366,22 +656,36 @@ struct AlembicMeshSource {
 
 	AnimatedStringListParam mapChannelNamesParam; ///< A parameter with the map channel names.
 
-	/// Parameter for the dynamic_geometry flag of the GeomStaticMesh plugin. Enabling dynamic
-	/// geometry allows efficient instancing of the mesh geometry. Otherwise it is replicated
-	/// for each instance. For now we always set this flag to true, although potentially this
-	/// can be optimized.
-	VR::DefBoolParam dynamicGeometryParam;
-
-	VR::DefPluginParam displSubdivSourceMeshParam; ///< The parameter with the source mesh plugin for displSubdivPlugin.
-	VR::DefBoolParam preTesselateDisplParam; ///< Parameter that specifies whether to pre-tessellate displacement.
-	VR::DefBoolParam preTesselateSubdivParam; ///< Parameter that specifies whether to pre-tesselate subdivision.
-	VR::DefFloatParam displSubdivEdgeLengthParam; ///< Edge length for view-dependent displacement/subdivision.
-	VR::DefBoolParam useGlobalsParam; ///< Parameter to disable usage of global displacement settings.
-	VR::DefIntParam maxSubdivLevelsParam; ///< Parameter for the maximum subdivision along a face edge for displacement/subdivision.
-	VR::DefPluginParam displTextureParam; ///< The displacement texture.
-	VR::DefFloatParam displAmountParam; ///< The displacement amount parameter.
+	/// Parameter for the face set of each face, as an index into faceSetNames; used as the material ID of the
+	/// face. It has no keyframes if the object has a single face set.
+	AnimatedIntListParam faceMtlIDsParam;
+
+	StringList faceSetNames; ///< The names of the face sets of the object; empty if the object has a single face set.
+
+	/// The names of the objects that were merged into this mesh, in the order of their IDs in the object ID
+	/// UV/color set; empty if this mesh was not created by merging small objects.
+	StringList mergedNames;
+
+	/// The per-object parameters of displSubdivPlugin; nullptr if the object has no displacement/subdivision.
+	/// The parameters with values common to many objects are in GeomAlembicReader::sharedPluginParams.
+	DisplSubdivPluginParams *displSubdivPluginParams;
 
 	int nsamples; ///< Number of time samples.
+	int voxelIndex; ///< The index of the voxel in the file that this object was read from.
+	VR::CharString abcName; ///< The full Alembic name of the object that this mesh was read from.
+	int chunkIndex; ///< The index of this mesh among the spatial chunks of a large object, or -1 if the object was not split.
+	float tessellationScale; ///< A multiplier for the displacement/subdivision edge length that keeps the tessellation within budget.
+	double tessellatedTriangles; ///< The estimated number of triangles after displacement/subdivision for all instances; 0 if there is none.
+	/// The dynamic_geometry flag of the GeomStaticMesh plugin. Enabling dynamic geometry allows efficient
+	/// instancing of the mesh geometry. Otherwise it is replicated for each instance, but it is faster to
+	/// ray trace. The flag is chosen for each mesh by GeomAlembicReader::chooseDynamicGeometry().
+	int dynamicGeometry;
+	int usesMappedData; ///< true if the vertex, face and UV/color set lists point into external memory (a memory-mapped disk cache file or shared geometry).
+	DisplacementSubdivParams displSubdivParams; ///< The displacement/subdivision settings that the plugins were created with.
+
+	/// A hash of the geometry and the tessellation settings of a static mesh with pre-tessellated displacement or
+	/// subdivision, used to reuse its plugins on the next frame; 0 if the mesh can't be reused.
+	VR::uint64 tessellationKey;
 
 	/// Constructor.
 	AlembicMeshSource(void):
@@ -394,18 +698,45 @@ struct AlembicMeshSource {
 		velocitiesParam("velocities"),
 		mapChannelsParam("map_channels"),
 		mapChannelNamesParam("map_channels_names"),
-		dynamicGeometryParam("dynamic_geometry", true),
-		displSubdivSourceMeshParam("mesh", nullptr),
-		preTesselateDisplParam("static_displacement", true),
-		preTesselateSubdivParam("static_subdiv", true),
-		displSubdivEdgeLengthParam("edge_length", 4.0f),
-		useGlobalsParam("use_globals", false),
-		maxSubdivLevelsParam("max_subdivs", 256),
-		displTextureParam("displacement_tex_color", nullptr),
-		displAmountParam("displacement_amount", 0.0f),
-		nsamples(1)
+		faceMtlIDsParam("face_mtlIDs"),
+		displSubdivPluginParams(nullptr),
+		nsamples(1),
+		voxelIndex(-1),
+		chunkIndex(-1),
+		tessellationScale(1.0f),
+		tessellatedTriangles(0.0),
+		dynamicGeometry(true),
+		usesMappedData(false),
+		tessellationKey(0)
 	{}
 
+	/// Destructor.
+	~AlembicMeshSource(void) {
+		delete displSubdivPluginParams;
+		displSubdivPluginParams=nullptr;
+	}
+
+	/// Set the dynamic_geometry flag of the GeomStaticMesh plugin.
+	void setDynamicGeometry(int dynamic) {
+		dynamicGeometry=dynamic;
+	}
+
+	/// Replace the vertex, face, normal, velocity and UV/color set lists that point into external memory with own
+	/// copies, so that the mesh can outlive it.
+	void detachMappedData(void) {
+		if (!usesMappedData)
+			return;
+
+		detachKeyframes(verticesParam);
+		detachKeyframes(facesParam);
+		detachKeyframes(normalsParam);
+		detachKeyframes(faceNormalsParam);
+		detachKeyframes(velocitiesParam);
+		detachKeyframes(faceMtlIDsParam);
+		detachKeyframes(mapChannelsParam);
+		usesMappedData=false;
+	}
+
 	void setNumTimeSteps(int numTimeSteps) {
 		nsamples=numTimeSteps;
 		verticesParam.reserveKeyframes(nsamples);
@@ -415,8 +746,81 @@ struct AlembicMeshSource {
 		velocitiesParam.reserveKeyframes(nsamples);
 		mapChannelsParam.reserveKeyframes(nsamples);
 		mapChannelNamesParam.reserveKeyframes(nsamples);
+		faceMtlIDsParam.reserveKeyframes(nsamples);
+	}
+
+	/// Replace the time sample indices of all keyframes with the actual times.
+	/// @see AnimatedParam::retimeKeyframes()
+	void retimeKeyframes(const TimesList &sampleTimes) {
+		verticesParam.retimeKeyframes(sampleTimes);
+		facesParam.retimeKeyframes(sampleTimes);
+		normalsParam.retimeKeyframes(sampleTimes);
+		faceNormalsParam.retimeKeyframes(sampleTimes);
+		velocitiesParam.retimeKeyframes(sampleTimes);
+		mapChannelsParam.retimeKeyframes(sampleTimes);
+		mapChannelNamesParam.retimeKeyframes(sampleTimes);
+		faceMtlIDsParam.retimeKeyframes(sampleTimes);
+	}
+
+	/// Collapse the keyframes of each channel that does not change over the motion blur interval to
+	/// a single keyframe. If the vertices are constant and there is no vertex motion, the velocities are
+	/// removed too, so that V-Ray can treat the mesh as static.
+	/// @retval true if the mesh is static after the call and false otherwise.
+	int collapseConstantKeyframes(void) {
+		int staticVerts=verticesParam.collapseConstantKeyframes();
+		facesParam.collapseConstantKeyframes();
+		normalsParam.collapseConstantKeyframes();
+		faceNormalsParam.collapseConstantKeyframes();
+		mapChannelsParam.collapseConstantKeyframes();
+		mapChannelNamesParam.collapseConstantKeyframes();
+		faceMtlIDsParam.collapseConstantKeyframes();
+
+		int staticVelocities=velocitiesParam.collapseConstantKeyframes();
+		if (staticVerts && staticVelocities && velocitiesParam.getNumKeyframes()==1) {
+			const VR::VectorList &velocities=velocitiesParam.getKeyframeData(0);
+			int hasMotion=false;
+			for (int i=0; i<velocities.count() && !hasMotion; i++)
+				hasMotion=(velocities[i].x!=0.0f || velocities[i].y!=0.0f || velocities[i].z!=0.0f);
+			if (!hasMotion)
+				velocitiesParam.clearKeyframes();
+		}
+
+		return staticVerts && velocitiesParam.getNumKeyframes()==0;
+	}
+
+protected:
+	/// Replace the data of the given list with an own copy.
+	template<class T>
+	static void detachList(T &data) {
+		T copy(data.count());
+		for (int j=0; j<data.count(); j++)
+			copy[j]=data[j];
+		data=copy;
+	}
+
+	/// Replace the data of all keyframes of the given list parameter with own copies.
+	template<class T, class P>
+	static void detachKeyframes(P &param) {
+		for (int i=0; i<param.getNumKeyframes(); i++) {
+			T &data=param.getKeyframeData(i);
+			detachList(data);
+		}
+	}
+
+	static void detachKeyframes(AnimatedVectorListParam &param) { detachKeyframes<VR::VectorList>(param); }
+	static void detachKeyframes(AnimatedIntListParam &param) { detachKeyframes<VR::IntList>(param); }
+
+	static void detachKeyframes(AnimatedMapChannelsParam &param) {
+		for (int i=0; i<param.getNumKeyframes(); i++) {
+			AbcMapChannelsList &mapChannels=param.getKeyframeData(i);
+			for (int j=0; j<mapChannels.count(); j++) {
+				detachList(mapChannels[j].verts);
+				detachList(mapChannels[j].faces);
+			}
+		}
 	}
 
+public:
 	/// Return the plugin that generates geometry for this object. This is either
 	/// the displSubdivPlugin if there is subdivision/displacement, or just the geomStaticMesh plugin.
 	VR::VRayPlugin* getGeomPlugin(void) const {
@@ -427,9 +831,6 @@ struct AlembicMeshSource {
 	}
 };
 
-typedef VR::Table<VR::Transform, -1> TransformsList;
-typedef VR::Table<double, -1> TimesList;
-
 /// Information about an instance of an AlembicMeshSource.
 struct AlembicMeshInstance {
 	AlembicMeshSource *meshSource; ///< The original mesh.
@@ -438,12 +839,273 @@ struct AlembicMeshInstance {
 	VR::CharString abcName; ///< The full Alembic name of this instance from the Alembic file.
 
 	VR::VRayStaticGeometry *meshInstance; ///< The instance returned from the GeomStaticMesh object.
+	VR::VRayPlugin *mtlPlugin; ///< The material that meshInstance was created or last updated with.
 	VR::CharString userAttr; ///< User attributes
 	int meshIndex; ///< The index of the instance
+	VR::uint64 geometryHash; ///< A hash of the geometry and the transformations of the object as read from the file; 0 if not computed.
+	VR::uint64 topologyHash; ///< A hash of the faces of the object as read from the file; 0 if not computed.
+
+	/// Constructor.
+	AlembicMeshInstance(void):meshSource(NULL), meshInstance(NULL), mtlPlugin(NULL), meshIndex(-1), geometryHash(0), topologyHash(0) {
+	}
+
+	/// If all transformations are the same, keep only the first one.
+	/// @retval true if the instance has at most one transformation after the call.
+	int collapseConstantTransforms(void) {
+		for (int i=1; i<tms.count(); i++) {
+			if (0!=memcmp(&tms[i], &tms[0], sizeof(VR::Transform)))
+				return false;
+		}
+
+		if (tms.count()>1) {
+			tms.setCount(1);
+			times.setCount(1);
+		}
+		return true;
+	}
+
+	/// Replace the time sample indices in the times list with the actual times from the given list.
+	/// @see AnimatedParam::retimeKeyframes()
+	void retimeTransforms(const TimesList &sampleTimes) {
+		for (int i=0; i<times.count(); i++) {
+			int sampleIdx=int(times[i]+0.5);
+			if (sampleIdx>=0 && sampleIdx<sampleTimes.count())
+				times[i]=sampleTimes[sampleIdx];
+		}
+	}
+};
+
+/// Compute the geometryHash and the topologyHash of the given instance from its transformations and the
+/// geometry of the given mesh source, which must not be processed yet (f.e. by level of detail).
+void computeGeometryHashes(AlembicMeshSource &abcMeshSource, AlembicMeshInstance &abcMeshInstance);
+
+/// The data of the last time sample of a mesh read for one frame. With centered or end-of-frame shutter intervals,
+/// this sample often has the same time as the first sample of the next frame, so it doesn't need to be decoded again.
+struct AlembicBoundarySample {
+	double time; ///< The time of the sample.
+	VR::CharString abcName; ///< The full Alembic name of the object.
+	VR::Transform tm; ///< The Alembic transformation of the object.
+	VR::VectorList vertices; ///< The vertices.
+	VR::IntList faces; ///< The faces.
+	VR::VectorList normals; ///< The normals; empty if the mesh has no normals.
+	VR::IntList faceNormals; ///< The face normals; empty if the mesh has no normals.
+	VR::VectorList velocities; ///< The vertex velocities; empty if the velocities are not read or are all zero.
+	AbcMapChannelsList mapChannels; ///< The UV/color sets.
+	StringList mapChannelNames; ///< The names of the UV/color sets.
+	VR::IntList faceMtlIDs; ///< The face set of each face; empty if the mesh has a single face set.
+	StringList faceSetNames; ///< The names of the face sets that faceMtlIDs index into.
+	int hasNormals; ///< true if the mesh has normals.
+	int hasVelocities; ///< true if the mesh has velocities, even if they are all zero.
+	int hasMapChannels; ///< true if the mesh has UV/color sets.
 
 	/// Constructor.
-	AlembicMeshInstance(void):meshSource(NULL), meshInstance(NULL), meshIndex(-1) {
+	AlembicBoundarySample(void): time(0.0), hasNormals(false), hasVelocities(false), hasMapChannels(false) {}
+};
+
+/// The boundary samples of all meshes read from a file for the previous frame, and the ones being collected for the
+/// current frame. The samples are valid only as long as the file and the settings that affect the geometry don't change.
+struct AlembicBoundarySamples {
+	/// Constructor.
+	AlembicBoundarySamples(void): settingsHash(0) {}
+
+	/// Destructor.
+	~AlembicBoundarySamples(void) {
+		freeMem();
 	}
+
+	/// Start collecting the samples for a new frame. The samples from the previous frame are dropped if they were
+	/// read from a different file or with different settings.
+	void begin(const VR::CharString &fname, const FileStamp &stamp, VR::uint64 hash) {
+		if (fileName!=fname || fileStamp!=stamp || settingsHash!=hash) {
+			freeSamples(previous);
+			fileName=fname;
+			fileStamp=stamp;
+			settingsHash=hash;
+		}
+		freeSamples(current);
+	}
+
+	/// Replace the samples from the previous frame with the ones collected for the current frame.
+	void end(void) {
+		freeSamples(previous);
+		previous.copy(current);
+		current.clear();
+	}
+
+	/// Return the sample from the previous frame for the given voxel, if it is at the given time.
+	/// @retval The sample or nullptr if there is none.
+	const AlembicBoundarySample* find(int voxelIndex, double time) const {
+		if (voxelIndex<0 || voxelIndex>=previous.count() || !previous[voxelIndex])
+			return nullptr;
+
+		const AlembicBoundarySample *sample=previous[voxelIndex];
+		return (fabs(sample->time-time)<=1e-6)? sample : nullptr;
+	}
+
+	/// Add the boundary sample for the given voxel for the current frame; the sample is owned by this object after the call.
+	void store(int voxelIndex, AlembicBoundarySample *sample) {
+		int oldCount=current.count();
+		if (voxelIndex>=oldCount) {
+			current.setCount(voxelIndex+1);
+			for (int i=oldCount; i<current.count(); i++)
+				current[i]=nullptr;
+		}
+
+		delete current[voxelIndex];
+		current[voxelIndex]=sample;
+	}
+
+	/// Delete all samples.
+	void freeMem(void) {
+		freeSamples(previous);
+		freeSamples(current);
+	}
+
+protected:
+	VR::CharString fileName; ///< The file that the samples were read from.
+	FileStamp fileStamp; ///< The size and the modification time of the file when the samples were read.
+	VR::uint64 settingsHash; ///< A hash of the settings that affect the geometry.
+	VR::Table<AlembicBoundarySample*, -1> previous; ///< The samples from the previous frame, indexed by voxel.
+	VR::Table<AlembicBoundarySample*, -1> current; ///< The samples being collected for the current frame, indexed by voxel.
+
+	static void freeSamples(VR::Table<AlembicBoundarySample*, -1> &samples) {
+		for (int i=0; i<samples.count(); i++)
+			delete samples[i];
+		samples.clear();
+	}
+};
+
+/// Parameters for reading the geometry of a voxel from the Alembic file.
+struct AlembicReadParams {
+	VR::VRayRenderer *vray; ///< The current V-Ray renderer; used to resolve object names.
+	VR::DefaultMeshSetsData *meshSets; ///< Information about the UV and color sets in the Alembic file.
+	AlembicBoundarySamples *boundarySamples; ///< If not NULL, boundary samples are reused from and collected into this object.
+	int nsamples; ///< Number of time samples.
+	TimesList sampleTimes; ///< The time for each of the time samples.
+	int readVelocities; ///< true to read the vertex velocities.
+	float frame; ///< The frame being read.
+	LodCamera lodCamera; ///< The camera used to compute the level of detail of objects.
+	int detectRigidMotion; ///< true to convert deforming meshes that only move rigidly into animated transformations.
+	float rigidMotionTolerance; ///< The maximum vertex deviation, relative to the mesh size, for rigid motion detection.
+	int computeGeometryHash; ///< true to compute the geometry hashes of the instances, for detecting changes in the file.
+	AbcArchiveIndex *archiveIndex; ///< If not NULL, the metadata of the read voxels is recorded here. Only set on the main thread.
+	VR::Table<int, -1> *voxelVisibility; ///< If not NULL, the visibility of the read voxels is recorded here. Only set on the main thread.
+
+	/// Constructor.
+	AlembicReadParams(void): vray(nullptr), meshSets(nullptr), boundarySamples(nullptr), nsamples(1), readVelocities(false), frame(0.0f),
+		detectRigidMotion(false), rigidMotionTolerance(1e-4f), computeGeometryHash(false), archiveIndex(nullptr), voxelVisibility(nullptr) {}
+
+	/// Compute the sample times for the given motion blur interval.
+	void initSampleTimes(int numSamples, double frameStart, double frameEnd, double frameTime) {
+		nsamples=numSamples;
+		sampleTimes.setCount(nsamples);
+		for (int i=0; i<nsamples; i++) {
+			sampleTimes[i]=(nsamples>1)? (frameStart+(frameEnd-frameStart)*i/double(nsamples-1)) : frameTime;
+		}
+	}
+};
+
+/// Objects of the current frame read in the background with progressive_loading, waiting to be added to the render
+/// by GeomAlembicReader::addProgressiveObjects(). Only the main thread modifies pendingVoxels and the settings, and
+/// only while the background thread is not running.
+struct AlembicProgressiveData {
+	VR::Table<int, -1> pendingVoxels; ///< The voxels left to read, the most important first.
+	std::atomic<int> numRead; ///< The number of voxels at the start of pendingVoxels that the background thread has read.
+	std::atomic<int> finished; ///< true once the background thread has stopped.
+	std::mutex mutex; ///< Protects meshSources and meshInstances, which are filled in by the background thread.
+	VR::Table<AlembicMeshSource*, -1> meshSources; ///< The mesh sources read so far, without any plugins.
+	VR::Table<AlembicMeshInstance*, -1> meshInstances; ///< The instances of the mesh sources.
+	std::atomic<int> cancel; ///< Set to true to stop the background thread.
+	int frameNumber; ///< The frame that the objects are read for.
+	float fps; ///< The frames per second.
+	VR::AlembicParams abcParams; ///< The motion blur parameters.
+	AlembicReadParams readParams; ///< The parameters for reading the objects; meshSets, boundarySamples, archiveIndex and voxelVisibility are not set.
+
+	/// Constructor.
+	AlembicProgressiveData(void): numRead(0), finished(false), cancel(false), frameNumber(0), fps(24.0f) {}
+
+	/// Destructor.
+	~AlembicProgressiveData(void) {
+		freeMem();
+	}
+
+	/// Delete all the geometry that was not added to the render and forget the pending voxels.
+	void freeMem(void) {
+		for (int i=0; i<meshInstances.count(); i++)
+			delete meshInstances[i];
+		meshInstances.clear();
+
+		for (int i=0; i<meshSources.count(); i++)
+			delete meshSources[i];
+		meshSources.clear();
+
+		pendingVoxels.clear();
+		numRead=0;
+	}
+};
+
+/// Geometry read in the background for a future frame, waiting to be used by GeomAlembicReader::loadGeometry().
+/// The keyframe times of the mesh sources and the instances are time sample indices until the geometry is used.
+struct AlembicPrefetchData {
+	VR::CharString fileName; ///< The file that the geometry was read from.
+	FileStamp fileStamp; ///< The size and the modification time of the file when the geometry was read.
+	int frameNumber; ///< The frame that the geometry was read for.
+	int nsamples; ///< The number of time samples.
+	VR::uint64 settingsHash; ///< A hash of the settings and the rules that the geometry was read with.
+	LodCamera lodCamera; ///< The camera that the level of detail was computed for.
+	VR::Table<AlembicMeshSource*, -1> meshSources; ///< The mesh sources, without any plugins.
+	VR::Table<AlembicMeshInstance*, -1> meshInstances; ///< The instances of the mesh sources.
+
+	/// true if reading the geometry waits for progressive loading of the current frame to finish; the frame number
+	/// and the settings below are then what it is read with once it starts.
+	int deferred;
+	float fps; ///< The frames per second, if deferred.
+	VR::AlembicParams abcParams; ///< The motion blur parameters, if deferred.
+	AlembicReadParams readParams; ///< The parameters for reading the objects, if deferred; only the settings are set.
+
+	/// Constructor.
+	AlembicPrefetchData(void): frameNumber(0), nsamples(0), settingsHash(0), deferred(false), fps(24.0f) {}
+
+	/// Destructor.
+	~AlembicPrefetchData(void) {
+		freeMem();
+	}
+
+	/// Delete all the geometry.
+	void freeMem(void) {
+		for (int i=0; i<meshInstances.count(); i++)
+			delete meshInstances[i];
+		meshInstances.clear();
+
+		for (int i=0; i<meshSources.count(); i++)
+			delete meshSources[i];
+		meshSources.clear();
+
+		deferred=false;
+	}
+};
+
+/// A MtlMulti plugin that combines the materials of the face sets of one or more objects. Objects whose face
+/// sets resolve to the same materials share the plugin.
+struct FaceSetMaterial {
+	VR::Table<VR::VRayPlugin*, -1> mtls; ///< The material of each face set, indexed by the face material ID.
+	VR::VRayPlugin *mtlPlugin; ///< The MtlMulti plugin.
+
+	/// Constructor.
+	FaceSetMaterial(void): mtlPlugin(nullptr) {}
+};
+
+/// The file and the settings that the geometry of a GeomAlembicReader was loaded with.
+struct AlembicLoadInfo {
+	VR::CharString fileName; ///< The file name; empty if no geometry is loaded.
+	FileStamp fileStamp; ///< The stamp of the file when the geometry was loaded.
+	int frameNumber; ///< The frame number.
+	float fps; ///< The frames per second.
+	VR::AlembicParams abcParams; ///< The motion blur parameters.
+	AlembicReadParams readParams; ///< The parameters for reading the objects; meshSets, boundarySamples, archiveIndex and voxelVisibility are not set.
+
+	/// Constructor.
+	AlembicLoadInfo(void): frameNumber(0), fps(24.0f) {}
 };
 
 //********************************************************
@@ -456,6 +1118,35 @@ struct GeomAlembicReader_Params: VR::VRayParameterListDesc {
 		addParamString("mtl_defs_file", "", -1, "An optional .vrscene file with material definitions. If not specified, look for the materials in the current scene", "fileAsset=(vrscene), fileAssetNames=(V-Ray Scene), fileAssetOp=(load)");
 		addParamString("mtl_assignments_file", "", -1, "An optional XML file that controls material assignments", "fileAsset=(xml), fileAssetNames=(XML control file), fileAssetOp=(load)");
 		addParamInt("nsamples", 0, -1, "The number of motion blur steps (0 is from global settings");
+		addParamBool("scan_archive", false, -1, "If true, the metadata (names, bounds, vertex/face counts) of all objects is read before any geometry, so that rules can be resolved without reading excluded objects");
+		addParamString("archive_index_file", "", -1, "An optional CSV file to write the metadata for all objects in the file to");
+		addParamBool("use_disk_cache", false, -1, "If true, the converted geometry for each frame is written to a cache file on the first render and memory-mapped on subsequent renders");
+		addParamString("disk_cache_dir", "", -1, "The directory for the geometry cache files; if empty, the cache files are placed next to the source file");
+		addParamBool("auto_instancing", false, -1, "If true, meshes that are identical up to a rigid transformation are replaced with instances of a single mesh");
+		addParamFloat("auto_instancing_tolerance", 1e-4f, -1, "The maximum vertex deviation, relative to the mesh size, for two meshes to be considered identical");
+		addParamBool("merge_small_objects", false, -1, "If true, static objects with a single instance and at most merge_max_triangles triangles are combined into one mesh per material and displacement/subdivision settings");
+		addParamInt("merge_max_triangles", 1000, -1, "The maximum number of triangles of an object for it to be merged with other small objects");
+		addParamInt("merge_batch_triangles", 1000000, -1, "The maximum number of triangles of a mesh created by merging small objects");
+		addParamInt("merge_id_channel", 100, -1, "The UV/color set that receives the index of the original object for each face of a merged mesh; -1 to disable");
+		addParamInt("split_min_triangles", 0, -1, "Objects with more triangles than this are split into spatially coherent chunks with their own mesh plugins; 0 to disable");
+		addParamInt("split_chunk_triangles", 1000000, -1, "The maximum number of triangles of a chunk of a split object");
+		addParamBool("detect_rigid_motion", false, -1, "If true, meshes whose vertex samples only differ by a rigid transformation are stored once and the motion is applied as an animated transformation");
+		addParamFloat("rigid_motion_tolerance", 1e-4f, -1, "The maximum vertex deviation, relative to the mesh size, for the motion of a mesh to be considered rigid");
+		addParamInt("static_geometry_max_instances", 1, -1, "Meshes with more instances than this always use dynamic geometry");
+		addParamFloat("static_geometry_mem_limit", 0.0f, -1, "The memory limit in MB for meshes that use static geometry; 0 means a quarter of the available memory");
+		addParamFloat("displacement_triangle_budget", 0.0f, -1, "The maximum number of triangles (in millions) for all displaced and subdivided objects; the edge length of objects is increased as needed to stay within it. 0 means no limit");
+		addParamBool("reuse_tessellation", true, -1, "If true, the plugins for static displaced or subdivided meshes are kept between frames and reused if the geometry and the tessellation settings don't change");
+		addParamBool("share_geometry", true, -1, "If true, readers that reference the same file with the same settings read the geometry for a frame only once and share it");
+		addParamBool("reuse_boundary_samples", true, -1, "If true, the last motion blur sample of each mesh is kept and reused as the first sample of the next frame when the times match");
+		addParamBool("watch_material_files", true, -1, "If true, the material definitions and the material assignments files are checked for changes before each frame and on material updates, and the materials of the loaded objects are rebound without reloading the geometry");
+		addParamBool("incremental_reload", false, -1, "If true, the file is checked for changes on interactive updates, and only the objects that were added, removed or changed are rebuilt");
+		addParamInt("memory_report_count", 0, -1, "If greater than 0, the memory used by this many of the largest objects is reported at the start of each frame");
+		addParamString("memory_report_file", "", -1, "An optional CSV file to write the memory used by each object, channel and keyframe to at the start of each frame");
+		addParamBool("prefetch_next_frame", false, -1, "If true, the geometry for the next frame is read in the background while the current frame renders");
+		addParamBool("progressive_loading", false, -1, "If true, the objects are read in the order of their estimated size on screen and rendering starts once progressive_fraction of them are read or progressive_time_budget runs out; the rest are read in the background and added on the following interactive updates and restarts of the frame. Only used if interactive_render is enabled");
+		addParamFloat("progressive_fraction", 0.25f, -1, "The fraction of the objects that are read before rendering starts when progressive_loading is enabled");
+		addParamFloat("progressive_time_budget", 0.0f, -1, "The time in seconds after which rendering starts when progressive_loading is enabled, even if fewer objects are read; 0 means no limit");
+		addParamBool("interactive_render", false, -1, "Set to true by the host application when the scene is rendered interactively (IPR), where the objects read in the background by progressive_loading can be added on the following updates");
 	}
 };
 
@@ -471,12 +1162,52 @@ struct GeomAlembicReader: VR::VRayStaticGeomSource, VR::VRaySceneModifierInterfa
 		paramList->setParamCache("mtl_defs_file", &mtlDefsFileName, true /* resolvePath */);
 		paramList->setParamCache("mtl_assignments_file", &mtlAssignmentsFileName, true /* resolvePath */);
 		paramList->setParamCache("nsamples", &geomSamples);
+		paramList->setParamCache("prefetch_next_frame", &prefetchNextFrame);
+		paramList->setParamCache("progressive_loading", &progressiveLoading);
+		paramList->setParamCache("progressive_fraction", &progressiveFraction);
+		paramList->setParamCache("progressive_time_budget", &progressiveTimeBudget);
+		paramList->setParamCache("interactive_render", &interactiveRender);
+		paramList->setParamCache("scan_archive", &scanArchive);
+		paramList->setParamCache("use_disk_cache", &useDiskCache);
+		paramList->setParamCache("auto_instancing", &autoInstancing);
+		paramList->setParamCache("auto_instancing_tolerance", &autoInstancingTolerance);
+		paramList->setParamCache("merge_small_objects", &mergeSmallObjects);
+		paramList->setParamCache("merge_max_triangles", &mergeMaxTriangles);
+		paramList->setParamCache("merge_batch_triangles", &mergeBatchTriangles);
+		paramList->setParamCache("merge_id_channel", &mergeIdChannel);
+		paramList->setParamCache("split_min_triangles", &splitMinTriangles);
+		paramList->setParamCache("split_chunk_triangles", &splitChunkTriangles);
+		paramList->setParamCache("detect_rigid_motion", &detectRigidMotion);
+		paramList->setParamCache("static_geometry_max_instances", &staticGeometryMaxInstances);
+		paramList->setParamCache("static_geometry_mem_limit", &staticGeometryMemLimit);
+		paramList->setParamCache("displacement_triangle_budget", &displacementTriangleBudget);
+		paramList->setParamCache("reuse_tessellation", &reuseTessellation);
+		paramList->setParamCache("share_geometry", &shareGeometry);
+		paramList->setParamCache("reuse_boundary_samples", &reuseBoundarySamples);
+		paramList->setParamCache("watch_material_files", &watchMaterialFiles);
+		paramList->setParamCache("incremental_reload", &incrementalReload);
+		paramList->setParamCache("memory_report_count", &memoryReportCount);
+		paramList->setParamCache("memory_report_file", &memoryReportFileName, true /* resolvePath */);
+		paramList->setParamCache("rigid_motion_tolerance", &rigidMotionTolerance);
+		paramList->setParamCache("disk_cache_dir", &diskCacheDir, true /* resolvePath */);
+		paramList->setParamCache("archive_index_file", &archiveIndexFileName, true /* resolvePath */);
 
 		plugman=NULL;
+		vrayRenderer=nullptr;
+		sharedGeometry=nullptr;
+		lastLoadedFrame=0;
+		hasLastLoadedFrame=false;
+		numFaceSetMtlPlugins=0;
+		mtlDefsGeneration=0;
 	}
 
 	/// Destructor.
 	~GeomAlembicReader(void) {
+		discardPrefetch();
+		stopProgressiveLoading();
+		freeRetainedMeshSources();
+		releaseSharedGeometry();
+		freeFaceSetMaterials();
 		plugman=NULL;
 	}
 
@@ -512,6 +1243,9 @@ struct GeomAlembicReader: VR::VRayStaticGeomSource, VR::VRaySceneModifierInterfa
 	void preRenderBegin(VR::VRayRenderer *vray) VRAY_OVERRIDE; // This is where the new material plugins will be created
 	void postRenderEnd(VR::VRayRenderer *vray) VRAY_OVERRIDE; // This is where we destroy our material plugins
 
+	/// Return the metadata index for the current file. It is built on the first frame of the render.
+	const AbcArchiveIndex& getArchiveIndex(void) const { return archiveIndex; }
+
 private:
 	friend struct GeomAlembicReaderInstance;
 
@@ -520,10 +1254,49 @@ private:
 	VR::CharString mtlDefsFileName;
 	VR::CharString mtlAssignmentsFileName;
 	int geomSamples;
+	int prefetchNextFrame;
+	int progressiveLoading;
+	float progressiveFraction;
+	float progressiveTimeBudget;
+	int interactiveRender;
+	int scanArchive;
+	int useDiskCache;
+	int autoInstancing;
+	float autoInstancingTolerance;
+	int mergeSmallObjects;
+	int mergeMaxTriangles;
+	int mergeBatchTriangles;
+	int mergeIdChannel;
+	int splitMinTriangles;
+	int splitChunkTriangles;
+	int detectRigidMotion;
+	float rigidMotionTolerance;
+	int staticGeometryMaxInstances;
+	float staticGeometryMemLimit;
+	float displacementTriangleBudget;
+	int reuseTessellation;
+	int shareGeometry;
+	int reuseBoundarySamples;
+	int watchMaterialFiles;
+	int incrementalReload;
+	int memoryReportCount;
+	VR::CharString memoryReportFileName;
+	VR::CharString diskCacheDir;
+	VR::CharString archiveIndexFileName;
 
 	/// A default material for shading objects without material assignment.
 	VR::VRayPlugin *defaultMtl;
 
+	/// The MtlMulti plugins created for objects whose face sets have different materials.
+	VR::Table<FaceSetMaterial*, -1> faceSetMaterials;
+
+	/// The MtlMulti plugins for the previous materials, until the objects are rebound to the new ones.
+	VR::Table<FaceSetMaterial*, -1> replacedFaceSetMaterials;
+
+	/// The number of MtlMulti plugins created since the start of the render. The replaced plugins live until the
+	/// objects are rebound to the new ones, so this, rather than the table size, makes their names unique.
+	int numFaceSetMtlPlugins;
+
 	/// The mesh plugins that will be instanced for rendering.
 	VR::Table<AlembicMeshSource*, -1> meshSources;
 
@@ -534,6 +1307,7 @@ private:
 
 	PluginManager *plugman; ///< The plugin manager we'll be using to create run-time shaders
 	Factory factory; ///< A class to hold the parameters of the run-time plugins
+	SharedPluginParams sharedPluginParams; ///< Plugin parameters with values common to many mesh plugins.
 
 	/// A helper method to create a new plugin in the plugin manager and add it to the plugins set
 	/// so that we can delete it later.
@@ -551,38 +1325,283 @@ private:
 	typedef VR::HashSet<VR::VRayPlugin*> PluginsSet;
 	PluginsSet plugins; ///< A list of created plugins; used to delete them at the render end
 
-	/// Create a new AlembicMeshSource from the given MeshVoxel, along with the associated GeomStaticMesh plugin for it.
-	/// @param vray The current V-Ray renderer.
+	/// Create a new AlembicMeshSource from the given MeshVoxel. The GeomStaticMesh plugin for it is created later
+	/// by createAllMeshPlugins(), once all objects for the frame are read.
+	/// @param readParams Parameters for reading the voxel.
 	/// @param abcFile The parsed .vrmesh/Alembic file.
-	/// @param voxel The voxel to create a mesh plugin for.
+	/// @param voxelIndex The voxel to create a mesh plugin for.
 	/// @param createInstance true to also create an AlembicMeshInstance object for the mesh and add it to the meshInstances table.
-	/// @param meshSets Information about the UV and color sets in the Alembic file. Used to fill in the names of the mapping channels.
+	/// @param cacheWriter If not NULL, the converted geometry is also written into this disk cache.
+	/// @param shared If not NULL, the converted geometry is added to this shared geometry and the returned
+	/// mesh source references its data.
 	/// @retval The resulting AlembicMeshSource object. May be NULL if the object cannot be created.
 	AlembicMeshSource *createGeomStaticMesh(
-		VR::VRayRenderer *vray,
+		const AlembicReadParams &readParams,
 		VR::MeshFile &abcFile,
 		int voxelIndex,
 		int createInstance,
-		VR::DefaultMeshSetsData &meshSets,
-		int nsamples,
-		double frameStart,
-		double frameEnd,
-		double frameTime
+		GeomCacheWriter *cacheWriter,
+		SharedGeometry *shared
 	);
 
+	/// Decimate the given mesh source if there is a LOD rule for it and it is small enough on screen.
+	void applyLod(AlembicMeshSource &abcMeshSource, const AlembicMeshInstance &abcMeshInstance, const AlembicReadParams &readParams);
+
+	/// Read the geometry for the given voxel into a new AlembicMeshSource, without creating any plugins.
+	/// This method does not modify the meshSources and meshInstances tables and can be called from a background thread,
+	/// as long as readParams does not reference the metadata index and the voxel visibility of the reader.
+	/// @param readParams Parameters for reading the voxel.
+	/// @param abcFile The parsed .vrmesh/Alembic file.
+	/// @param voxelIndex The voxel to read.
+	/// @param[out] abcMeshInstance Receives the Alembic name and the transformations of the object.
+	/// @retval The resulting AlembicMeshSource object. May be NULL if the voxel cannot be read or is excluded.
+	AlembicMeshSource *readMeshSource(
+		const AlembicReadParams &readParams,
+		VR::MeshFile &abcFile,
+		int voxelIndex,
+		AlembicMeshInstance &abcMeshInstance
+	);
+
+	/// Create the GeomStaticMesh plugin and the displacement/subdivision wrapper plugin, if needed,
+	/// for a mesh source returned by readMeshSource().
+	/// @param abcMeshSource The mesh source.
+	/// @param sourceIndex The index of the mesh source; used to name the plugins of objects without a name.
+	/// @retval true if the plugins were created successfully and false otherwise.
+	int createMeshPlugins(AlembicMeshSource &abcMeshSource, int sourceIndex);
+
+	/// Create the plugins for all mesh sources in the meshSources table that don't have them yet. Mesh sources
+	/// for which the plugins cannot be created are deleted, along with their instances. Mesh sources retained from
+	/// the previous frame with the same geometry and tessellation settings are used instead of new ones.
+	void createAllMeshPlugins(void);
+
+	/// Delete the GeomStaticMesh plugin and the displacement/subdivision plugin of the given mesh source.
+	void deleteMeshPlugins(AlembicMeshSource &abcMeshSource);
+
+	/// Static meshes with pre-tessellated displacement or subdivision, kept with their plugins from the previous
+	/// frame so that the plugins don't need to be created again if the mesh is the same on the next frame. The
+	/// tessellation itself is redone when the Node instances are compiled for the frame.
+	VR::Table<AlembicMeshSource*, -1> retainedMeshSources;
+
+	/// Replace the mesh sources in the meshSources table with matching retained mesh sources from the previous frame.
+	/// The retained mesh sources that are not used are deleted.
+	void reuseRetainedMeshSources(void);
+
+	/// Delete all retained mesh sources along with their plugins.
+	void freeRetainedMeshSources(void);
+
+	/// Choose static or dynamic geometry and the tessellation of the given meshes, before their plugins are created.
+	/// This is done for all meshes of a frame as well as for the ones added later by incremental_reload and
+	/// progressive_loading; the meshes that are already loaded keep their settings and count against the budgets.
+	/// @param sources The meshes to choose for; they may or may not be in meshSources already.
+	/// @param instances The instances of these meshes.
+	/// @param camera The camera used to estimate the projected size of the meshes.
+	/// @param prog A progress callback; may be NULL.
+	void applyGeometryPolicy(
+		const VR::Table<AlembicMeshSource*, -1> &sources,
+		const VR::Table<AlembicMeshInstance*, -1> &instances,
+		const LodCamera &camera,
+		VR::ProgressCallback *prog
+	);
+
+	/// Choose between static and dynamic geometry for each of the given meshes, based on the number of instances, the
+	/// number of triangles and the available memory, unless there is a rule for the mesh. The static meshes in
+	/// meshSources that are not among the given ones use up part of the memory. The decisions are reported to prog.
+	/// @param prog A progress callback; may be NULL.
+	void chooseDynamicGeometry(const VR::Table<AlembicMeshSource*, -1> &sources, const VR::Table<AlembicMeshInstance*, -1> &instances, VR::ProgressCallback *prog);
+
+	/// Estimate the number of triangles that each of the given displaced or subdivided meshes will be tessellated
+	/// into, based on its projected size, and scale the edge length of all of them so that the total, together with
+	/// the estimate for the other meshes in meshSources, stays within the triangle budget.
+	/// @param camera The camera used to estimate the projected size of the meshes.
+	/// @param prog A progress callback; may be NULL.
+	void applyTessellationBudget(const VR::Table<AlembicMeshSource*, -1> &sources, const VR::Table<AlembicMeshInstance*, -1> &instances, const LodCamera &camera, VR::ProgressCallback *prog);
+
+	/// Report the memory used by the largest mesh sources to prog and write the memory used by all mesh sources, per
+	/// channel and keyframe, to the memory report file, if there is one.
+	/// @param prog A progress callback; may be NULL.
+	void reportMemoryUsage(VR::ProgressCallback *prog);
+
+	/// Find meshes that are identical up to a rigid transformation and replace them with instances of a single mesh.
+	/// @param prog A progress callback to report the saved memory to; may be NULL.
+	void autoInstanceMeshSources(VR::ProgressCallback *prog);
+
+	/// Combine static objects with a single instance and few triangles that have the same material, displacement/subdivision
+	/// and static/dynamic geometry rules into larger meshes, in the space of the Alembic file. The index of the original
+	/// object of each face is written to the merge_id_channel UV/color set, and the names to AlembicMeshSource::mergedNames.
+	/// @param prog A progress callback to report the number of merged objects to; may be NULL.
+	void mergeSmallMeshSources(VR::ProgressCallback *prog);
+
+	/// Split objects with more than split_min_triangles triangles into spatially coherent chunks of at most
+	/// split_chunk_triangles triangles, each with its own mesh source and one instance per instance of the object,
+	/// so that their acceleration structures can be built in parallel and culled independently. Objects with
+	/// displacement or subdivision, or whose topology changes over the motion blur interval, are not split.
+	/// @param prog A progress callback to report the number of split objects to; may be NULL.
+	void splitLargeMeshSources(VR::ProgressCallback *prog);
+
+	/// Create a reader for the given .vrmesh/Alembic file and initialize it for the given frame.
+	/// @retval The mesh file, or nullptr if the file cannot be opened; in that case an error is printed to the progress callback.
+	static VR::MeshFile* openMeshFile(
+		const tchar *fname,
+		int frameNumber,
+		float fps,
+		VR::AlembicParams &abcParams,
+		VR::VRayRenderer *vray,
+		VR::ThreadManager *threadManager,
+		VR::ProgressCallback *prog
+	);
+
+	/// Read the UV and color sets information from the preview voxel of the given file.
+	static void readMeshSetsData(VR::MeshFile &abcFile, int previewVoxelIndex, int nsamples, VR::DefaultMeshSetsData &setsData);
+
+	/// Metadata about all voxels in the file, built once per file. Only the main thread modifies it.
+	AbcArchiveIndex archiveIndex;
+
+	/// Initialize the metadata index for the given file and scan it if the scan_archive parameter is enabled.
+	void initArchiveIndex(VR::MeshFile &abcFile, VR::VRayRenderer *vray, int frameNumber);
+
+	/// Write the metadata index to archive_index_file. If the file was not opened for the current frame, it is opened
+	/// here to initialize the index.
+	void writeArchiveIndex(int frameNumber, float fps, const VR::AlembicParams &abcParams, VR::VRayRenderer *vray);
+
+	/// Make sure the cached voxel visibility matches the given file.
+	/// @retval The number of voxels in the file.
+	int initVoxelVisibility(VR::MeshFile &abcFile);
+
+	/// Return true if the given voxel is a mesh voxel that should be read, i.e. it is not a preview or an instance voxel
+	/// and it is not known to be excluded by the visibility rules.
+	/// @param visibility The known visibility of the voxels, as in voxelVisibility.
+	static int isMeshVoxel(VR::MeshFile &abcFile, int voxelIndex, const VR::Table<int, -1> &visibility);
+
+	/// Read all the visible mesh voxels from the given file into the given tables, without creating any plugins.
+	/// This method can be called from a background thread if readParams does not reference the metadata index
+	/// and the voxel visibility of the reader.
+	/// @param visibility The known visibility of the voxels, as in voxelVisibility.
+	void readAllMeshSources(
+		const AlembicReadParams &readParams,
+		VR::MeshFile &abcFile,
+		const VR::Table<int, -1> &visibility,
+		VR::Table<AlembicMeshSource*, -1> &sources,
+		VR::Table<AlembicMeshInstance*, -1> &instances
+	);
+
+	/// The disk cache that the current geometry was loaded from, if any. It must stay open while the geometry is used,
+	/// since the mesh sources reference the mapped memory.
+	GeomCacheReader diskCacheReader;
+
+	/// The last motion blur sample of each mesh read from the file for the previous frame.
+	AlembicBoundarySamples boundarySamples;
+
+	/// Compute a hash of the settings that affect the converted geometry, for validating disk cache files
+	/// and for finding geometry read by other readers.
+	VR::uint64 computeGeometrySettingsHash(const AlembicReadParams &readParams, const VR::AlembicParams &abcParams, float fps);
+
+	/// The geometry for the current frame shared with other readers of the same file, if any.
+	SharedGeometry *sharedGeometry;
+
+	/// Add mesh sources and instances that reference the data of the given shared geometry, for the objects
+	/// that are visible with the rules of this reader.
+	void useSharedGeometry(SharedGeometry &shared, const AlembicReadParams &readParams);
+
+	/// Remove the reference to the shared geometry for the current frame, if any.
+	void releaseSharedGeometry(void);
+
+	/// Load the geometry for the current frame from the given disk cache file, if it is valid for the source file.
+	/// If any object cannot be loaded, nothing is kept from the cache and the cache file is deleted.
+	/// @retval true if the geometry was loaded from the cache and false otherwise.
+	int loadFromDiskCache(const VR::CharString &cacheFileName, const FileStamp &sourceStamp, VR::uint64 settingsHash, const AlembicReadParams &readParams);
+
+	/// Geometry being read in the background for the next frame.
+	AlembicPrefetchData prefetchData;
+
+	/// The background thread that fills in prefetchData.
+	std::thread prefetchThread;
+
+	/// Start reading the geometry for the given frame in the background. If progressive loading is still reading the
+	/// objects of the current frame, the prefetch is deferred until it finishes; see startDeferredPrefetch().
+	void startPrefetch(int frameNumber, VR::VRayRenderer *vray, const AlembicReadParams &readParams, float fps, const VR::AlembicParams &abcParams);
+
+	/// Wait for the background thread to finish, if it is running.
+	void waitForPrefetch(void);
+
+	/// Wait for the background thread and delete any prefetched geometry.
+	void discardPrefetch(void);
+
+	/// Start the prefetch deferred by startPrefetch(), if progressive loading has finished.
+	void startDeferredPrefetch(void);
+
+	/// Take the prefetched geometry, if it matches the given frame and settings, and create the plugins for it.
+	/// @retval true if the prefetched geometry was used and false otherwise.
+	int usePrefetchedGeometry(int frameNumber, const AlembicReadParams &readParams, const VR::AlembicParams &abcParams, float fps);
+
+	/// Compute a hash of everything that prefetched geometry depends on, apart from the frame and the camera: the
+	/// settings in computeGeometrySettingsHash() and the level of detail rules.
+	VR::uint64 computePrefetchSettingsHash(const AlembicReadParams &readParams, const VR::AlembicParams &abcParams, float fps);
+
+	/// The frame that was loaded last; used to guess the frame step for prefetch_next_frame.
+	int lastLoadedFrame;
+
+	/// true if lastLoadedFrame is valid.
+	int hasLastLoadedFrame;
+
+	/// The objects of the current frame that are read in the background with progressive_loading.
+	AlembicProgressiveData progressiveData;
+
+	/// The background thread that reads the pending voxels in progressiveData.
+	std::thread progressiveThread;
+
+	/// Sort the given voxels by decreasing projected size, estimated from the bounding boxes in the metadata index.
+	/// Voxels without metadata keep their order after the others.
+	void sortVoxelsByImportance(VR::Table<int, -1> &voxelIndices, const LodCamera &camera);
+
+	/// Start reading the pending voxels in progressiveData in the background.
+	void startProgressiveLoading(int frameNumber, VR::VRayRenderer *vray, const AlembicReadParams &readParams, float fps, const VR::AlembicParams &abcParams);
+
+	/// Stop the background thread, keeping the objects read so far and the voxels that were not read yet.
+	void pauseProgressiveLoading(void);
+
+	/// Start a background thread for the pending voxels that were not read yet, if any.
+	void resumeProgressiveLoading(void);
+
+	/// Stop the background thread and delete the objects that were not added to the render yet.
+	void stopProgressiveLoading(void);
+
+	/// Return true if progressive loading has objects of the current frame that were not added to the render yet,
+	/// either read already or still to be read.
+	int hasPendingProgressiveObjects(void);
+
+	/// Create the plugins for the objects read in the background so far and instance them in all Nodes. Called when
+	/// V-Ray updates the material of a Node and when an interactive render starts the same frame again.
+	/// @retval The number of added objects.
+	int addProgressiveObjects(void);
+
 	/// Create a default material to use for shading when no material assignment is found for an object.
 	VRayPlugin* createDefaultMaterial(void);
 
 	VR::CharString mtlsPrefix; ///< The prefix to use when specifying plugins from the materials definitions file.
 
+	/// The plugins created from the materials definitions file, so that they can be deleted when the file is read again.
+	VR::Table<VR::VRayPlugin*, -1> mtlDefsPlugins;
+
+	/// The plugins from the previous read of the materials definitions file, until the objects are rebound to the new ones.
+	VR::Table<VR::VRayPlugin*, -1> replacedMtlDefsPlugins;
+
+	/// The number of times the materials definitions file was read. The previous plugins live until the objects are
+	/// rebound to the new ones, so this is added to the prefix of the plugins after the first read.
+	int mtlDefsGeneration;
+
 	/// Read material definitions from the specified file and merge them into the given scene.
 	/// The plugin names are prefixed with the file name in case several readers reference the same
 	/// material definitions file.
 	/// @param[in] fileName The .vrscene file name with the material definitions.
+	/// @param generation The number of previous reads of the file; makes the prefix unique when it is read again.
 	/// @param prog A progress callback to print information from parsing the .vrscene file.
 	/// @param[out] mtlPrefix The prefix that was prepended to all plugins when reading the .vrscene file.
 	/// @param[out] vrayScene The scene to create the material plugins into.
-	static VR::ErrorCode readMaterialDefinitions(const VR::CharString &fileName, VR::ProgressCallback *prog, VR::CharString &mtlPrefix, VR::VRayScene &vrayScene);
+	/// @param[out] mtlPlugins The plugins created from the file are appended here.
+	static VR::ErrorCode readMaterialDefinitions(const VR::CharString &fileName, int generation, VR::ProgressCallback *prog, VR::CharString &mtlPrefix, VR::VRayScene &vrayScene, VR::Table<VR::VRayPlugin*, -1> &mtlPlugins);
+
+	/// Delete the plugins from the previous read of the materials definitions file, once no object uses them any more.
+	void deleteReplacedMaterialDefinitions(VR::VRayScene &vrayScene);
 
 	/// Parse the given XML control file into the controlFileXML member.
 	static VR::ErrorCode readMtlAssignmentsFile(const VR::CharString &xmlFile, PXML &mtlAssignmentsFileXML);
@@ -590,9 +1609,71 @@ private:
 	/// The material assignment rules extracted from controlFileXML
 	MtlAssignmentRulesTable mtlAssignments;
 
-	/// Return the material plugin to use for the given Alembic file name.
-	VR::VRayPlugin* getMaterialPluginForInstance(const VR::CharString &abcName);
+	VR::VRayRenderer *vrayRenderer; ///< The current renderer, between preRenderBegin() and postRenderEnd().
+	FileStamp mtlDefsStamp; ///< The stamp of the material definitions file when it was last read.
+	FileStamp mtlAssignmentsStamp; ///< The stamp of the material assignments file when it was last read.
+
+	/// The GeomAlembicReaderInstance objects created for the Node plugins that reference this reader.
+	VR::Table<GeomAlembicReaderInstance*, -1> readerInstances;
+
+	/// The file and the settings that the current geometry was loaded with, for reloading changed objects.
+	AlembicLoadInfo loadInfo;
+
+	/// If the file changed since the geometry was loaded, read it again and rebuild the plugins and the instances of
+	/// the objects that were added, removed or changed; the plugins of the other objects are not touched.
+	/// @retval true if the file changed and was read again and false otherwise.
+	int updateChangedGeometry(void);
+
+	/// Read the material definitions file and the material assignments file, and remember their stamps.
+	void readMaterialInputs(VR::VRayRenderer *vray, VR::VRayScene &vrayScene);
+
+	/// Return true if the material definitions file or the material assignments file changed since they were read.
+	int materialInputsChanged(void) const;
+
+	/// If the material definitions or the material assignments changed, read them again and update the materials of
+	/// the loaded objects through VRayStaticGeometry::updateMaterial(). Objects whose displacement/subdivision settings
+	/// changed get new plugins and instances; the rest of the geometry is not touched. Changes to the visibility rules
+	/// take effect when the geometry is loaded next.
+	/// @retval true if the inputs were read again and false if they did not change.
+	int updateMaterialBindings(void);
+
+	/// Return the material plugin to use for the given object. If the face sets of the object have different
+	/// materials, this is a MtlMulti plugin with the material of each face set.
+	VR::VRayPlugin* getMaterialPluginForInstance(const AlembicMeshInstance &abcMeshInstance);
+
+	/// Return a MtlMulti plugin with the material of each face set of the given object, as resolved by the material
+	/// assignment rules for the face set names, or the object material if all face sets have the same material.
+	/// @param meshSource The object; it must have more than one face set.
+	/// @param objectMtl The material of the object, used for the face sets without a rule of their own.
+	VR::VRayPlugin* getFaceSetMaterial(const AlembicMeshSource &meshSource, VR::VRayPlugin *objectMtl);
+
+	/// Forget the MtlMulti plugins created for face sets, including the replaced ones. The plugins themselves are
+	/// deleted with all other plugins in postRenderEnd().
+	void freeFaceSetMaterials(void);
+
+	/// Move the MtlMulti plugins created for face sets to replacedFaceSetMaterials when the materials are read
+	/// again, so that new ones are created for the new materials.
+	void replaceFaceSetMaterials(void);
+
+	/// Delete the replaced MtlMulti plugins, once no object uses them any more.
+	void deleteReplacedFaceSetMaterials(void);
 
 	/// Return the displacement and subdivision parameters for the given Alembic object file name.
 	void getDisplacementSubdivParams(const VR::CharString &abcName, DisplacementSubdivParams &params);
+
+	/// Return the level of detail parameters for the given Alembic object name.
+	/// @retval true if there is a LOD rule for the object and false otherwise.
+	int getLodParams(const VR::CharString &abcName, LodParams &params);
+
+	/// The visibility of each voxel as determined by the visibility rules: -1 if not known yet, 0 if the voxel
+	/// is excluded and 1 if it should be loaded. Since the Alembic name of an object is only known after its voxel
+	/// is read for the first time, this allows us to skip excluded voxels without reading them on subsequent frames.
+	/// Only the main thread uses it; the prefetch thread works on a copy.
+	VR::Table<int, -1> voxelVisibility;
+
+	/// The file that voxelVisibility was computed for.
+	VR::CharString voxelVisibilityFile;
+
+	/// Reset the cached voxel visibility, f.e. when the visibility rules change.
+	void resetVoxelVisibility(void);
 };
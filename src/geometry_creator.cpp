@@ -1,4 +1,10 @@
 #include "geomalembicreader.h"
+#include "mesh_lod.h"
+#include "mesh_rigid.h"
+#include "hash_utils.h"
+#include "shared_geometry.h"
+
+#include <unordered_map>
 
 using namespace VR;
 
@@ -28,83 +34,259 @@ struct MeshVoxelGuardRAII {
 };
 
 AlembicMeshSource* GeomAlembicReader::createGeomStaticMesh(
-	VRayRenderer *vray,
+	const AlembicReadParams &readParams,
 	MeshFile &abcFile,
 	int voxelIndex,
 	int createInstance,
-	DefaultMeshSetsData &meshSets,
-	int nsamples,
-	double frameStart,
-	double frameEnd,
-	double frameTime
+	GeomCacheWriter *cacheWriter,
+	SharedGeometry *shared
 ) {
-	MeshVoxel *voxel=abcFile.getVoxel(voxelIndex, nsamples<<16, NULL, NULL);
-	if (!voxel)
-		return NULL;
+	AlembicMeshInstance *abcMeshInstance=new AlembicMeshInstance;
 
-	MeshVoxelGuardRAII voxelRAII(abcFile, voxel);
+	AlembicMeshSource *abcMeshSource=readMeshSource(readParams, abcFile, voxelIndex, *abcMeshInstance);
+
+	// Write the geometry to the disk cache before any view-dependent processing.
+	if (abcMeshSource && cacheWriter) {
+		cacheWriter->addObject(*abcMeshSource, *abcMeshInstance, readParams.sampleTimes);
+	}
+
+	// Give the decoded geometry to the other readers of the file and continue with a copy that references it.
+	if (abcMeshSource && shared) {
+		AlembicMeshInstance *readerInstance=nullptr;
+		abcMeshSource=shared->add(abcMeshSource, abcMeshInstance, readerInstance);
+		abcMeshInstance=readerInstance;
+	}
+
+	if (abcMeshSource) {
+		if (readParams.computeGeometryHash)
+			computeGeometryHashes(*abcMeshSource, *abcMeshInstance);
+		applyLod(*abcMeshSource, *abcMeshInstance, readParams);
+	}
+
+	if (!abcMeshSource) {
+		delete abcMeshInstance;
+		return nullptr;
+	}
+
+	if (createInstance) {
+		abcMeshInstance->meshIndex=meshInstances.count();
+		abcMeshInstance->meshSource=abcMeshSource;
+
+		meshInstances+=abcMeshInstance;
+	} else {
+		delete abcMeshInstance;
+	}
+
+	return abcMeshSource;
+}
 
-	// First figure out the name of the Alembic object from the face IDs in the voxel.
-	// For Alembic files, all faces have the same face ID and we can use it to read the
-	// name of the shader set, which is the name of the Alembic object.
-	int mtlID=0;
+// Return true if the last keyframe of the given parameter is at the given time.
+template<class T>
+static int hasKeyframeAt(AnimatedParam<T> &param, double time) {
+	int numKeyframes=param.getNumKeyframes();
+	return numKeyframes>0 && param.getKeyframeTime(numKeyframes-1)==time;
+}
+
+// Return the data of the last keyframe of the given parameter.
+template<class T>
+static T& getLastKeyframeData(AnimatedParam<T> &param) {
+	return param.getKeyframeData(param.getNumKeyframes()-1);
+}
+
+// Fill in the data of a boundary sample from the last keyframes of the given mesh source. The channels
+// that the sample has must be set already.
+static void storeBoundarySample(AlembicMeshSource &abcMeshSource, AlembicBoundarySample &sample) {
+	sample.vertices=getLastKeyframeData(abcMeshSource.verticesParam);
+	sample.faces=getLastKeyframeData(abcMeshSource.facesParam);
+	if (sample.hasNormals) {
+		sample.normals=getLastKeyframeData(abcMeshSource.normalsParam);
+		if (abcMeshSource.faceNormalsParam.getNumKeyframes()>0)
+			sample.faceNormals=getLastKeyframeData(abcMeshSource.faceNormalsParam);
+	}
+	// Zero velocities are removed when collapsing; the sample then keeps an empty list.
+	if (sample.hasVelocities && abcMeshSource.velocitiesParam.getNumKeyframes()>0) {
+		sample.velocities=getLastKeyframeData(abcMeshSource.velocitiesParam);
+	}
+	if (sample.hasMapChannels) {
+		copyKeyframeData(sample.mapChannels, getLastKeyframeData(abcMeshSource.mapChannelsParam));
+		copyKeyframeData(sample.mapChannelNames, getLastKeyframeData(abcMeshSource.mapChannelNamesParam));
+	}
+	if (abcMeshSource.faceMtlIDsParam.getNumKeyframes()>0) {
+		sample.faceMtlIDs=getLastKeyframeData(abcMeshSource.faceMtlIDsParam);
+		sample.faceSetNames.copy(abcMeshSource.faceSetNames);
+	}
+}
+
+// Add the data of a boundary sample from the previous frame to the given mesh source as a keyframe at the given time.
+static void addBoundarySample(AlembicMeshSource &abcMeshSource, const AlembicBoundarySample &sample, double time) {
+	abcMeshSource.verticesParam.addKeyframe(time, sample.vertices);
+	abcMeshSource.facesParam.addKeyframe(time, sample.faces);
+	if (sample.hasNormals) {
+		abcMeshSource.normalsParam.addKeyframe(time, sample.normals);
+		if (sample.faceNormals.count()>0)
+			abcMeshSource.faceNormalsParam.addKeyframe(time, sample.faceNormals);
+	}
+	if (sample.hasVelocities) {
+		if (sample.velocities.count()==sample.vertices.count()) {
+			abcMeshSource.velocitiesParam.addKeyframe(time, sample.velocities);
+		} else {
+			VectorList zeroVelocities(sample.vertices.count());
+			for (int i=0; i<zeroVelocities.count(); i++)
+				zeroVelocities[i].makeZero();
+			abcMeshSource.velocitiesParam.addKeyframe(time, zeroVelocities);
+		}
+	}
+	if (sample.hasMapChannels) {
+		copyKeyframeData(abcMeshSource.mapChannelsParam.addKeyframe(time), sample.mapChannels);
+		copyKeyframeData(abcMeshSource.mapChannelNamesParam.addKeyframe(time), sample.mapChannelNames);
+	}
+	if (sample.faceMtlIDs.count()>0) {
+		abcMeshSource.faceMtlIDsParam.addKeyframe(time, sample.faceMtlIDs);
+		abcMeshSource.faceSetNames.copy(sample.faceSetNames);
+	}
+}
+
+// Return the index of the given name in the list, or -1 if it is not there. Empty names, whose ptr() is NULL,
+// match each other.
+static int findName(const StringList &names, const CharString &name) {
+	const tchar *str=name.empty()? "" : name.ptr();
+	for (int i=0; i<names.count(); i++) {
+		const tchar *listStr=names[i].empty()? "" : names[i].ptr();
+		if (0==strcmp(listStr, str))
+			return i;
+	}
+	return -1;
+}
+
+// Read the face set of each face from the face info channel of the voxel into a new keyframe of faceMtlIDsParam,
+// as an index into the face set names of the mesh source; new names are added as they are found. The face sets
+// are the shader sets of the voxel, and are matched by name since the shader set IDs may differ between samples.
+static void readFaceSets(MeshFile &abcFile, MeshVoxel *voxel, VRayRenderer *vray, AlembicMeshSource &abcMeshSource, double time) {
 	const MeshChannel *faceInfoChannel=voxel->getChannel(FACE_INFO_CHANNEL);
-	if (faceInfoChannel) {
-		const FaceInfoData *faceInfo=static_cast<FaceInfoData*>(faceInfoChannel->data);
-		if (faceInfo)
-			mtlID=faceInfo[0].mtlID;
+	if (!faceInfoChannel || !faceInfoChannel->data)
+		return;
+
+	const FaceInfoData *faceInfo=static_cast<FaceInfoData*>(faceInfoChannel->data);
+	int numFaces=faceInfoChannel->numElements;
+
+	Table<int, -1> setIDs, setIndices;
+	int lastID=-1, lastIndex=-1;
+	IntList faceMtlIDs(numFaces);
+	for (int i=0; i<numFaces; i++) {
+		int mtlID=faceInfo[i].mtlID;
+		if (mtlID!=lastID || lastIndex<0) {
+			int k=0;
+			while (k<setIDs.count() && setIDs[k]!=mtlID)
+				k++;
+
+			if (k==setIDs.count()) {
+				StringID strID=abcFile.getShaderSetStringID(voxel, mtlID);
+				if (strID.id!=0) {
+					strID=vray->getStringManager()->getStringID(strID.id);
+				}
+
+				CharString name(strID.str);
+				int index=findName(abcMeshSource.faceSetNames, name);
+				if (index<0) {
+					index=abcMeshSource.faceSetNames.count();
+					*abcMeshSource.faceSetNames.newElement()=name;
+				}
+
+				setIDs+=mtlID;
+				setIndices+=index;
+			}
+
+			lastID=mtlID;
+			lastIndex=setIndices[k];
+		}
+		faceMtlIDs[i]=lastIndex;
 	}
 
-	// The Alembic name is stored as the shader set name.
-	tchar meshPluginName[512]="";
-	StringID strID=abcFile.getShaderSetStringID(voxel, mtlID);
-	if (strID.id!=0) {
-		strID=vray->getStringManager()->getStringID(strID.id);
-		vutils_sprintf_n(meshPluginName, COUNT_OF(meshPluginName), "voxel_%s", strID.str.ptr());
+	abcMeshSource.faceMtlIDsParam.addKeyframe(time, faceMtlIDs);
+}
+
+AlembicMeshSource* GeomAlembicReader::readMeshSource(
+	const AlembicReadParams &readParams,
+	MeshFile &abcFile,
+	int voxelIndex,
+	AlembicMeshInstance &abcMeshInstance
+) {
+	int nsamples=readParams.nsamples;
+
+	// The first sample may have been read already as the last sample of the previous frame.
+	const AlembicBoundarySample *firstSample=nullptr;
+	if (readParams.boundarySamples) {
+		firstSample=readParams.boundarySamples->find(voxelIndex, readParams.sampleTimes[0]);
+	}
+
+	MeshVoxel *voxel=nullptr;
+	if (!firstSample) {
+		voxel=abcFile.getVoxel(voxelIndex, nsamples<<16, NULL, NULL);
+		if (!voxel)
+			return NULL;
+	}
+
+	MeshVoxelGuardRAII voxelRAII(abcFile, voxel);
+
+	CharString abcName;
+	if (firstSample) {
+		abcName=firstSample->abcName;
 	} else {
-		vutils_sprintf_n(meshPluginName, COUNT_OF(meshPluginName), "voxel_%i", meshSources.count());
+		// First figure out the name of the Alembic object from the shader sets of the faces; the face sets
+		// of the object are only used for the face set materials below.
+		abcName=AbcArchiveIndex::getObjectName(abcFile, *voxel, readParams.vray);
+
+		// Record the metadata for this voxel.
+		if (readParams.archiveIndex)
+			readParams.archiveIndex->updateFromVoxel(voxelIndex, *voxel, abcName, readParams.frame);
 	}
 
-	VRayPlugin *meshPlugin=newPlugin("GeomStaticMesh", meshPluginName);
-	if (!meshPlugin)
+	// Check if the object should be loaded at all and remember the result so that
+	// we don't need to read the voxel again on subsequent frames.
+	int visible=mtlAssignments.isObjectVisible(abcName);
+	if (readParams.voxelVisibility && voxelIndex<readParams.voxelVisibility->count())
+		(*readParams.voxelVisibility)[voxelIndex]=visible;
+	if (!visible)
 		return nullptr;
 
-	TransformsList vertexTransforms;
+	TransformsList &vertexTransforms=abcMeshInstance.tms;
 	vertexTransforms.setCount(nsamples);
 
-	TimesList times;
+	TimesList &times=abcMeshInstance.times;
 	times.setCount(nsamples);
 
-	AlembicMeshSource *abcMeshSource=new AlembicMeshSource;
-	abcMeshSource->geomStaticMesh=meshPlugin;
-
-	// true if we want to read velocity information and false to just sample positions.
-	// Note that the Alembic reader inside the MeshFile implementation may still internally use
-	// velocity information from the Alembic file to interpolate positions.
-	int useVelocity=true;
-
-	meshPlugin->setParameter(&abcMeshSource->dynamicGeometryParam);
-	meshPlugin->setParameter(&abcMeshSource->verticesParam);
-	meshPlugin->setParameter(&abcMeshSource->facesParam);
-	meshPlugin->setParameter(&abcMeshSource->mapChannelsParam);
-	meshPlugin->setParameter(&abcMeshSource->normalsParam);
-	meshPlugin->setParameter(&abcMeshSource->faceNormalsParam);
-	meshPlugin->setParameter(&abcMeshSource->mapChannelNamesParam);
-	if (useVelocity) {
-		meshPlugin->setParameter(&abcMeshSource->velocitiesParam);
-	}
+	abcMeshInstance.abcName=abcName;
 
+	AlembicMeshSource *abcMeshSource=new AlembicMeshSource;
+	abcMeshSource->voxelIndex=voxelIndex;
+	abcMeshSource->abcName=abcName;
 	abcMeshSource->setNumTimeSteps(nsamples);
 
+	// Objects with a <channels> rule read only the selected optional channels.
+	const ChannelsAssignmentRule *channelsRule=mtlAssignments.getChannelsRule(abcName);
+	int readNormals=!channelsRule || channelsRule->normals;
+	int readVelocities=readParams.readVelocities && (!channelsRule || channelsRule->velocities);
+
 	for (int i=0; i<nsamples; i++) {
-		double time=(nsamples>1)? (frameStart+(frameEnd-frameStart)*i/double(nsamples-1)) : frameTime;
+		double time=readParams.sampleTimes[i];
 		vertexTransforms[i].makeIdentity();
 		times[i]=time;
 
+		if (i==0 && firstSample) {
+			vertexTransforms[i]=firstSample->tm;
+			addBoundarySample(*abcMeshSource, *firstSample, time);
+			continue;
+		}
+
 		if (i>0) {
 			int timeFlags=i|(nsamples<<16);
 			voxel=abcFile.getVoxel(voxelIndex, timeFlags, NULL, NULL);
 			voxelRAII.reassign(voxel);
+
+			// The metadata was not updated from the first sample.
+			if (voxel && i==1 && firstSample && readParams.archiveIndex) {
+				readParams.archiveIndex->updateFromVoxel(voxelIndex, *voxel, abcName.ptr(), readParams.frame);
+			}
 		}
 
 		if (!voxel)
@@ -138,8 +320,11 @@ AlembicMeshSource* GeomAlembicReader::createGeomStaticMesh(
 		}
 		abcMeshSource->facesParam.addKeyframe(time, paramFaces);
 
+		// Read the face sets; they become the material IDs of the faces.
+		readFaceSets(abcFile, voxel, readParams.vray, *abcMeshSource, time);
+
 		// Read the normals and set them into the normalsParam and faceNormalsParam
-		const MeshChannel *normalsChannel=voxel->getChannel(VERT_NORMAL_CHANNEL);
+		const MeshChannel *normalsChannel=readNormals? voxel->getChannel(VERT_NORMAL_CHANNEL) : nullptr;
 		if (normalsChannel) {
 			const VertGeomData *normals=static_cast<VertGeomData*>(normalsChannel->data);
 			int numNormals=normalsChannel->numElements;
@@ -150,7 +335,7 @@ AlembicMeshSource* GeomAlembicReader::createGeomStaticMesh(
 			abcMeshSource->normalsParam.addKeyframe(time, paramNormals);
 		}
 
-		const MeshChannel *faceNormalsChannel=voxel->getChannel(VERT_NORMAL_TOPO_CHANNEL);
+		const MeshChannel *faceNormalsChannel=readNormals? voxel->getChannel(VERT_NORMAL_TOPO_CHANNEL) : nullptr;
 		if (faceNormalsChannel) {
 			const FaceTopoData *faceNormals=static_cast<FaceTopoData*>(faceNormalsChannel->data);
 			int numFaceNormals=faceNormalsChannel->numElements;
@@ -166,49 +351,63 @@ AlembicMeshSource* GeomAlembicReader::createGeomStaticMesh(
 			abcMeshSource->faceNormalsParam.addKeyframe(time, paramFaceNormals);
 		}
 
-		// Read the UV/color sets
-		int numMapChannels=0;
-		for (int i=0; i<voxel->numChannels; i++) {
-			const MeshChannel &chan=voxel->channels[i];
-			if (isValidMappingChannel(chan))
-				numMapChannels++;
+		// Read the UV/color sets that are selected for the object. The set names are in the order of the
+		// channels in the voxel, UV sets first.
+		DefaultMeshSetsData &meshSets=*readParams.meshSets;
+		int numUVSets=meshSets.getNumSets(MeshSetsData::meshSetType_uvSet);
+
+		Table<int, -1> mapChannelIndices;
+		Table<const tchar*, -1> mapChannelSetNames;
+		int setIdx=0;
+		for (int chanIdx=0; chanIdx<voxel->numChannels; chanIdx++) {
+			const MeshChannel &chan=voxel->channels[chanIdx];
+			if (!isValidMappingChannel(chan))
+				continue;
+
+			const tchar *setName=NULL;
+			if (setIdx<numUVSets) setName=meshSets.getSetName(MeshSetsData::meshSetType_uvSet, setIdx);
+			else setName=meshSets.getSetName(MeshSetsData::meshSetType_colorSet, setIdx-numUVSets);
+			if (NULL==setName) setName="";
+			setIdx++;
+
+			if (channelsRule && !channelsRule->readMapChannel(chan.channelID-VERT_TEX_CHANNEL0, setName))
+				continue;
+
+			*mapChannelIndices.newElement()=chanIdx;
+			*mapChannelSetNames.newElement()=setName;
 		}
 
+		int numMapChannels=mapChannelIndices.count();
 		if (numMapChannels>0) {
 			AbcMapChannelsList &mapChannelsList=abcMeshSource->mapChannelsParam.addKeyframe(time);
 			mapChannelsList.setCount(numMapChannels);
 
-			int idx=0;
-			for (int chanIdx=0; chanIdx<voxel->numChannels; chanIdx++) {
-				const MeshChannel &chan=voxel->channels[chanIdx];
-				if (isValidMappingChannel(chan)) {
-					AbcMapChannel &mapChannel=mapChannelsList[idx];
+			for (int idx=0; idx<numMapChannels; idx++) {
+				const MeshChannel &chan=voxel->channels[mapChannelIndices[idx]];
+				AbcMapChannel &mapChannel=mapChannelsList[idx];
 
-					mapChannel.idx=chan.channelID-VERT_TEX_CHANNEL0;
+				mapChannel.idx=chan.channelID-VERT_TEX_CHANNEL0;
 
-					mapChannel.verts.setCount(chan.numElements);
-					const VertGeomData *uvw=static_cast<const VertGeomData*>(chan.data);
-					int numUVWs=chan.numElements;
-					for (int j=0; j<numUVWs; j++) {
-						mapChannel.verts[j]=uvw[j];
-					}
+				mapChannel.verts=VectorList(chan.numElements);
+				const VertGeomData *uvw=static_cast<const VertGeomData*>(chan.data);
+				int numUVWs=chan.numElements;
+				for (int j=0; j<numUVWs; j++) {
+					mapChannel.verts[j]=uvw[j];
+				}
 
-					const MeshChannel *topoChan=voxel->getChannel(chan.depChannelID);
-					if (topoChan) {
-						const FaceTopoData *uvwFaces=static_cast<FaceTopoData*>(topoChan->data);
-						int numUVWFaces=topoChan->numElements;
-
-						mapChannel.faces.setCount(numUVWFaces*3);
-						for (int j=0; j<numUVWFaces; j++) {
-							const FaceTopoData &face=uvwFaces[j];
-							int idx=j*3;
-							mapChannel.faces[idx+0]=face.v[0];
-							mapChannel.faces[idx+1]=face.v[1];
-							mapChannel.faces[idx+2]=face.v[2];
-						}
+				const MeshChannel *topoChan=voxel->getChannel(chan.depChannelID);
+				if (topoChan) {
+					const FaceTopoData *uvwFaces=static_cast<FaceTopoData*>(topoChan->data);
+					int numUVWFaces=topoChan->numElements;
+
+					mapChannel.faces=IntList(numUVWFaces*3);
+					for (int j=0; j<numUVWFaces; j++) {
+						const FaceTopoData &face=uvwFaces[j];
+						int faceIdx=j*3;
+						mapChannel.faces[faceIdx+0]=face.v[0];
+						mapChannel.faces[faceIdx+1]=face.v[1];
+						mapChannel.faces[faceIdx+2]=face.v[2];
 					}
-
-					idx++;
 				}
 			}
 
@@ -216,19 +415,13 @@ AlembicMeshSource* GeomAlembicReader::createGeomStaticMesh(
 			StringList &mapChannelNames=abcMeshSource->mapChannelNamesParam.addKeyframe(time);
 
 			mapChannelNames.setCount(numMapChannels);
-			int numUVSets=meshSets.getNumSets(MeshSetsData::meshSetType_uvSet);
-			for (int i=0; i<mapChannelsList.count(); i++) {
-				const tchar *setName=NULL;
-				if (i<numUVSets) setName=meshSets.getSetName(MeshSetsData::meshSetType_uvSet, i);
-				else setName=meshSets.getSetName(MeshSetsData::meshSetType_colorSet, i-numUVSets);
-
-				if (NULL==setName) setName="";
-				mapChannelNames[i]=setName;
+			for (int i=0; i<numMapChannels; i++) {
+				mapChannelNames[i]=mapChannelSetNames[i];
 			}
 		}
 
 		// If motion blur is enabled, read the vertex velocities and set them into the velocitiesParam
-		if (useVelocity && vray->getSequenceData().params.moblur.on) {
+		if (readVelocities) {
 			const MeshChannel *velocitiesChannel=voxel->getChannel(VERT_VELOCITY_CHANNEL);
 			if (velocitiesChannel && velocitiesChannel->data && velocitiesChannel->numElements==numVerts) {
 				const VertGeomData *velocities=static_cast<VertGeomData*>(velocitiesChannel->data);
@@ -241,9 +434,105 @@ AlembicMeshSource* GeomAlembicReader::createGeomStaticMesh(
 		}
 	}
 
+	// Objects with a single face set get one material for the whole object.
+	if (abcMeshSource->faceSetNames.count()<=1) {
+		abcMeshSource->faceMtlIDsParam.clearKeyframes();
+		abcMeshSource->faceSetNames.clear();
+	}
+
+	// Find out which channels the last sample has, before the constant channels are collapsed.
+	double lastTime=readParams.sampleTimes[nsamples-1];
+	AlembicBoundarySample *lastSample=nullptr;
+	if (readParams.boundarySamples && nsamples>1 && hasKeyframeAt(abcMeshSource->verticesParam, lastTime)) {
+		lastSample=new AlembicBoundarySample;
+		lastSample->time=lastTime;
+		lastSample->abcName=abcName;
+		lastSample->tm=vertexTransforms[nsamples-1];
+		lastSample->hasNormals=hasKeyframeAt(abcMeshSource->normalsParam, lastTime);
+		lastSample->hasVelocities=hasKeyframeAt(abcMeshSource->velocitiesParam, lastTime);
+		lastSample->hasMapChannels=hasKeyframeAt(abcMeshSource->mapChannelsParam, lastTime);
+	}
+
+	// Objects that don't deform or move over the motion blur interval need only one sample,
+	// which also lets V-Ray use the static acceleration structures for them.
+	abcMeshSource->collapseConstantKeyframes();
+
+	// Keep the last sample for the next frame. After collapsing, the last keyframe of each channel has the data
+	// of the last sample, so the lists are shared with the mesh source instead of copied.
+	if (lastSample) {
+		storeBoundarySample(*abcMeshSource, *lastSample);
+		readParams.boundarySamples->store(voxelIndex, lastSample);
+	}
+
+	// Meshes that only move rigidly need just one vertex sample; the motion goes into the transformations.
+	if (readParams.detectRigidMotion) {
+		convertRigidMotion(*abcMeshSource, abcMeshInstance, readParams.rigidMotionTolerance);
+	}
+
+	abcMeshInstance.collapseConstantTransforms();
+
+	return abcMeshSource;
+}
+
+void GeomAlembicReader::applyLod(AlembicMeshSource &abcMeshSource, const AlembicMeshInstance &abcMeshInstance, const AlembicReadParams &readParams) {
+	// Decimate the object if it is small enough on screen and there is a LOD rule for it.
+	// Note that we don't know the Node transformation at this point, so the projected size
+	// is estimated with the object transformation from the Alembic file only.
+	LodParams lodParams;
+	if (abcMeshInstance.tms.count()>0 && getLodParams(abcMeshInstance.abcName, lodParams) && lodParams.cellPixels>0.0f) {
+		Box bbox=getMeshSourceBBox(abcMeshSource, abcMeshInstance.tms[0]);
+		float projectedSize=estimateProjectedSize(bbox, readParams.lodCamera);
+		if (projectedSize<lodParams.maxPixels) {
+			int gridRes=Max(1, int(ceilf(projectedSize/lodParams.cellPixels)));
+			decimateMeshSource(abcMeshSource, gridRes);
+		}
+	}
+}
+
+int GeomAlembicReader::createMeshPlugins(AlembicMeshSource &abcMeshSource, int sourceIndex) {
+	const CharString &abcName=abcMeshSource.abcName;
+
+	tchar meshPluginName[512]="";
+	if (!abcName.empty()) {
+		vutils_sprintf_n(meshPluginName, COUNT_OF(meshPluginName), "voxel_%s", abcName.ptr());
+	} else {
+		vutils_sprintf_n(meshPluginName, COUNT_OF(meshPluginName), "voxel_%i", sourceIndex);
+	}
+	if (abcMeshSource.chunkIndex>=0) {
+		tchar chunkSuffix[32]="";
+		vutils_sprintf_n(chunkSuffix, COUNT_OF(chunkSuffix), "@chunk%i", abcMeshSource.chunkIndex);
+		vutils_strcat_n(meshPluginName, chunkSuffix, COUNT_OF(meshPluginName));
+	}
+
+	VRayPlugin *meshPlugin=newPlugin("GeomStaticMesh", meshPluginName);
+	if (!meshPlugin)
+		return false;
+
+	abcMeshSource.geomStaticMesh=meshPlugin;
+
+	// true if we want to read velocity information and false to just sample positions.
+	// Note that the Alembic reader inside the MeshFile implementation may still internally use
+	// velocity information from the Alembic file to interpolate positions.
+	int useVelocity=true;
+
+	meshPlugin->setParameter(sharedPluginParams.getDynamicGeometry(abcMeshSource.dynamicGeometry));
+	meshPlugin->setParameter(&abcMeshSource.verticesParam);
+	meshPlugin->setParameter(&abcMeshSource.facesParam);
+	meshPlugin->setParameter(&abcMeshSource.mapChannelsParam);
+	meshPlugin->setParameter(&abcMeshSource.normalsParam);
+	meshPlugin->setParameter(&abcMeshSource.faceNormalsParam);
+	meshPlugin->setParameter(&abcMeshSource.mapChannelNamesParam);
+	if (useVelocity) {
+		meshPlugin->setParameter(&abcMeshSource.velocitiesParam);
+	}
+	if (abcMeshSource.faceMtlIDsParam.getNumKeyframes()>0) {
+		meshPlugin->setParameter(&abcMeshSource.faceMtlIDsParam);
+	}
+
 	// Check if the object should have displacement/subdivision
 	DisplacementSubdivParams displSubdivParams;
-	getDisplacementSubdivParams(strID.str, displSubdivParams);
+	getDisplacementSubdivParams(abcName, displSubdivParams);
+	abcMeshSource.displSubdivParams=displSubdivParams;
 
 	VRayPlugin *displSubdivPlugin=nullptr;
 
@@ -253,51 +542,232 @@ AlembicMeshSource* GeomAlembicReader::createGeomStaticMesh(
 		vutils_strcat_n(meshPluginName, "@subdiv", COUNT_OF(meshPluginName));
 		displSubdivPlugin=newPlugin("GeomStaticSmoothedMesh", meshPluginName);
 		if (displSubdivPlugin) {
-			displSubdivPlugin->setParameter(&abcMeshSource->preTesselateSubdivParam);
+			displSubdivPlugin->setParameter(sharedPluginParams.getStaticSubdiv(displSubdivParams.staticTessellation));
 		}
 	} else if (displSubdivParams.displacementTex) {
 		// Only displacement
 		vutils_strcat_n(meshPluginName, "@displ", COUNT_OF(meshPluginName));
 		displSubdivPlugin=newPlugin("GeomDisplacedMesh", meshPluginName);
 		if (displSubdivPlugin) {
-			displSubdivPlugin->setParameter(&abcMeshSource->preTesselateDisplParam);
+			displSubdivPlugin->setParameter(sharedPluginParams.getStaticDisplacement(displSubdivParams.staticTessellation));
 		}
 	}
 
 	// Set the general displacement/subdivision parameters as needed.
 	if (displSubdivPlugin) {
+		if (!abcMeshSource.displSubdivPluginParams)
+			abcMeshSource.displSubdivPluginParams=new DisplSubdivPluginParams;
+		DisplSubdivPluginParams &pluginParams=*abcMeshSource.displSubdivPluginParams;
+
 		// Set the source mesh plugin.
-		abcMeshSource->displSubdivSourceMeshParam.setUserObject(meshPlugin, 0 /* index */, 0.0f /* time */);
-		displSubdivPlugin->setParameter(&abcMeshSource->displSubdivSourceMeshParam);
+		pluginParams.sourceMeshParam.setUserObject(meshPlugin, 0 /* index */, 0.0f /* time */);
+		displSubdivPlugin->setParameter(&pluginParams.sourceMeshParam);
 
 		// Set other parameters.
-		displSubdivPlugin->setParameter(&abcMeshSource->displSubdivEdgeLengthParam);
-		displSubdivPlugin->setParameter(&abcMeshSource->useGlobalsParam);
-		displSubdivPlugin->setParameter(&abcMeshSource->maxSubdivLevelsParam);
+		displSubdivPlugin->setParameter(sharedPluginParams.getEdgeLength(displSubdivParams.edgeLength*abcMeshSource.tessellationScale));
+		displSubdivPlugin->setParameter(sharedPluginParams.getUseGlobals());
+		displSubdivPlugin->setParameter(sharedPluginParams.getMaxSubdivs(displSubdivParams.maxSubdivs));
 
 		// Set the displacement texture, if any.
 		if (displSubdivParams.displacementTex) {
-			abcMeshSource->displTextureParam.setUserObject(displSubdivParams.displacementTex, 0 /* index */, 0.0f /* time */);
-			displSubdivPlugin->setParameter(&abcMeshSource->displTextureParam);
+			pluginParams.displTextureParam.setUserObject(displSubdivParams.displacementTex, 0 /* index */, 0.0f /* time */);
+			displSubdivPlugin->setParameter(&pluginParams.displTextureParam);
 
-			abcMeshSource->displAmountParam.setFloat(displSubdivParams.displacementAmount, 0 /* index */, 0.0f /* time */);
-			displSubdivPlugin->setParameter(&abcMeshSource->displAmountParam);
+			pluginParams.displAmountParam.setFloat(displSubdivParams.displacementAmount, 0 /* index */, 0.0f /* time */);
+			displSubdivPlugin->setParameter(&pluginParams.displAmountParam);
 		}
 	}
 
-	abcMeshSource->displSubdivPlugin=displSubdivPlugin;
+	abcMeshSource.displSubdivPlugin=displSubdivPlugin;
 
-	if (createInstance) {
-		AlembicMeshInstance *abcMeshInstance=new AlembicMeshInstance;
+	return true;
+}
 
-		abcMeshInstance->meshIndex=meshInstances.count();
-		abcMeshInstance->meshSource=abcMeshSource;
-		abcMeshInstance->tms.copy(vertexTransforms);
-		abcMeshInstance->times.copy(times);
-		abcMeshInstance->abcName=strID.str;
+void GeomAlembicReader::createAllMeshPlugins(void) {
+	reuseRetainedMeshSources();
 
-		meshInstances+=abcMeshInstance;
+	int numMeshSources=meshSources.count();
+	int numValid=0;
+	for (int i=0; i<numMeshSources; i++) {
+		AlembicMeshSource *abcMeshSource=meshSources[i];
+		if (abcMeshSource->geomStaticMesh || createMeshPlugins(*abcMeshSource, i)) {
+			meshSources[numValid++]=abcMeshSource;
+			continue;
+		}
+
+		// The plugins could not be created; remove the instances of this mesh too.
+		int numValidInstances=0;
+		for (int j=0; j<meshInstances.count(); j++) {
+			AlembicMeshInstance *abcMeshInstance=meshInstances[j];
+			if (abcMeshInstance->meshSource==abcMeshSource) {
+				delete abcMeshInstance;
+			} else {
+				meshInstances[numValidInstances++]=abcMeshInstance;
+			}
+		}
+		meshInstances.setCount(numValidInstances);
+
+		delete abcMeshSource;
 	}
+	meshSources.setCount(numValid);
 
-	return abcMeshSource;
+	for (int i=0; i<meshInstances.count(); i++)
+		meshInstances[i]->meshIndex=i;
+}
+
+void GeomAlembicReader::deleteMeshPlugins(AlembicMeshSource &abcMeshSource) {
+	if (abcMeshSource.displSubdivPlugin) {
+		deletePlugin(abcMeshSource.displSubdivPlugin);
+		abcMeshSource.displSubdivPlugin=nullptr;
+	}
+
+	if (abcMeshSource.geomStaticMesh) {
+		deletePlugin(abcMeshSource.geomStaticMesh);
+		abcMeshSource.geomStaticMesh=nullptr;
+	}
+}
+
+// Add the data of all keyframes of the given list parameter to a hash.
+template<class T>
+static uint64 hashKeyframes(AnimatedParam<T> &param, uint64 hash) {
+	int numKeyframes=param.getNumKeyframes();
+	hash=hashMemory(&numKeyframes, sizeof(numKeyframes), hash);
+	for (int i=0; i<numKeyframes; i++) {
+		const T &data=param.getKeyframeData(i);
+		int count=data.count();
+		hash=hashMemory(&count, sizeof(count), hash);
+		if (count>0)
+			hash=hashMemory(&data[0], count*sizeof(data[0]), hash);
+	}
+	return hash;
+}
+
+// Add the UV/color sets of all keyframes of the given parameter to a hash.
+static uint64 hashMapChannels(AnimatedMapChannelsParam &mapChannelsParam, uint64 hash) {
+	for (int i=0; i<mapChannelsParam.getNumKeyframes(); i++) {
+		const AbcMapChannelsList &mapChannels=mapChannelsParam.getKeyframeData(i);
+		for (int j=0; j<mapChannels.count(); j++) {
+			const AbcMapChannel &mapChannel=mapChannels[j];
+			hash=hashMemory(&mapChannel.idx, sizeof(mapChannel.idx), hash);
+			if (mapChannel.verts.count()>0)
+				hash=hashMemory(&mapChannel.verts[0], mapChannel.verts.count()*sizeof(Vector), hash);
+			if (mapChannel.faces.count()>0)
+				hash=hashMemory(&mapChannel.faces[0], mapChannel.faces.count()*sizeof(int), hash);
+		}
+	}
+	return hash;
+}
+
+// Compute a key that identifies the tessellation of the given mesh source, or 0 if the mesh is not static or
+// is not pre-tessellated.
+static uint64 getTessellationKey(AlembicMeshSource &abcMeshSource, const DisplacementSubdivParams &params) {
+	if (!params.hasDisplacementOrSubdivision() || !params.staticTessellation)
+		return 0;
+	// The keyframe times of a reused mesh are from the previous frame, so it must have only one sample.
+	if (abcMeshSource.verticesParam.getNumKeyframes()!=1 || abcMeshSource.facesParam.getNumKeyframes()!=1 ||
+		abcMeshSource.normalsParam.getNumKeyframes()>1 || abcMeshSource.mapChannelsParam.getNumKeyframes()>1 ||
+		abcMeshSource.velocitiesParam.getNumKeyframes()!=0)
+		return 0;
+
+	uint64 hash=hashSeed;
+	if (!abcMeshSource.abcName.empty())
+		hash=hashMemory(abcMeshSource.abcName.ptr(), abcMeshSource.abcName.length(), hash);
+	hash=hashMemory(&params.displacementTex, sizeof(params.displacementTex), hash);
+	hash=hashMemory(&params.displacementAmount, sizeof(params.displacementAmount), hash);
+	hash=hashMemory(&params.hasSubdivision, sizeof(params.hasSubdivision), hash);
+	hash=hashMemory(&params.edgeLength, sizeof(params.edgeLength), hash);
+	hash=hashMemory(&params.maxSubdivs, sizeof(params.maxSubdivs), hash);
+	hash=hashMemory(&abcMeshSource.tessellationScale, sizeof(abcMeshSource.tessellationScale), hash);
+	hash=hashMemory(&abcMeshSource.dynamicGeometry, sizeof(abcMeshSource.dynamicGeometry), hash);
+
+	hash=hashKeyframes(abcMeshSource.verticesParam, hash);
+	hash=hashKeyframes(abcMeshSource.facesParam, hash);
+	hash=hashKeyframes(abcMeshSource.normalsParam, hash);
+	hash=hashKeyframes(abcMeshSource.faceNormalsParam, hash);
+	hash=hashMapChannels(abcMeshSource.mapChannelsParam, hash);
+	hash=hashKeyframes(abcMeshSource.faceMtlIDsParam, hash);
+
+	// 0 means that the mesh can't be reused.
+	return hash? hash : 1;
+}
+
+void computeGeometryHashes(AlembicMeshSource &abcMeshSource, AlembicMeshInstance &abcMeshInstance) {
+	uint64 topologyHash=hashKeyframes(abcMeshSource.facesParam, hashSeed);
+
+	uint64 hash=topologyHash;
+	hash=hashKeyframes(abcMeshSource.verticesParam, hash);
+	hash=hashKeyframes(abcMeshSource.normalsParam, hash);
+	hash=hashKeyframes(abcMeshSource.faceNormalsParam, hash);
+	hash=hashKeyframes(abcMeshSource.velocitiesParam, hash);
+	hash=hashMapChannels(abcMeshSource.mapChannelsParam, hash);
+	hash=hashKeyframes(abcMeshSource.faceMtlIDsParam, hash);
+	for (int i=0; i<abcMeshSource.faceSetNames.count(); i++)
+		hash=hashMemory(abcMeshSource.faceSetNames[i].ptr(), abcMeshSource.faceSetNames[i].length(), hash);
+
+	// The times are not hashed, since prefetched geometry may still have sample indices instead of times.
+	int numTms=abcMeshInstance.tms.count();
+	hash=hashMemory(&numTms, sizeof(numTms), hash);
+	if (numTms>0)
+		hash=hashMemory(&abcMeshInstance.tms[0], numTms*sizeof(Transform), hash);
+
+	// 0 means that the hash is not computed.
+	abcMeshInstance.topologyHash=topologyHash? topologyHash : 1;
+	abcMeshInstance.geometryHash=hash? hash : 1;
+}
+
+void GeomAlembicReader::reuseRetainedMeshSources(void) {
+	// Compute the keys for the meshes of this frame, and find matching meshes from the previous frame.
+	std::unordered_map<AlembicMeshSource*, AlembicMeshSource*> replacements;
+	for (int i=0; i<meshSources.count(); i++) {
+		AlembicMeshSource *abcMeshSource=meshSources[i];
+		if (abcMeshSource->geomStaticMesh)
+			continue;
+
+		abcMeshSource->tessellationKey=0;
+		if (!reuseTessellation)
+			continue;
+
+		DisplacementSubdivParams displSubdivParams;
+		getDisplacementSubdivParams(abcMeshSource->abcName, displSubdivParams);
+		abcMeshSource->tessellationKey=getTessellationKey(*abcMeshSource, displSubdivParams);
+		if (abcMeshSource->tessellationKey==0)
+			continue;
+
+		for (int j=0; j<retainedMeshSources.count(); j++) {
+			AlembicMeshSource *retainedMeshSource=retainedMeshSources[j];
+			if (retainedMeshSource->tessellationKey!=abcMeshSource->tessellationKey)
+				continue;
+
+			replacements[abcMeshSource]=retainedMeshSource;
+			meshSources[i]=retainedMeshSource;
+			retainedMeshSources[j]=retainedMeshSources.last();
+			retainedMeshSources.setCount(retainedMeshSources.count()-1);
+			delete abcMeshSource;
+			break;
+		}
+	}
+
+	// Re-point the instances to the reused meshes.
+	if (!replacements.empty()) {
+		for (int i=0; i<meshInstances.count(); i++) {
+			AlembicMeshInstance *abcMeshInstance=meshInstances[i];
+			auto it=replacements.find(abcMeshInstance->meshSource);
+			if (it!=replacements.end())
+				abcMeshInstance->meshSource=it->second;
+		}
+	}
+
+	// The rest of the meshes from the previous frame are no longer needed; delete them before creating
+	// the new plugins, since these may have the same names.
+	freeRetainedMeshSources();
+}
+
+void GeomAlembicReader::freeRetainedMeshSources(void) {
+	for (int i=0; i<retainedMeshSources.count(); i++) {
+		AlembicMeshSource *abcMeshSource=retainedMeshSources[i];
+		if (plugman)
+			deleteMeshPlugins(*abcMeshSource);
+		delete abcMeshSource;
+	}
+	retainedMeshSources.clear();
 }
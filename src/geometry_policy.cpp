@@ -0,0 +1,264 @@
+#include "geomalembicreader.h"
+#include "mesh_lod.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace VR;
+
+// Return the available physical memory in bytes, or 0 if it is not known.
+static uint64 getAvailablePhysicalMemory(void) {
+#ifdef _WIN32
+	MEMORYSTATUSEX memStatus;
+	memStatus.dwLength=sizeof(memStatus);
+	if (!GlobalMemoryStatusEx(&memStatus))
+		return 0;
+	return uint64(memStatus.ullAvailPhys);
+#else
+	long numPages=sysconf(_SC_AVPHYS_PAGES);
+	long pageSize=sysconf(_SC_PAGESIZE);
+	if (numPages<=0 || pageSize<=0)
+		return 0;
+	return uint64(numPages)*uint64(pageSize);
+#endif
+}
+
+/// Information about a mesh source for choosing between static and dynamic geometry.
+struct GeometryPolicyEntry {
+	AlembicMeshSource *meshSource; ///< The mesh source.
+	int numInstances; ///< The number of instances of the mesh.
+	size_t numTriangles; ///< The number of triangles in the mesh.
+};
+
+// Return the number of triangles in the first keyframe of the given mesh.
+static size_t getNumTriangles(const AlembicMeshSource &meshSource) {
+	if (meshSource.facesParam.getNumKeyframes()==0)
+		return 0;
+	return size_t(meshSource.facesParam.getKeyframeData(0).count()/3);
+}
+
+void GeomAlembicReader::applyGeometryPolicy(
+	const Table<AlembicMeshSource*, -1> &sources,
+	const Table<AlembicMeshInstance*, -1> &instances,
+	const LodCamera &camera,
+	ProgressCallback *prog
+) {
+	if (sources.count()==0)
+		return;
+
+	// Decide which meshes should use static geometry.
+	chooseDynamicGeometry(sources, instances, prog);
+
+	// Keep the tessellation of displaced and subdivided meshes within the triangle budget.
+	applyTessellationBudget(sources, instances, camera, prog);
+}
+
+void GeomAlembicReader::chooseDynamicGeometry(const Table<AlembicMeshSource*, -1> &sources, const Table<AlembicMeshInstance*, -1> &instances, ProgressCallback *prog) {
+	// Count the instances of each mesh; the given instances may not be in meshInstances yet.
+	std::unordered_map<AlembicMeshSource*, int> numInstances;
+	for (int i=0; i<meshInstances.count(); i++)
+		numInstances[meshInstances[i]->meshSource]++;
+	if (&instances!=&meshInstances) {
+		for (int i=0; i<instances.count(); i++)
+			numInstances[instances[i]->meshSource]++;
+	}
+
+	// The memory budget for static geometry; by default, a quarter of the available memory.
+	uint64 memBudget=uint64(double(staticGeometryMemLimit)*1024.0*1024.0);
+	if (memBudget==0)
+		memBudget=getAvailablePhysicalMemory()/4;
+
+	int numStatic=0, numDynamic=0, numForced=0;
+	uint64 staticMem=0;
+
+	// The static meshes that are already loaded use up part of the budget.
+	std::unordered_set<AlembicMeshSource*> chosenSources(&sources[0], &sources[0]+sources.count());
+	uint64 loadedStaticMem=0;
+	for (int i=0; i<meshSources.count(); i++) {
+		const AlembicMeshSource &meshSource=*meshSources[i];
+		if (chosenSources.count(meshSources[i])==0 && !meshSource.dynamicGeometry)
+			loadedStaticMem+=uint64(getNumTriangles(meshSource))*Max(numInstances[meshSources[i]], 1)*staticBytesPerTriangle;
+	}
+
+	// Apply the rules first and collect the rest of the meshes as candidates for static geometry.
+	std::vector<GeometryPolicyEntry> candidates;
+	for (int i=0; i<sources.count(); i++) {
+		AlembicMeshSource &meshSource=*sources[i];
+
+		GeometryPolicyEntry entry;
+		entry.meshSource=&meshSource;
+		entry.numInstances=numInstances[&meshSource];
+		entry.numTriangles=getNumTriangles(meshSource);
+
+		int dynamic=true;
+		if (mtlAssignments.getDynamicGeometry(meshSource.abcName, dynamic)) {
+			numForced++;
+			if (dynamic) {
+				numDynamic++;
+			} else {
+				numStatic++;
+				staticMem+=uint64(entry.numTriangles)*entry.numInstances*staticBytesPerTriangle;
+			}
+			meshSource.setDynamicGeometry(dynamic);
+			continue;
+		}
+
+		// Heavily instanced meshes are always dynamic, since static geometry is replicated for each instance.
+		if (entry.numInstances>staticGeometryMaxInstances) {
+			numDynamic++;
+			meshSource.setDynamicGeometry(true);
+			continue;
+		}
+
+		candidates.push_back(entry);
+	}
+
+	// Make the largest meshes static first, since they benefit most from the faster ray tracing,
+	// until the memory budget is exhausted.
+	std::sort(candidates.begin(), candidates.end(), [](const GeometryPolicyEntry &a, const GeometryPolicyEntry &b) {
+		return a.numTriangles>b.numTriangles;
+	});
+
+	for (const GeometryPolicyEntry &entry : candidates) {
+		uint64 mem=uint64(entry.numTriangles)*Max(entry.numInstances, 1)*staticBytesPerTriangle;
+		int dynamic=(memBudget>0 && loadedStaticMem+staticMem+mem>memBudget);
+		if (dynamic) {
+			numDynamic++;
+		} else {
+			numStatic++;
+			staticMem+=mem;
+		}
+		entry.meshSource->setDynamicGeometry(dynamic);
+
+		if (prog) {
+			const tchar *name=entry.meshSource->abcName.empty()? "" : entry.meshSource->abcName.ptr();
+			prog->debug("Using %s geometry for \"%s\" (%i instances, %i triangles)", dynamic? "dynamic" : "static", name, entry.numInstances, int(entry.numTriangles));
+		}
+	}
+
+	if (prog) {
+		prog->info("Geometry policy: %i static meshes (about %.1f MB), %i dynamic meshes, %i chosen by rules", numStatic, double(staticMem)/(1024.0*1024.0), numDynamic, numForced);
+	}
+}
+
+/// The estimated tessellation of a displaced or subdivided mesh over all of its instances.
+struct TessellationEstimate {
+	AlembicMeshSource *meshSource; ///< The mesh source.
+	double baseTriangles; ///< The number of triangles before tessellation.
+	double maxTriangles; ///< The number of triangles if all edges are subdivided max_subdivs times.
+	double viewTriangles; ///< The number of triangles needed to reach the target edge length on screen.
+
+	/// Return the estimated number of triangles if the edge length is multiplied by the given scale.
+	double getTriangles(double scale) const {
+		return Min(Max(viewTriangles/(scale*scale), baseTriangles), maxTriangles);
+	}
+};
+
+// Return the estimated total number of triangles for all meshes if the edge length is multiplied by the given scale.
+static double getTotalTriangles(const std::vector<TessellationEstimate> &estimates, double scale) {
+	double res=0.0;
+	for (const TessellationEstimate &estimate : estimates)
+		res+=estimate.getTriangles(scale);
+	return res;
+}
+
+void GeomAlembicReader::applyTessellationBudget(const Table<AlembicMeshSource*, -1> &sources, const Table<AlembicMeshInstance*, -1> &instances, const LodCamera &camera, ProgressCallback *prog) {
+	std::unordered_set<AlembicMeshSource*> chosenSources(&sources[0], &sources[0]+sources.count());
+	for (int i=0; i<sources.count(); i++) {
+		sources[i]->tessellationScale=1.0f;
+		sources[i]->tessellatedTriangles=0.0;
+	}
+
+	// The meshes that are already loaded keep their tessellation and use up part of the budget.
+	double loadedTriangles=0.0;
+	for (int i=0; i<meshSources.count(); i++) {
+		if (chosenSources.count(meshSources[i])==0)
+			loadedTriangles+=meshSources[i]->tessellatedTriangles;
+	}
+
+	// Estimate the tessellation of each displaced or subdivided mesh from the projected size of its instances.
+	// Objects that cover the camera are assumed to fill the image a few times over.
+	std::unordered_map<AlembicMeshSource*, int> estimateIndices;
+	std::vector<TessellationEstimate> estimates;
+	float maxProjectedSize=float(camera.imgWidth)*4.0f;
+	for (int i=0; i<instances.count(); i++) {
+		AlembicMeshInstance &meshInstance=*instances[i];
+		AlembicMeshSource &meshSource=*meshInstance.meshSource;
+		if (chosenSources.count(&meshSource)==0 || meshInstance.tms.count()==0 || meshSource.facesParam.getNumKeyframes()==0)
+			continue;
+
+		DisplacementSubdivParams displSubdivParams;
+		getDisplacementSubdivParams(meshSource.abcName, displSubdivParams);
+		if (!displSubdivParams.hasDisplacementOrSubdivision() || displSubdivParams.edgeLength<=0.0f)
+			continue;
+
+		auto it=estimateIndices.find(&meshSource);
+		if (it==estimateIndices.end()) {
+			TessellationEstimate estimate;
+			estimate.meshSource=&meshSource;
+			estimate.baseTriangles=estimate.maxTriangles=estimate.viewTriangles=0.0;
+			it=estimateIndices.insert(std::make_pair(&meshSource, int(estimates.size()))).first;
+			estimates.push_back(estimate);
+		}
+		TessellationEstimate &estimate=estimates[it->second];
+
+		double numTriangles=double(meshSource.facesParam.getKeyframeData(0).count()/3);
+		double maxSubdivs=double(Max(displSubdivParams.maxSubdivs, 1));
+		float projectedSize=Min(estimateProjectedSize(getMeshSourceBBox(meshSource, meshInstance.tms[0]), camera), maxProjectedSize);
+		double edgesAcross=double(projectedSize)/double(displSubdivParams.edgeLength);
+
+		estimate.baseTriangles+=numTriangles;
+		estimate.maxTriangles+=numTriangles*maxSubdivs*maxSubdivs;
+		estimate.viewTriangles+=2.0*edgesAcross*edgesAcross;
+	}
+
+	// Without a budget, the estimates are only kept for the memory report.
+	double budget=double(displacementTriangleBudget)*1e6;
+	double total=getTotalTriangles(estimates, 1.0);
+	if (budget<=0.0 || loadedTriangles+total<=budget) {
+		for (const TessellationEstimate &estimate : estimates)
+			estimate.meshSource->tessellatedTriangles=estimate.getTriangles(1.0);
+		return;
+	}
+	budget=Max(budget-loadedTriangles, 0.0);
+
+	// Find the smallest edge length scale that fits in the budget; the number of triangles decreases with the scale.
+	double minScale=1.0, maxScale=1e4;
+	if (getTotalTriangles(estimates, maxScale)>budget) {
+		if (prog) {
+			prog->warning("The displacement triangle budget of %.1fM triangles is less than the untessellated geometry", double(displacementTriangleBudget));
+		}
+		minScale=maxScale;
+	} else {
+		for (int i=0; i<40; i++) {
+			double scale=sqrt(minScale*maxScale);
+			if (getTotalTriangles(estimates, scale)>budget) minScale=scale;
+			else maxScale=scale;
+		}
+		minScale=maxScale;
+	}
+
+	// Round the scale up to a 1/16 octave step, so that the scale, and with it the edge length parameters and the
+	// tessellation of the objects, does not change with every small change of the estimate from frame to frame.
+	minScale=pow(2.0, ceil(log(minScale)/log(2.0)*16.0)/16.0);
+
+	for (const TessellationEstimate &estimate : estimates) {
+		estimate.meshSource->tessellationScale=float(minScale);
+		estimate.meshSource->tessellatedTriangles=estimate.getTriangles(minScale);
+	}
+
+	if (prog) {
+		prog->info("Displacement tessellation: estimated %.1fM triangles for a budget of %.1fM, edge length scaled by %.2f", (loadedTriangles+total)*1e-6, double(displacementTriangleBudget), minScale);
+	}
+}
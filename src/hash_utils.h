@@ -0,0 +1,20 @@
+#pragma once
+
+#include "utils.h"
+
+/// The initial value for hashMemory().
+const VR::uint64 hashSeed=VR::uint64(14695981039346656037ULL);
+
+/// Compute a 64-bit FNV-1a hash of the given memory block.
+/// @param data The memory block.
+/// @param size The size of the memory block in bytes.
+/// @param hash The hash to continue from; use hashSeed for a new hash.
+/// @retval The updated hash.
+inline VR::uint64 hashMemory(const void *data, size_t size, VR::uint64 hash=hashSeed) {
+	const VR::uint8 *bytes=static_cast<const VR::uint8*>(data);
+	for (size_t i=0; i<size; i++) {
+		hash^=VR::uint64(bytes[i]);
+		hash*=VR::uint64(1099511628211ULL);
+	}
+	return hash;
+}
@@ -0,0 +1,158 @@
+#include "mem_report.h"
+#include "csv_utils.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+using namespace VR;
+
+const tchar* getMeshMemChannelName(MeshMemChannel channel) {
+	switch (channel) {
+		case meshMemChannel_vertices: return "vertices";
+		case meshMemChannel_faces: return "faces";
+		case meshMemChannel_normals: return "normals";
+		case meshMemChannel_faceNormals: return "faceNormals";
+		case meshMemChannel_velocities: return "velocities";
+		case meshMemChannel_faceMtlIDs: return "faceMtlIDs";
+		case meshMemChannel_mapChannel: return "mapChannel";
+		case meshMemChannel_tessellation: return "tessellation";
+		default: return "";
+	}
+}
+
+// Add an entry for the given channel and keyframe to the memory usage. External data is kept out of channelBytes.
+static void addMemEntry(MeshMemUsage &usage, MeshMemChannel channel, int mapChannelIdx, int keyframe, size_t bytes, int external=false) {
+	MeshMemEntry &entry=*usage.entries.newElement();
+	entry.channel=channel;
+	entry.mapChannelIdx=mapChannelIdx;
+	entry.keyframe=keyframe;
+	entry.bytes=bytes;
+	entry.external=external;
+	if (external)
+		usage.externalBytes+=bytes;
+	else
+		usage.channelBytes[channel]+=bytes;
+}
+
+// Add an entry for each keyframe of the given list parameter to the memory usage.
+template<class T>
+static void addKeyframesMemUsage(MeshMemUsage &usage, MeshMemChannel channel, AnimatedParam<T> &param, int external) {
+	for (int i=0; i<param.getNumKeyframes(); i++) {
+		const T &data=param.getKeyframeData(i);
+		addMemEntry(usage, channel, -1, i, data.count()*sizeof(data[0]), external);
+	}
+}
+
+void getMeshSourceMemUsage(AlembicMeshSource &meshSource, MeshMemUsage &usage) {
+	usage.meshSource=&meshSource;
+
+	// These are the lists that point into the mapped cache file or the shared geometry (see detachMappedData()).
+	int external=meshSource.usesMappedData;
+	addKeyframesMemUsage(usage, meshMemChannel_vertices, meshSource.verticesParam, external);
+	addKeyframesMemUsage(usage, meshMemChannel_faces, meshSource.facesParam, external);
+	addKeyframesMemUsage(usage, meshMemChannel_normals, meshSource.normalsParam, external);
+	addKeyframesMemUsage(usage, meshMemChannel_faceNormals, meshSource.faceNormalsParam, external);
+	addKeyframesMemUsage(usage, meshMemChannel_velocities, meshSource.velocitiesParam, external);
+	addKeyframesMemUsage(usage, meshMemChannel_faceMtlIDs, meshSource.faceMtlIDsParam, external);
+
+	AnimatedMapChannelsParam &mapChannelsParam=meshSource.mapChannelsParam;
+	for (int i=0; i<mapChannelsParam.getNumKeyframes(); i++) {
+		const AbcMapChannelsList &mapChannels=mapChannelsParam.getKeyframeData(i);
+		for (int j=0; j<mapChannels.count(); j++) {
+			const AbcMapChannel &mapChannel=mapChannels[j];
+			addMemEntry(usage, meshMemChannel_mapChannel, mapChannel.idx, i, mapChannel.verts.count()*sizeof(Vector)+mapChannel.faces.count()*sizeof(int), external);
+		}
+	}
+
+	// Only pre-tessellated displacement/subdivision is kept in memory for the whole frame.
+	if (meshSource.displSubdivPlugin && meshSource.displSubdivParams.staticTessellation && meshSource.tessellatedTriangles>0.0) {
+		addMemEntry(usage, meshMemChannel_tessellation, -1, -1, size_t(meshSource.tessellatedTriangles*double(staticBytesPerTriangle)));
+	}
+}
+
+// Convert bytes to megabytes for printing.
+static double toMB(size_t bytes) {
+	return double(bytes)/(1024.0*1024.0);
+}
+
+void GeomAlembicReader::reportMemoryUsage(ProgressCallback *prog) {
+	if (memoryReportCount<=0 && memoryReportFileName.empty())
+		return;
+
+	std::unordered_map<AlembicMeshSource*, int> numInstances;
+	for (int i=0; i<meshInstances.count(); i++)
+		numInstances[meshInstances[i]->meshSource]++;
+
+	std::vector<MeshMemUsage*> usages;
+	usages.reserve(meshSources.count());
+	size_t totalBytes[meshMemChannel_count]={ 0 };
+	size_t totalExternalBytes=0;
+	for (int i=0; i<meshSources.count(); i++) {
+		MeshMemUsage *usage=new MeshMemUsage;
+		getMeshSourceMemUsage(*meshSources[i], *usage);
+		usage->numInstances=numInstances[meshSources[i]];
+		for (int j=0; j<meshMemChannel_count; j++)
+			totalBytes[j]+=usage->channelBytes[j];
+		totalExternalBytes+=usage->externalBytes;
+		usages.push_back(usage);
+	}
+
+	std::sort(usages.begin(), usages.end(), [](const MeshMemUsage *a, const MeshMemUsage *b) {
+		return a->getTotalBytes()>b->getTotalBytes();
+	});
+
+	if (prog && memoryReportCount>0) {
+		size_t geometryBytes=0;
+		for (int i=0; i<meshMemChannel_count; i++) {
+			if (i!=meshMemChannel_tessellation)
+				geometryBytes+=totalBytes[i];
+		}
+		prog->info("Memory used by %i objects: %.1f MB geometry, %.1f MB estimated tessellation; %.1f MB more in the disk cache or shared geometry, not included",
+			meshSources.count(), toMB(geometryBytes), toMB(totalBytes[meshMemChannel_tessellation]), toMB(totalExternalBytes));
+
+		int count=Min(memoryReportCount, int(usages.size()));
+		for (int i=0; i<count; i++) {
+			const MeshMemUsage &usage=*usages[i];
+			const tchar *name=usage.meshSource->abcName.empty()? "" : usage.meshSource->abcName.ptr();
+			prog->info("%.2f MB \"%s\" (%i instances): vertices %.2f, faces %.2f, normals %.2f, face normals %.2f, velocities %.2f, face sets %.2f, UV/color sets %.2f, tessellation %.2f, external %.2f",
+				toMB(usage.getTotalBytes()), name, usage.numInstances,
+				toMB(usage.channelBytes[meshMemChannel_vertices]),
+				toMB(usage.channelBytes[meshMemChannel_faces]),
+				toMB(usage.channelBytes[meshMemChannel_normals]),
+				toMB(usage.channelBytes[meshMemChannel_faceNormals]),
+				toMB(usage.channelBytes[meshMemChannel_velocities]),
+				toMB(usage.channelBytes[meshMemChannel_faceMtlIDs]),
+				toMB(usage.channelBytes[meshMemChannel_mapChannel]),
+				toMB(usage.channelBytes[meshMemChannel_tessellation]),
+				toMB(usage.externalBytes)
+			);
+		}
+	}
+
+	if (!memoryReportFileName.empty()) {
+		FILE *f=fopen(memoryReportFileName.ptr(), "wt");
+		if (!f) {
+			if (prog) {
+				prog->warning("Cannot open memory report file \"%s\" for writing", memoryReportFileName.ptr());
+			}
+		} else {
+			fprintf(f, "name,voxel,instances,channel,mapChannel,keyframe,bytes,externalBytes\n");
+			for (const MeshMemUsage *usage : usages) {
+				const AlembicMeshSource &meshSource=*usage->meshSource;
+				for (int i=0; i<usage->entries.count(); i++) {
+					const MeshMemEntry &entry=usage->entries[i];
+					size_t ownBytes=entry.external? 0 : entry.bytes;
+					size_t externalBytes=entry.external? entry.bytes : 0;
+					writeCSVString(f, meshSource.abcName.ptr());
+					fprintf(f, ",%i,%i,%s,%i,%i,%llu,%llu\n", meshSource.voxelIndex, usage->numInstances,
+						getMeshMemChannelName(entry.channel), entry.mapChannelIdx, entry.keyframe, (unsigned long long) ownBytes, (unsigned long long) externalBytes);
+				}
+			}
+			fclose(f);
+		}
+	}
+
+	for (MeshMemUsage *usage : usages)
+		delete usage;
+}
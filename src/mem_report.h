@@ -0,0 +1,64 @@
+#pragma once
+
+#include "geomalembicreader.h"
+
+/// The kinds of data that the memory of a mesh source is accounted for.
+enum MeshMemChannel {
+	meshMemChannel_vertices,
+	meshMemChannel_faces,
+	meshMemChannel_normals,
+	meshMemChannel_faceNormals,
+	meshMemChannel_velocities,
+	meshMemChannel_faceMtlIDs,
+	meshMemChannel_mapChannel,
+	meshMemChannel_tessellation,
+
+	meshMemChannel_count
+};
+
+/// Return a name for the given kind of data, as used in the memory report.
+const tchar* getMeshMemChannelName(MeshMemChannel channel);
+
+/// The memory used by one keyframe of one channel of a mesh source.
+struct MeshMemEntry {
+	MeshMemChannel channel; ///< The kind of data.
+	int mapChannelIdx; ///< The index of the UV/color set for meshMemChannel_mapChannel and -1 otherwise.
+	int keyframe; ///< The index of the keyframe; -1 for the tessellation, which is not keyframed.
+	size_t bytes; ///< The memory used, in bytes.
+	int external; ///< true if the data lives in a memory-mapped disk cache file or in geometry shared with other readers.
+};
+
+/// The memory used by a mesh source.
+struct MeshMemUsage {
+	AlembicMeshSource *meshSource; ///< The mesh source.
+	int numInstances; ///< The number of instances of the mesh source.
+	size_t channelBytes[meshMemChannel_count]; ///< The memory used by each kind of data, over all keyframes, apart from external data.
+	size_t externalBytes; ///< The size of the data that lives in external memory; it is not included in channelBytes.
+	VR::Table<MeshMemEntry, -1> entries; ///< The memory used by each channel and keyframe.
+
+	/// Constructor.
+	MeshMemUsage(void): meshSource(nullptr), numInstances(0), externalBytes(0) {
+		for (int i=0; i<meshMemChannel_count; i++)
+			channelBytes[i]=0;
+	}
+
+	/// Return the memory used by the vertex, face, normal, velocity and UV/color data.
+	size_t getGeometryBytes(void) const {
+		return getTotalBytes()-channelBytes[meshMemChannel_tessellation];
+	}
+
+	/// Return the memory used by all data, including the estimated tessellation but not the external data.
+	size_t getTotalBytes(void) const {
+		size_t res=0;
+		for (int i=0; i<meshMemChannel_count; i++)
+			res+=channelBytes[i];
+		return res;
+	}
+};
+
+/// Compute the memory used by the given mesh source for each channel and keyframe. The tessellation of
+/// pre-tessellated displacement/subdivision is estimated from AlembicMeshSource::tessellatedTriangles.
+/// The lists that point into external memory (see AlembicMeshSource::usesMappedData) are reported separately.
+/// @param meshSource The mesh source.
+/// @param[out] usage The memory used is returned here; numInstances is not set.
+void getMeshSourceMemUsage(AlembicMeshSource &meshSource, MeshMemUsage &usage);
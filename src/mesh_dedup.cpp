@@ -0,0 +1,221 @@
+#include "geomalembicreader.h"
+#include "hash_utils.h"
+#include "mem_report.h"
+#include "mesh_rigid.h"
+
+#include <unordered_map>
+#include <vector>
+
+using namespace VR;
+
+// Return true if all keyframes of the given velocities parameter are empty.
+static int hasNoVelocities(AnimatedVectorListParam &velocitiesParam) {
+	for (int i=0; i<velocitiesParam.getNumKeyframes(); i++) {
+		if (velocitiesParam.getKeyframeData(i).count()>0)
+			return false;
+	}
+	return true;
+}
+
+/// A mesh source that is a candidate for instancing.
+struct DedupCandidate {
+	int sourceIndex; ///< Index of the mesh source in the meshSources table.
+	const VectorList *verts; ///< The vertices of the mesh.
+	const IntList *faces; ///< The faces of the mesh.
+	Vector center; ///< The centroid of the vertices.
+	float radius; ///< The RMS distance of the vertices from the centroid.
+};
+
+// Return true if the map channels of the two mesh sources are exactly the same.
+static int mapChannelsMatch(AlembicMeshSource &a, AlembicMeshSource &b) {
+	if (a.mapChannelsParam.getNumKeyframes()!=b.mapChannelsParam.getNumKeyframes())
+		return false;
+
+	for (int k=0; k<a.mapChannelsParam.getNumKeyframes(); k++) {
+		if (!isKeyframeDataEqual(a.mapChannelsParam.getKeyframeData(k), b.mapChannelsParam.getKeyframeData(k)))
+			return false;
+	}
+	return true;
+}
+
+// Return true if the two mesh sources have the same face sets, so that they get the same materials.
+static int faceSetsMatch(AlembicMeshSource &a, AlembicMeshSource &b) {
+	if (!isKeyframeDataEqual(a.faceSetNames, b.faceSetNames))
+		return false;
+	if (a.faceMtlIDsParam.getNumKeyframes()!=b.faceMtlIDsParam.getNumKeyframes())
+		return false;
+
+	for (int k=0; k<a.faceMtlIDsParam.getNumKeyframes(); k++) {
+		if (!isKeyframeDataEqual(a.faceMtlIDsParam.getKeyframeData(k), b.faceMtlIDsParam.getKeyframeData(k)))
+			return false;
+	}
+	return true;
+}
+
+// Return true if the normals of the mesh source b are the normals of a rotated by the given transformation.
+static int normalsMatch(AlembicMeshSource &a, AlembicMeshSource &b, const Transform &tm, float tolerance) {
+	int numKeyframes=a.normalsParam.getNumKeyframes();
+	if (numKeyframes!=b.normalsParam.getNumKeyframes() || a.faceNormalsParam.getNumKeyframes()!=b.faceNormalsParam.getNumKeyframes())
+		return false;
+
+	for (int k=0; k<a.faceNormalsParam.getNumKeyframes(); k++) {
+		if (!isKeyframeDataEqual(a.faceNormalsParam.getKeyframeData(k), b.faceNormalsParam.getKeyframeData(k)))
+			return false;
+	}
+
+	for (int k=0; k<numKeyframes; k++) {
+		const VectorList &normalsA=a.normalsParam.getKeyframeData(k);
+		const VectorList &normalsB=b.normalsParam.getKeyframeData(k);
+		if (normalsA.count()!=normalsB.count())
+			return false;
+		for (int i=0; i<normalsA.count(); i++) {
+			if (lengthSqr(tm.m*normalsA[i]-normalsB[i])>tolerance*tolerance)
+				return false;
+		}
+	}
+	return true;
+}
+
+void GeomAlembicReader::autoInstanceMeshSources(ProgressCallback *prog) {
+	int numMeshSources=meshSources.count();
+	float tolerance=Max(autoInstancingTolerance, 0.0f);
+
+	// Collect the meshes that can be instanced: static geometry without velocities, with the same displacement
+	// and subdivision settings. The candidates are bucketed by a hash of their topology.
+	std::vector<DedupCandidate> candidates;
+	std::unordered_map<uint64, std::vector<int> > buckets;
+	for (int i=0; i<numMeshSources; i++) {
+		AlembicMeshSource &meshSource=*meshSources[i];
+		if (meshSource.verticesParam.getNumKeyframes()!=1 || meshSource.facesParam.getNumKeyframes()!=1)
+			continue;
+		if (!hasNoVelocities(meshSource.velocitiesParam))
+			continue;
+
+		DedupCandidate cand;
+		cand.sourceIndex=i;
+		cand.verts=&meshSource.verticesParam.getKeyframeData(0);
+		cand.faces=&meshSource.facesParam.getKeyframeData(0);
+		if (cand.verts->count()<3 || cand.faces->count()==0)
+			continue;
+
+		getVerticesCentroid(*cand.verts, cand.center, cand.radius);
+		if (cand.radius<=0.0f)
+			continue;
+
+		uint64 hash=hashSeed;
+		int numVerts=cand.verts->count();
+		hash=hashMemory(&numVerts, sizeof(numVerts), hash);
+		hash=hashMemory(&(*cand.faces)[0], cand.faces->count()*sizeof(int), hash);
+
+		buckets[hash].push_back(int(candidates.size()));
+		candidates.push_back(cand);
+	}
+
+	// For each bucket, compare the meshes with the ones that were already kept.
+	Table<int, -1> replacement; // The index of the mesh source that replaces each one, or -1.
+	replacement.setCount(numMeshSources);
+	for (int i=0; i<numMeshSources; i++)
+		replacement[i]=-1;
+
+	Table<Transform, -1> replacementTms; // The transformation from the kept mesh to each replaced one.
+	replacementTms.setCount(numMeshSources);
+
+	int numMerged=0;
+	size_t memSaved=0;
+	for (auto &bucket : buckets) {
+		const std::vector<int> &indices=bucket.second;
+		if (indices.size()<2)
+			continue;
+
+		std::vector<int> kept;
+		for (int candIdx : indices) {
+			DedupCandidate &cand=candidates[candIdx];
+			AlembicMeshSource &meshSource=*meshSources[cand.sourceIndex];
+
+			DisplacementSubdivParams displSubdivParams;
+			getDisplacementSubdivParams(meshSource.abcName, displSubdivParams);
+
+			int merged=false;
+			for (int keptIdx : kept) {
+				DedupCandidate &keptCand=candidates[keptIdx];
+				AlembicMeshSource &keptSource=*meshSources[keptCand.sourceIndex];
+
+				const IntList &keptFaces=*keptCand.faces;
+				const IntList &faces=*cand.faces;
+				if (keptCand.verts->count()!=cand.verts->count() || keptFaces.count()!=faces.count())
+					continue;
+				if (memcmp(&keptFaces[0], &faces[0], faces.count()*sizeof(int))!=0)
+					continue;
+				if (fabsf(keptCand.radius-cand.radius)>tolerance*keptCand.radius)
+					continue;
+
+				DisplacementSubdivParams keptDisplSubdivParams;
+				getDisplacementSubdivParams(keptSource.abcName, keptDisplSubdivParams);
+				if (!keptDisplSubdivParams.isSameAs(displSubdivParams))
+					continue;
+
+				Transform tm;
+				if (!getRigidTransform(*keptCand.verts, *cand.verts, tm))
+					continue;
+				if (!rigidTransformMatches(*keptCand.verts, *cand.verts, tm, tolerance*keptCand.radius))
+					continue;
+				if (!normalsMatch(keptSource, meshSource, tm, Max(tolerance, 1e-3f)))
+					continue;
+				if (!mapChannelsMatch(keptSource, meshSource))
+					continue;
+				if (!faceSetsMatch(keptSource, meshSource))
+					continue;
+
+				replacement[cand.sourceIndex]=keptCand.sourceIndex;
+				replacementTms[cand.sourceIndex]=tm;
+				merged=true;
+				break;
+			}
+
+			if (merged) {
+				numMerged++;
+				MeshMemUsage usage;
+				getMeshSourceMemUsage(meshSource, usage);
+				memSaved+=usage.getGeometryBytes();
+			} else {
+				kept.push_back(candIdx);
+			}
+		}
+	}
+
+	if (numMerged==0)
+		return;
+
+	// Re-point the instances of the replaced meshes to the kept ones.
+	std::unordered_map<AlembicMeshSource*, int> sourceIndices;
+	for (int i=0; i<numMeshSources; i++)
+		sourceIndices[meshSources[i]]=i;
+
+	for (int i=0; i<meshInstances.count(); i++) {
+		AlembicMeshInstance &meshInstance=*meshInstances[i];
+		auto it=sourceIndices.find(meshInstance.meshSource);
+		if (it==sourceIndices.end() || replacement[it->second]<0)
+			continue;
+
+		int sourceIndex=it->second;
+		const Transform &tm=replacementTms[sourceIndex];
+		for (int k=0; k<meshInstance.tms.count(); k++)
+			meshInstance.tms[k]=meshInstance.tms[k]*tm;
+		meshInstance.meshSource=meshSources[replacement[sourceIndex]];
+	}
+
+	// Delete the replaced meshes.
+	int numValid=0;
+	for (int i=0; i<numMeshSources; i++) {
+		if (replacement[i]>=0) {
+			delete meshSources[i];
+		} else {
+			meshSources[numValid++]=meshSources[i];
+		}
+	}
+	meshSources.setCount(numValid);
+
+	if (prog) {
+		prog->info("Automatic instancing replaced %i meshes with instances, saving %.1f MB", numMerged, double(memSaved)/(1024.0*1024.0));
+	}
+}
@@ -0,0 +1,199 @@
+#include "mesh_lod.h"
+
+#include <unordered_map>
+
+using namespace VR;
+
+Box getMeshSourceBBox(AlembicMeshSource &meshSource, const Transform &tm) {
+	Box bbox;
+	bbox.init();
+
+	if (meshSource.verticesParam.getNumKeyframes()==0)
+		return bbox;
+
+	const VectorList &verts=meshSource.verticesParam.getKeyframeData(0);
+	for (int i=0; i<verts.count(); i++) {
+		bbox+=tm*verts[i];
+	}
+	return bbox;
+}
+
+float estimateProjectedSize(const Box &bbox, const LodCamera &camera) {
+	if (bbox.isEmpty())
+		return 0.0f;
+
+	Vector center=(bbox.pmin+bbox.pmax)*0.5f;
+	float radius=length(bbox.pmax-bbox.pmin)*0.5f;
+	float dist=length(center-camera.pos);
+	if (dist<=radius)
+		return 1e18f;
+
+	float tanHalfFov=tanf(camera.fov*0.5f);
+	if (tanHalfFov<=0.0f)
+		return 1e18f;
+
+	return float(camera.imgWidth)*radius/(dist*tanHalfFov);
+}
+
+// Compute the average position of the vertices in each cluster.
+static VectorList averageClusters(const VectorList &verts, const Table<int, -1> &vertCluster, int numClusters) {
+	VectorList res(numClusters);
+	Table<int, -1> counts;
+	counts.setCount(numClusters);
+	for (int i=0; i<numClusters; i++) {
+		res[i].makeZero();
+		counts[i]=0;
+	}
+
+	for (int i=0; i<verts.count(); i++) {
+		int cluster=vertCluster[i];
+		res[cluster]+=verts[i];
+		counts[cluster]++;
+	}
+
+	for (int i=0; i<numClusters; i++) {
+		if (counts[i]>0)
+			res[i]/=float(counts[i]);
+	}
+	return res;
+}
+
+int decimateMeshSource(AlembicMeshSource &meshSource, int gridRes) {
+	AnimatedVectorListParam &vertsParam=meshSource.verticesParam;
+	AnimatedIntListParam &facesParam=meshSource.facesParam;
+
+	int numVertKeyframes=vertsParam.getNumKeyframes();
+	int numFaceKeyframes=facesParam.getNumKeyframes();
+	if (numVertKeyframes==0 || numFaceKeyframes==0)
+		return 0;
+
+	// Make sure the topology is the same for all keyframes.
+	int numVerts=vertsParam.getKeyframeData(0).count();
+	for (int i=1; i<numVertKeyframes; i++) {
+		if (vertsParam.getKeyframeData(i).count()!=numVerts)
+			return 0;
+	}
+
+	int numFaceIndices=facesParam.getKeyframeData(0).count();
+	for (int i=1; i<numFaceKeyframes; i++) {
+		if (facesParam.getKeyframeData(i).count()!=numFaceIndices)
+			return 0;
+	}
+
+	if (numVerts==0 || gridRes<1)
+		return 0;
+
+	// Compute the clustering grid from the first keyframe.
+	const VectorList &verts=vertsParam.getKeyframeData(0);
+	Box bbox=getMeshSourceBBox(meshSource, Transform(1));
+	Vector size=bbox.pmax-bbox.pmin;
+	float maxSize=Max(size.x, Max(size.y, size.z));
+	if (maxSize<=0.0f)
+		return 0;
+
+	float cellSize=maxSize/float(gridRes);
+
+	// Assign each vertex to a cluster.
+	Table<int, -1> vertCluster;
+	vertCluster.setCount(numVerts);
+	std::unordered_map<uint64, int> cellToCluster;
+	for (int i=0; i<numVerts; i++) {
+		Vector p=(verts[i]-bbox.pmin)/cellSize;
+		uint64 ix=uint64(Min(Max(int(p.x), 0), gridRes-1));
+		uint64 iy=uint64(Min(Max(int(p.y), 0), gridRes-1));
+		uint64 iz=uint64(Min(Max(int(p.z), 0), gridRes-1));
+		uint64 key=ix+uint64(gridRes)*(iy+uint64(gridRes)*iz);
+
+		std::unordered_map<uint64, int>::iterator it=cellToCluster.find(key);
+		if (it==cellToCluster.end()) {
+			int clusterIdx=int(cellToCluster.size());
+			cellToCluster[key]=clusterIdx;
+			vertCluster[i]=clusterIdx;
+		} else {
+			vertCluster[i]=it->second;
+		}
+	}
+
+	int numClusters=int(cellToCluster.size());
+	if (numClusters>=numVerts)
+		return 0;
+
+	// Find out which faces survive the clustering.
+	const IntList &faces=facesParam.getKeyframeData(0);
+	int numFaces=numFaceIndices/3;
+	Table<int, -1> keptFaces;
+	for (int i=0; i<numFaces; i++) {
+		int v0=vertCluster[faces[i*3+0]];
+		int v1=vertCluster[faces[i*3+1]];
+		int v2=vertCluster[faces[i*3+2]];
+		if (v0!=v1 && v1!=v2 && v2!=v0)
+			keptFaces+=i;
+	}
+
+	int numKeptFaces=keptFaces.count();
+
+	// Replace the vertices and the velocities with the cluster averages.
+	for (int i=0; i<numVertKeyframes; i++) {
+		VectorList &keyframeVerts=vertsParam.getKeyframeData(i);
+		keyframeVerts=averageClusters(keyframeVerts, vertCluster, numClusters);
+	}
+
+	AnimatedVectorListParam &velocitiesParam=meshSource.velocitiesParam;
+	for (int i=0; i<velocitiesParam.getNumKeyframes(); i++) {
+		VectorList &keyframeVels=velocitiesParam.getKeyframeData(i);
+		if (keyframeVels.count()==numVerts)
+			keyframeVels=averageClusters(keyframeVels, vertCluster, numClusters);
+	}
+
+	// Remap the faces.
+	for (int i=0; i<numFaceKeyframes; i++) {
+		IntList &keyframeFaces=facesParam.getKeyframeData(i);
+		IntList newFaces(numKeptFaces*3);
+		for (int j=0; j<numKeptFaces; j++) {
+			int faceIdx=keptFaces[j];
+			newFaces[j*3+0]=vertCluster[keyframeFaces[faceIdx*3+0]];
+			newFaces[j*3+1]=vertCluster[keyframeFaces[faceIdx*3+1]];
+			newFaces[j*3+2]=vertCluster[keyframeFaces[faceIdx*3+2]];
+		}
+		keyframeFaces=newFaces;
+	}
+
+	// Keep only the mapping faces for the remaining faces. The mapping vertices are left as they are.
+	AnimatedMapChannelsParam &mapChannelsParam=meshSource.mapChannelsParam;
+	for (int i=0; i<mapChannelsParam.getNumKeyframes(); i++) {
+		AbcMapChannelsList &mapChannels=mapChannelsParam.getKeyframeData(i);
+		for (int j=0; j<mapChannels.count(); j++) {
+			AbcMapChannel &mapChannel=mapChannels[j];
+			if (mapChannel.faces.count()!=numFaceIndices)
+				continue;
+
+			IntList newFaces(numKeptFaces*3);
+			for (int k=0; k<numKeptFaces; k++) {
+				int faceIdx=keptFaces[k];
+				newFaces[k*3+0]=mapChannel.faces[faceIdx*3+0];
+				newFaces[k*3+1]=mapChannel.faces[faceIdx*3+1];
+				newFaces[k*3+2]=mapChannel.faces[faceIdx*3+2];
+			}
+			mapChannel.faces=newFaces;
+		}
+	}
+
+	// Keep only the face material IDs of the remaining faces.
+	AnimatedIntListParam &faceMtlIDsParam=meshSource.faceMtlIDsParam;
+	for (int i=0; i<faceMtlIDsParam.getNumKeyframes(); i++) {
+		IntList &faceMtlIDs=faceMtlIDsParam.getKeyframeData(i);
+		if (faceMtlIDs.count()!=numFaces)
+			continue;
+
+		IntList newFaceMtlIDs(numKeptFaces);
+		for (int j=0; j<numKeptFaces; j++)
+			newFaceMtlIDs[j]=faceMtlIDs[keptFaces[j]];
+		faceMtlIDs=newFaceMtlIDs;
+	}
+
+	// The original normals don't match the new topology; let V-Ray compute the normals.
+	meshSource.normalsParam.clearKeyframes();
+	meshSource.faceNormalsParam.clearKeyframes();
+
+	return numFaces-numKeptFaces;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "geomalembicreader.h"
+
+/// Compute the bounding box of the first vertex keyframe of the given mesh source, transformed by the given matrix.
+/// @param meshSource The mesh source.
+/// @param tm The transformation to apply to the vertices.
+/// @retval The bounding box; it is empty if the mesh has no vertices.
+VR::Box getMeshSourceBBox(AlembicMeshSource &meshSource, const VR::Transform &tm);
+
+/// Estimate the size, in pixels, of the projection of the given world-space bounding box for the given camera.
+/// The estimate is based on the bounding sphere of the box and the horizontal field of view of the camera.
+/// @param bbox The world-space bounding box.
+/// @param camera The camera parameters.
+/// @retval The projected size in pixels; a very large value if the camera is inside the bounding sphere.
+float estimateProjectedSize(const VR::Box &bbox, const LodCamera &camera);
+
+/// Decimate all keyframes of the given mesh source in place using vertex clustering on a regular grid.
+/// Vertices in the same grid cell are merged into their average position and faces that become degenerate
+/// are removed, along with the respective mapping channel faces. Explicit normals are discarded. The topology
+/// of the mesh must be the same for all keyframes; if it is not, the mesh is left unchanged.
+/// @param meshSource The mesh source to decimate.
+/// @param gridRes The number of grid cells along the largest dimension of the mesh bounding box.
+/// @retval The number of faces removed from the mesh.
+int decimateMeshSource(AlembicMeshSource &meshSource, int gridRes);
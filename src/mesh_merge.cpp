@@ -0,0 +1,388 @@
+#include "geomalembicreader.h"
+#include "hash_utils.h"
+
+#include <unordered_map>
+#include <vector>
+
+using namespace VR;
+
+/// An object that is a candidate for merging with other small objects.
+struct MergeCandidate {
+	int sourceIndex; ///< Index of the mesh source in the meshSources table.
+	AlembicMeshInstance *meshInstance; ///< The only instance of the mesh source.
+	int numTriangles; ///< The number of triangles of the mesh.
+	VRayPlugin *mtlPlugin; ///< The resolved material of the object.
+	DisplacementSubdivParams displSubdivParams; ///< The resolved displacement/subdivision settings.
+	int dynamicRule; ///< -1 if there is no static/dynamic geometry rule for the object, otherwise the value of the rule.
+	int hasNormals; ///< true if the mesh has normals.
+};
+
+// Return true if the two mesh sources have UV/color sets with the same indices and names.
+static int mapChannelLayoutsMatch(AlembicMeshSource &a, AlembicMeshSource &b) {
+	int numA=a.mapChannelsParam.getNumKeyframes();
+	int numB=b.mapChannelsParam.getNumKeyframes();
+	if (numA!=numB)
+		return false;
+	if (numA==0)
+		return true;
+
+	const AbcMapChannelsList &channelsA=a.mapChannelsParam.getKeyframeData(0);
+	const AbcMapChannelsList &channelsB=b.mapChannelsParam.getKeyframeData(0);
+	if (channelsA.count()!=channelsB.count())
+		return false;
+	for (int i=0; i<channelsA.count(); i++) {
+		if (channelsA[i].idx!=channelsB[i].idx)
+			return false;
+	}
+
+	if (a.mapChannelNamesParam.getNumKeyframes()!=b.mapChannelNamesParam.getNumKeyframes())
+		return false;
+	if (a.mapChannelNamesParam.getNumKeyframes()>0 && !isKeyframeDataEqual(a.mapChannelNamesParam.getKeyframeData(0), b.mapChannelNamesParam.getKeyframeData(0)))
+		return false;
+
+	return true;
+}
+
+// Return true if the two candidates can go into the same merged mesh.
+static int canMerge(const MergeCandidate &a, const MergeCandidate &b, AlembicMeshSource &sourceA, AlembicMeshSource &sourceB) {
+	return
+		a.mtlPlugin==b.mtlPlugin &&
+		a.dynamicRule==b.dynamicRule &&
+		a.hasNormals==b.hasNormals &&
+		a.displSubdivParams.isSameAs(b.displSubdivParams) &&
+		mapChannelLayoutsMatch(sourceA, sourceB);
+}
+
+// Return true if the mesh source is simple enough to be merged: a single static sample without velocities
+// or face sets, and UV/color sets that have a face for each face of the mesh.
+static int isMergeable(AlembicMeshSource &meshSource, int idChannel) {
+	if (meshSource.verticesParam.getNumKeyframes()!=1 || meshSource.facesParam.getNumKeyframes()!=1)
+		return false;
+	if (meshSource.normalsParam.getNumKeyframes()>1 || meshSource.faceNormalsParam.getNumKeyframes()>1 || meshSource.mapChannelsParam.getNumKeyframes()>1)
+		return false;
+	if (meshSource.velocitiesParam.getNumKeyframes()>0 || meshSource.faceMtlIDsParam.getNumKeyframes()>0)
+		return false;
+
+	int numFaceIndices=meshSource.facesParam.getKeyframeData(0).count();
+	if (meshSource.faceNormalsParam.getNumKeyframes()>0 && meshSource.faceNormalsParam.getKeyframeData(0).count()!=numFaceIndices)
+		return false;
+
+	if (meshSource.mapChannelsParam.getNumKeyframes()>0) {
+		const AbcMapChannelsList &mapChannels=meshSource.mapChannelsParam.getKeyframeData(0);
+		for (int i=0; i<mapChannels.count(); i++) {
+			if (mapChannels[i].faces.count()!=numFaceIndices || mapChannels[i].idx==idChannel)
+				return false;
+		}
+	}
+	return true;
+}
+
+// Return the matrix that transforms normals for the given transformation, i.e. the inverse transpose of its
+// matrix up to a positive scale factor, which does not matter since the normals are normalized anyway. The
+// cofactor matrix is the inverse transpose times the determinant, so it is negated for mirroring transformations
+// to keep the normals from being flipped.
+static Matrix getNormalMatrix(const Matrix &m) {
+	Vector c0=m[1]^m[2], c1=m[2]^m[0], c2=m[0]^m[1];
+	float det=m[0]*c0;
+	return (det<0.0f)? Matrix(-c0, -c1, -c2) : Matrix(c0, c1, c2);
+}
+
+// Combine the given candidates into a new mesh source in the space of the Alembic file, with the ID of each
+// object in the given UV/color set (if it is not negative).
+static AlembicMeshSource* createMergedMeshSource(
+	Table<AlembicMeshSource*, -1> &meshSources,
+	const std::vector<MergeCandidate> &candidates,
+	const std::vector<int> &batch,
+	int idChannel
+) {
+	AlembicMeshSource &firstSource=*meshSources[candidates[batch[0]].sourceIndex];
+	const MergeCandidate &firstCand=candidates[batch[0]];
+	double time=firstSource.verticesParam.getKeyframeTime(0);
+
+	int numVerts=0, numFaceIndices=0, numNormals=0;
+	for (int candIdx : batch) {
+		AlembicMeshSource &meshSource=*meshSources[candidates[candIdx].sourceIndex];
+		numVerts+=meshSource.verticesParam.getKeyframeData(0).count();
+		numFaceIndices+=meshSource.facesParam.getKeyframeData(0).count();
+		if (firstCand.hasNormals)
+			numNormals+=meshSource.normalsParam.getKeyframeData(0).count();
+	}
+
+	AlembicMeshSource *merged=new AlembicMeshSource;
+	merged->setNumTimeSteps(1);
+	merged->voxelIndex=firstSource.voxelIndex;
+	merged->abcName=firstSource.abcName;
+	merged->mergedNames.setCount(int(batch.size()));
+
+	VectorList verts(numVerts);
+	IntList faces(numFaceIndices);
+	VectorList normals(firstCand.hasNormals? numNormals : 0);
+	IntList faceNormals(firstCand.hasNormals? numFaceIndices : 0);
+
+	int numMapChannels=0;
+	if (firstSource.mapChannelsParam.getNumKeyframes()>0)
+		numMapChannels=firstSource.mapChannelsParam.getKeyframeData(0).count();
+
+	// All UV/color sets have a face for each face of the mesh; see isMergeable().
+	AbcMapChannelsList mapChannels;
+	mapChannels.setCount(numMapChannels+(idChannel>=0? 1 : 0));
+	Table<int, -1> mapVertOffsets;
+	mapVertOffsets.setCount(numMapChannels);
+	for (int j=0; j<numMapChannels; j++) {
+		int numMapVerts=0;
+		for (int candIdx : batch)
+			numMapVerts+=meshSources[candidates[candIdx].sourceIndex]->mapChannelsParam.getKeyframeData(0)[j].verts.count();
+
+		mapChannels[j].idx=firstSource.mapChannelsParam.getKeyframeData(0)[j].idx;
+		mapChannels[j].verts=VectorList(numMapVerts);
+		mapChannels[j].faces=IntList(numFaceIndices);
+		mapVertOffsets[j]=0;
+	}
+
+	int vertOffset=0, faceOffset=0, normalOffset=0;
+	for (int k=0; k<int(batch.size()); k++) {
+		const MergeCandidate &cand=candidates[batch[k]];
+		AlembicMeshSource &meshSource=*meshSources[cand.sourceIndex];
+		const Transform &tm=cand.meshInstance->tms[0];
+		merged->mergedNames[k]=cand.meshInstance->abcName;
+
+		const VectorList &srcVerts=meshSource.verticesParam.getKeyframeData(0);
+		for (int i=0; i<srcVerts.count(); i++)
+			verts[vertOffset+i]=tm*srcVerts[i];
+
+		const IntList &srcFaces=meshSource.facesParam.getKeyframeData(0);
+		for (int i=0; i<srcFaces.count(); i++)
+			faces[faceOffset+i]=srcFaces[i]+vertOffset;
+
+		if (cand.hasNormals) {
+			Matrix normalTm=getNormalMatrix(tm.m);
+			const VectorList &srcNormals=meshSource.normalsParam.getKeyframeData(0);
+			for (int i=0; i<srcNormals.count(); i++)
+				normals[normalOffset+i]=normalize(normalTm*srcNormals[i]);
+
+			// Normals without face normals are indexed by the faces.
+			const IntList &srcFaceNormals=meshSource.faceNormalsParam.getNumKeyframes()>0? meshSource.faceNormalsParam.getKeyframeData(0) : srcFaces;
+			for (int i=0; i<srcFaceNormals.count(); i++)
+				faceNormals[faceOffset+i]=srcFaceNormals[i]+normalOffset;
+			normalOffset+=srcNormals.count();
+		}
+
+		for (int j=0; j<numMapChannels; j++) {
+			const AbcMapChannel &srcChannel=meshSource.mapChannelsParam.getKeyframeData(0)[j];
+			AbcMapChannel &mapChannel=mapChannels[j];
+			int mapVertOffset=mapVertOffsets[j];
+			for (int i=0; i<srcChannel.verts.count(); i++)
+				mapChannel.verts[mapVertOffset+i]=srcChannel.verts[i];
+			for (int i=0; i<srcChannel.faces.count(); i++)
+				mapChannel.faces[faceOffset+i]=srcChannel.faces[i]+mapVertOffset;
+			mapVertOffsets[j]+=srcChannel.verts.count();
+		}
+
+		vertOffset+=srcVerts.count();
+		faceOffset+=srcFaces.count();
+	}
+
+	// The ID channel has one vertex per object, with the index of the object in mergedNames, and all faces
+	// of the object reference it.
+	if (idChannel>=0) {
+		AbcMapChannel &idMapChannel=mapChannels[numMapChannels];
+		idMapChannel.idx=idChannel;
+		idMapChannel.verts=VectorList(int(batch.size()));
+		idMapChannel.faces=IntList(numFaceIndices);
+		int offset=0;
+		for (int k=0; k<int(batch.size()); k++) {
+			idMapChannel.verts[k]=Vector(float(k), 0.0f, 0.0f);
+			int count=meshSources[candidates[batch[k]].sourceIndex]->facesParam.getKeyframeData(0).count();
+			for (int i=0; i<count; i++)
+				idMapChannel.faces[offset+i]=k;
+			offset+=count;
+		}
+	}
+
+	merged->verticesParam.addKeyframe(time, verts);
+	merged->facesParam.addKeyframe(time, faces);
+	if (firstCand.hasNormals) {
+		merged->normalsParam.addKeyframe(time, normals);
+		merged->faceNormalsParam.addKeyframe(time, faceNormals);
+	}
+	if (mapChannels.count()>0) {
+		copyKeyframeData(merged->mapChannelsParam.addKeyframe(time), mapChannels);
+
+		StringList &names=merged->mapChannelNamesParam.addKeyframe(time);
+		if (firstSource.mapChannelNamesParam.getNumKeyframes()>0)
+			names.copy(firstSource.mapChannelNamesParam.getKeyframeData(0));
+		names.setCount(mapChannels.count());
+		if (idChannel>=0)
+			names[numMapChannels]="alembic_object_id";
+	}
+
+	return merged;
+}
+
+void GeomAlembicReader::mergeSmallMeshSources(ProgressCallback *prog) {
+	int numMeshSources=meshSources.count();
+
+	// Find the instance of each mesh; only meshes with a single instance are merged.
+	std::unordered_map<AlembicMeshSource*, int> instanceIndices;
+	for (int i=0; i<meshInstances.count(); i++) {
+		AlembicMeshSource *meshSource=meshInstances[i]->meshSource;
+		auto it=instanceIndices.find(meshSource);
+		if (it==instanceIndices.end())
+			instanceIndices[meshSource]=i;
+		else
+			it->second=-1;
+	}
+
+	// Collect the candidates and bucket them by their material, displacement and geometry settings.
+	std::vector<MergeCandidate> candidates;
+	std::unordered_map<uint64, std::vector<int> > buckets;
+	for (int i=0; i<numMeshSources; i++) {
+		AlembicMeshSource &meshSource=*meshSources[i];
+		auto it=instanceIndices.find(&meshSource);
+		if (it==instanceIndices.end() || it->second<0)
+			continue;
+
+		AlembicMeshInstance *meshInstance=meshInstances[it->second];
+		if (meshInstance->tms.count()!=1 || !isMergeable(meshSource, mergeIdChannel))
+			continue;
+
+		MergeCandidate cand;
+		cand.sourceIndex=i;
+		cand.meshInstance=meshInstance;
+		cand.numTriangles=meshSource.facesParam.getKeyframeData(0).count()/3;
+		if (cand.numTriangles==0 || cand.numTriangles>mergeMaxTriangles)
+			continue;
+
+		cand.mtlPlugin=getMaterialPluginForInstance(*meshInstance);
+		getDisplacementSubdivParams(meshInstance->abcName, cand.displSubdivParams);
+		int dynamic=true;
+		cand.dynamicRule=mtlAssignments.getDynamicGeometry(meshInstance->abcName, dynamic)? dynamic : -1;
+		cand.hasNormals=meshSource.normalsParam.getNumKeyframes()>0;
+
+		uint64 hash=hashSeed;
+		hash=hashMemory(&cand.mtlPlugin, sizeof(cand.mtlPlugin), hash);
+		hash=hashMemory(&cand.displSubdivParams.displacementTex, sizeof(cand.displSubdivParams.displacementTex), hash);
+		hash=hashMemory(&cand.displSubdivParams.hasSubdivision, sizeof(cand.displSubdivParams.hasSubdivision), hash);
+		hash=hashMemory(&cand.dynamicRule, sizeof(cand.dynamicRule), hash);
+		hash=hashMemory(&cand.hasNormals, sizeof(cand.hasNormals), hash);
+
+		buckets[hash].push_back(int(candidates.size()));
+		candidates.push_back(cand);
+	}
+
+	// Split each bucket into groups of objects that can be merged, and each group into batches
+	// of at most mergeBatchTriangles triangles.
+	std::vector<std::vector<int> > batches;
+	for (auto &bucket : buckets) {
+		std::vector<std::vector<int> > groups;
+		for (int candIdx : bucket.second) {
+			const MergeCandidate &cand=candidates[candIdx];
+			std::vector<int> *group=nullptr;
+			for (std::vector<int> &g : groups) {
+				const MergeCandidate &first=candidates[g[0]];
+				if (canMerge(first, cand, *meshSources[first.sourceIndex], *meshSources[cand.sourceIndex])) {
+					group=&g;
+					break;
+				}
+			}
+			if (!group) {
+				groups.push_back(std::vector<int>());
+				group=&groups.back();
+			}
+			group->push_back(candIdx);
+		}
+
+		for (const std::vector<int> &group : groups) {
+			std::vector<int> batch;
+			int batchTriangles=0;
+			for (int candIdx : group) {
+				int numTriangles=candidates[candIdx].numTriangles;
+				if (!batch.empty() && batchTriangles+numTriangles>mergeBatchTriangles) {
+					batches.push_back(batch);
+					batch.clear();
+					batchTriangles=0;
+				}
+				batch.push_back(candIdx);
+				batchTriangles+=numTriangles;
+			}
+			if (!batch.empty())
+				batches.push_back(batch);
+		}
+	}
+
+	// Create the merged meshes; batches with a single object are left as they are.
+	Table<int, -1> mergedInto; // For each mesh source, the index of the merged mesh that replaces it, or -1.
+	mergedInto.setCount(numMeshSources);
+	for (int i=0; i<numMeshSources; i++)
+		mergedInto[i]=-1;
+
+	Table<AlembicMeshSource*, -1> mergedSources;
+	int numMerged=0;
+	for (const std::vector<int> &batch : batches) {
+		if (batch.size()<2)
+			continue;
+
+		AlembicMeshSource *merged=createMergedMeshSource(meshSources, candidates, batch, mergeIdChannel);
+		for (int candIdx : batch)
+			mergedInto[candidates[candIdx].sourceIndex]=mergedSources.count();
+		mergedSources+=merged;
+		numMerged+=int(batch.size());
+	}
+
+	if (mergedSources.count()==0)
+		return;
+
+	// Replace the instances of the merged meshes with one instance of each merged mesh, in the space of the file.
+	Table<AlembicMeshInstance*, -1> mergedInstances;
+	mergedInstances.setCount(mergedSources.count());
+	for (int i=0; i<mergedSources.count(); i++)
+		mergedInstances[i]=nullptr;
+
+	std::unordered_map<AlembicMeshSource*, int> sourceIndices;
+	for (int i=0; i<numMeshSources; i++)
+		sourceIndices[meshSources[i]]=i;
+
+	int numValid=0;
+	for (int i=0; i<meshInstances.count(); i++) {
+		AlembicMeshInstance *meshInstance=meshInstances[i];
+		auto it=sourceIndices.find(meshInstance->meshSource);
+		int mergedIdx=(it==sourceIndices.end())? -1 : mergedInto[it->second];
+		if (mergedIdx<0) {
+			meshInstances[numValid++]=meshInstance;
+			continue;
+		}
+
+		if (!mergedInstances[mergedIdx]) {
+			AlembicMeshInstance *mergedInstance=new AlembicMeshInstance;
+			mergedInstance->meshSource=mergedSources[mergedIdx];
+			mergedInstance->abcName=mergedSources[mergedIdx]->abcName;
+			mergedInstance->tms.setCount(1);
+			mergedInstance->tms[0].makeIdentity();
+			mergedInstance->times.setCount(1);
+			mergedInstance->times[0]=meshInstance->times.count()>0? meshInstance->times[0] : 0.0;
+			mergedInstances[mergedIdx]=mergedInstance;
+			meshInstances[numValid++]=mergedInstance;
+		}
+		delete meshInstance;
+	}
+	meshInstances.setCount(numValid);
+	for (int i=0; i<meshInstances.count(); i++)
+		meshInstances[i]->meshIndex=i;
+
+	// Delete the merged meshes and add the new ones.
+	numValid=0;
+	for (int i=0; i<numMeshSources; i++) {
+		if (mergedInto[i]>=0) {
+			delete meshSources[i];
+		} else {
+			meshSources[numValid++]=meshSources[i];
+		}
+	}
+	meshSources.setCount(numValid);
+	for (int i=0; i<mergedSources.count(); i++)
+		meshSources+=mergedSources[i];
+
+	if (prog) {
+		prog->info("Merged %i small objects into %i meshes", numMerged, mergedSources.count());
+	}
+}
@@ -0,0 +1,151 @@
+#include "mesh_rigid.h"
+
+using namespace VR;
+
+void getVerticesCentroid(const VectorList &verts, Vector &center, float &radius) {
+	int numVerts=verts.count();
+	center.makeZero();
+	radius=0.0f;
+	if (numVerts==0)
+		return;
+
+	for (int i=0; i<numVerts; i++)
+		center+=verts[i];
+	center/=float(numVerts);
+
+	float sumSqr=0.0f;
+	for (int i=0; i<numVerts; i++)
+		sumSqr+=lengthSqr(verts[i]-center);
+	radius=sqrtf(sumSqr/float(numVerts));
+}
+
+// Build an orthonormal frame from two vectors.
+static int makeFrame(const Vector &d1, const Vector &d2, Vector frame[3]) {
+	Vector n=d1^d2;
+	if (lengthSqr(d1)<=0.0f || lengthSqr(n)<=0.0f)
+		return false;
+
+	frame[0]=normalize(d1);
+	frame[2]=normalize(n);
+	frame[1]=frame[2]^frame[0];
+	return true;
+}
+
+int getRigidTransform(const VectorList &a, const VectorList &b, Transform &tm) {
+	int numVerts=a.count();
+	if (numVerts<3 || b.count()!=numVerts)
+		return false;
+
+	Vector centerA, centerB;
+	float radiusA, radiusB;
+	getVerticesCentroid(a, centerA, radiusA);
+	getVerticesCentroid(b, centerB, radiusB);
+
+	// The first reference vertex is the one furthest from the centroid.
+	int ref1=0;
+	float maxDist=-1.0f;
+	for (int i=0; i<numVerts; i++) {
+		float dist=lengthSqr(a[i]-centerA);
+		if (dist>maxDist) {
+			maxDist=dist;
+			ref1=i;
+		}
+	}
+
+	// The second one is the one that forms the largest triangle with the centroid and the first one.
+	int ref2=-1;
+	float maxArea=0.0f;
+	for (int i=0; i<numVerts; i++) {
+		float area=lengthSqr((a[ref1]-centerA)^(a[i]-centerA));
+		if (area>maxArea) {
+			maxArea=area;
+			ref2=i;
+		}
+	}
+	if (ref2<0)
+		return false;
+
+	Vector fa[3], fb[3];
+	if (!makeFrame(a[ref1]-centerA, a[ref2]-centerA, fa) || !makeFrame(b[ref1]-centerB, b[ref2]-centerB, fb))
+		return false;
+
+	// The rotation maps the frame of a onto the frame of b; since the frames are orthonormal, the inverse
+	// of the frame of a is its transpose.
+	Matrix mb(fb[0], fb[1], fb[2]);
+	Matrix rot(
+		mb*Vector(fa[0].x, fa[1].x, fa[2].x),
+		mb*Vector(fa[0].y, fa[1].y, fa[2].y),
+		mb*Vector(fa[0].z, fa[1].z, fa[2].z)
+	);
+	tm=Transform(rot, centerB-rot*centerA);
+	return true;
+}
+
+int rigidTransformMatches(const VectorList &a, const VectorList &b, const Transform &tm, float maxDist) {
+	if (a.count()!=b.count())
+		return false;
+
+	float maxDistSqr=maxDist*maxDist;
+	for (int i=0; i<a.count(); i++) {
+		if (lengthSqr(tm*a[i]-b[i])>maxDistSqr)
+			return false;
+	}
+	return true;
+}
+
+int convertRigidMotion(AlembicMeshSource &meshSource, AlembicMeshInstance &meshInstance, float tolerance) {
+	AnimatedVectorListParam &vertsParam=meshSource.verticesParam;
+	int numKeyframes=vertsParam.getNumKeyframes();
+	if (numKeyframes<2 || meshSource.facesParam.getNumKeyframes()!=1 || meshSource.faceNormalsParam.getNumKeyframes()>1)
+		return false;
+	if (meshInstance.tms.count()!=numKeyframes || meshInstance.times.count()!=numKeyframes)
+		return false;
+
+	const VectorList &verts0=vertsParam.getKeyframeData(0);
+	Vector center;
+	float radius;
+	getVerticesCentroid(verts0, center, radius);
+	if (radius<=0.0f)
+		return false;
+
+	float maxDist=tolerance*radius;
+
+	// Find the transformation of each sample relative to the first one.
+	TransformsList sampleTms;
+	sampleTms.setCount(numKeyframes);
+	sampleTms[0].makeIdentity();
+	for (int i=1; i<numKeyframes; i++) {
+		if (vertsParam.getKeyframeTime(i)!=meshInstance.times[i])
+			return false;
+
+		const VectorList &verts=vertsParam.getKeyframeData(i);
+		if (!getRigidTransform(verts0, verts, sampleTms[i]) || !rigidTransformMatches(verts0, verts, sampleTms[i], maxDist))
+			return false;
+	}
+
+	// The normals must rotate with the vertices too.
+	AnimatedVectorListParam &normalsParam=meshSource.normalsParam;
+	if (normalsParam.getNumKeyframes()==numKeyframes) {
+		const VectorList &normals0=normalsParam.getKeyframeData(0);
+		for (int i=1; i<numKeyframes; i++) {
+			const VectorList &normals=normalsParam.getKeyframeData(i);
+			if (normals.count()!=normals0.count())
+				return false;
+			for (int j=0; j<normals.count(); j++) {
+				if (lengthSqr(sampleTms[i].m*normals0[j]-normals[j])>1e-6f)
+					return false;
+			}
+		}
+	} else if (normalsParam.getNumKeyframes()>1) {
+		return false;
+	}
+
+	// Move the motion into the instance transformations and keep only the first samples of the mesh.
+	for (int i=0; i<numKeyframes; i++)
+		meshInstance.tms[i]=meshInstance.tms[i]*sampleTms[i];
+
+	vertsParam.collapseToFirstKeyframe();
+	normalsParam.collapseToFirstKeyframe();
+	meshSource.velocitiesParam.clearKeyframes();
+	return true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "geomalembicreader.h"
+
+/// Compute the centroid of the given vertices and their RMS distance from it.
+/// @param verts The vertices.
+/// @param center The centroid is returned here.
+/// @param radius The RMS distance of the vertices from the centroid is returned here; 0 if there are no vertices.
+void getVerticesCentroid(const VR::VectorList &verts, VR::Vector &center, float &radius);
+
+/// Compute the rigid transformation (rotation and translation) that maps the vertices a onto the vertices b,
+/// assuming that vertices with the same index correspond to each other. The transformation is computed from
+/// the centroids and two reference vertices chosen from a, so it must be verified with rigidTransformMatches().
+/// @param a The source vertices.
+/// @param b The target vertices; must have the same count as a.
+/// @param tm The transformation is returned here.
+/// @retval true if the transformation could be computed and false if the vertices are degenerate (f.e. collinear).
+int getRigidTransform(const VR::VectorList &a, const VR::VectorList &b, VR::Transform &tm);
+
+/// Check if the vertices b are the vertices a transformed by the given transformation.
+/// @param a The source vertices.
+/// @param b The target vertices; must have the same count as a.
+/// @param tm The transformation.
+/// @param maxDist The maximum allowed distance between a transformed vertex of a and the respective vertex of b.
+/// @retval true if all vertices match within maxDist.
+int rigidTransformMatches(const VR::VectorList &a, const VR::VectorList &b, const VR::Transform &tm, float maxDist);
+
+/// Check if all vertex samples of the given mesh source are a rigid transformation of the first one, and if so,
+/// keep only the first vertex sample and move the motion into the transformations of the instance. Normals are
+/// reduced to their first sample too and velocities are removed, since the motion is now in the transformations.
+/// @param meshSource The mesh source; the topology must be constant over the samples.
+/// @param meshInstance The instance of the mesh source; it must have one transformation for each vertex sample.
+/// @param tolerance The maximum vertex deviation relative to the size of the mesh.
+/// @retval true if the mesh was converted and false if it was left unchanged.
+int convertRigidMotion(AlembicMeshSource &meshSource, AlembicMeshInstance &meshInstance, float tolerance);
@@ -0,0 +1,301 @@
+#include "geomalembicreader.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+using namespace VR;
+
+/// Renumbers the elements (vertices, normals or UV/color set vertices) referenced by a subset of faces.
+struct IndexRemap {
+	Table<int, -1> newIndices; ///< The new index of each original element, or -1 if it is not used.
+	Table<int, -1> used; ///< The original index of each new element.
+
+	/// Prepare for renumbering the given number of elements. If the number is the same as for the previous call, only
+	/// the entries of the elements used since then are reset, so that renumbering many small subsets of the same large
+	/// list takes time proportional to the subsets and not to the list.
+	void init(int numElements) {
+		if (newIndices.count()!=numElements) {
+			newIndices.setCount(numElements);
+			for (int i=0; i<numElements; i++)
+				newIndices[i]=-1;
+		} else {
+			for (int i=0; i<used.count(); i++)
+				newIndices[used[i]]=-1;
+		}
+		used.clear();
+	}
+
+	/// Renumber the element indices of the given faces; faces is a list of 3 indices per face.
+	template<class T>
+	IntList remapFaces(const T &faces, const std::vector<int> &faceIndices) {
+		IntList res(int(faceIndices.size())*3);
+		for (int i=0; i<int(faceIndices.size()); i++) {
+			for (int j=0; j<3; j++) {
+				int idx=faces[faceIndices[i]*3+j];
+				if (newIndices[idx]<0) {
+					newIndices[idx]=used.count();
+					used+=idx;
+				}
+				res[i*3+j]=newIndices[idx];
+			}
+		}
+		return res;
+	}
+
+	/// Return a copy of the used elements of the given list, in the new order.
+	VectorList copyUsed(const VectorList &elements) const {
+		VectorList res(used.count());
+		for (int i=0; i<used.count(); i++)
+			res[i]=elements[used[i]];
+		return res;
+	}
+};
+
+/// The renumbering tables for the chunks of one source mesh, kept from one chunk to the next.
+struct ChunkRemaps {
+	IndexRemap vertRemap; ///< For the vertices, velocities and (without face normals) the normals.
+	IndexRemap normalRemap; ///< For the normals indexed by the face normals.
+	Table<IndexRemap*, -1> mapRemaps; ///< For the vertices of each UV/color set.
+
+	/// Destructor.
+	~ChunkRemaps(void) {
+		for (int i=0; i<mapRemaps.count(); i++)
+			delete mapRemaps[i];
+		mapRemaps.clear();
+	}
+
+	/// Return the renumbering table for the UV/color set with the given index in the list of the source mesh.
+	IndexRemap& getMapRemap(int channel) {
+		while (mapRemaps.count()<=channel)
+			mapRemaps+=new IndexRemap;
+		return *mapRemaps[channel];
+	}
+};
+
+// Return true if the source mesh can be split: the topology (faces, face normals, UV/color set faces and face sets)
+// must be the same for all samples, and the per-vertex lists must have the same count for all samples.
+static int isSplittable(AlembicMeshSource &meshSource) {
+	if (meshSource.facesParam.getNumKeyframes()!=1 || meshSource.verticesParam.getNumKeyframes()==0)
+		return false;
+	if (meshSource.faceNormalsParam.getNumKeyframes()>1 || meshSource.mapChannelsParam.getNumKeyframes()>1 || meshSource.faceMtlIDsParam.getNumKeyframes()>1)
+		return false;
+
+	int numFaceIndices=meshSource.facesParam.getKeyframeData(0).count();
+	int numVerts=meshSource.verticesParam.getKeyframeData(0).count();
+	for (int i=0; i<meshSource.verticesParam.getNumKeyframes(); i++) {
+		if (meshSource.verticesParam.getKeyframeData(i).count()!=numVerts)
+			return false;
+	}
+	for (int i=0; i<meshSource.velocitiesParam.getNumKeyframes(); i++) {
+		if (meshSource.velocitiesParam.getKeyframeData(i).count()!=numVerts)
+			return false;
+	}
+
+	if (meshSource.faceNormalsParam.getNumKeyframes()>0) {
+		if (meshSource.faceNormalsParam.getKeyframeData(0).count()!=numFaceIndices)
+			return false;
+	} else {
+		for (int i=0; i<meshSource.normalsParam.getNumKeyframes(); i++) {
+			if (meshSource.normalsParam.getKeyframeData(i).count()!=numVerts)
+				return false;
+		}
+	}
+
+	if (meshSource.mapChannelsParam.getNumKeyframes()>0) {
+		const AbcMapChannelsList &mapChannels=meshSource.mapChannelsParam.getKeyframeData(0);
+		for (int i=0; i<mapChannels.count(); i++) {
+			if (mapChannels[i].faces.count()!=numFaceIndices)
+				return false;
+		}
+	}
+
+	if (meshSource.faceMtlIDsParam.getNumKeyframes()>0 && meshSource.faceMtlIDsParam.getKeyframeData(0).count()!=numFaceIndices/3)
+		return false;
+
+	return true;
+}
+
+// Split the given faces into spatially coherent groups of at most maxFaces faces each, by recursively splitting
+// them at the median of their centroids along the largest dimension of the centroid bounds.
+static void splitFaces(std::vector<int> &faceIndices, int begin, int end, const std::vector<Vector> &centroids, int maxFaces, std::vector<std::pair<int, int> > &ranges) {
+	if (end-begin<=maxFaces) {
+		ranges.push_back(std::make_pair(begin, end));
+		return;
+	}
+
+	Box bbox;
+	bbox.init();
+	for (int i=begin; i<end; i++)
+		bbox+=centroids[faceIndices[i]];
+
+	Vector size=bbox.pmax-bbox.pmin;
+	int axis=(size.x>=size.y && size.x>=size.z)? 0 : (size.y>=size.z? 1 : 2);
+
+	int mid=begin+(end-begin)/2;
+	std::nth_element(faceIndices.begin()+begin, faceIndices.begin()+mid, faceIndices.begin()+end, [&](int a, int b) {
+		return centroids[a][axis]<centroids[b][axis];
+	});
+
+	splitFaces(faceIndices, begin, mid, centroids, maxFaces, ranges);
+	splitFaces(faceIndices, mid, end, centroids, maxFaces, ranges);
+}
+
+// Create a mesh source with the given faces of the source mesh, for all samples. The vertices, normals and
+// UV/color set vertices that the faces reference are copied and renumbered with the given tables, which must be
+// used only for the chunks of this source mesh.
+static AlembicMeshSource* createChunk(AlembicMeshSource &src, const std::vector<int> &faceIndices, int chunkIndex, ChunkRemaps &remaps) {
+	AlembicMeshSource *chunk=new AlembicMeshSource;
+	chunk->setNumTimeSteps(src.nsamples);
+	chunk->voxelIndex=src.voxelIndex;
+	chunk->abcName=src.abcName;
+	chunk->chunkIndex=chunkIndex;
+	chunk->faceSetNames.copy(src.faceSetNames);
+
+	const IntList &faces=src.facesParam.getKeyframeData(0);
+	int numVerts=src.verticesParam.getKeyframeData(0).count();
+
+	IndexRemap &vertRemap=remaps.vertRemap;
+	vertRemap.init(numVerts);
+	chunk->facesParam.addKeyframe(src.facesParam.getKeyframeTime(0), vertRemap.remapFaces(faces, faceIndices));
+
+	for (int i=0; i<src.verticesParam.getNumKeyframes(); i++)
+		chunk->verticesParam.addKeyframe(src.verticesParam.getKeyframeTime(i), vertRemap.copyUsed(src.verticesParam.getKeyframeData(i)));
+	for (int i=0; i<src.velocitiesParam.getNumKeyframes(); i++)
+		chunk->velocitiesParam.addKeyframe(src.velocitiesParam.getKeyframeTime(i), vertRemap.copyUsed(src.velocitiesParam.getKeyframeData(i)));
+
+	// Normals are either indexed by the face normals or, without them, by the faces.
+	if (src.faceNormalsParam.getNumKeyframes()>0) {
+		IndexRemap &normalRemap=remaps.normalRemap;
+		normalRemap.init(src.normalsParam.getNumKeyframes()>0? src.normalsParam.getKeyframeData(0).count() : 0);
+		IntList faceNormals=normalRemap.remapFaces(src.faceNormalsParam.getKeyframeData(0), faceIndices);
+		chunk->faceNormalsParam.addKeyframe(src.faceNormalsParam.getKeyframeTime(0), faceNormals);
+		for (int i=0; i<src.normalsParam.getNumKeyframes(); i++)
+			chunk->normalsParam.addKeyframe(src.normalsParam.getKeyframeTime(i), normalRemap.copyUsed(src.normalsParam.getKeyframeData(i)));
+	} else {
+		for (int i=0; i<src.normalsParam.getNumKeyframes(); i++)
+			chunk->normalsParam.addKeyframe(src.normalsParam.getKeyframeTime(i), vertRemap.copyUsed(src.normalsParam.getKeyframeData(i)));
+	}
+
+	if (src.mapChannelsParam.getNumKeyframes()>0) {
+		const AbcMapChannelsList &srcChannels=src.mapChannelsParam.getKeyframeData(0);
+		AbcMapChannelsList &mapChannels=chunk->mapChannelsParam.addKeyframe(src.mapChannelsParam.getKeyframeTime(0));
+		mapChannels.setCount(srcChannels.count());
+		for (int i=0; i<srcChannels.count(); i++) {
+			const AbcMapChannel &srcChannel=srcChannels[i];
+			AbcMapChannel &mapChannel=mapChannels[i];
+			mapChannel.idx=srcChannel.idx;
+
+			IndexRemap &mapRemap=remaps.getMapRemap(i);
+			mapRemap.init(srcChannel.verts.count());
+			mapChannel.faces=mapRemap.remapFaces(srcChannel.faces, faceIndices);
+			mapChannel.verts=VectorList(mapRemap.used.count());
+			for (int j=0; j<mapRemap.used.count(); j++)
+				mapChannel.verts[j]=srcChannel.verts[mapRemap.used[j]];
+		}
+	}
+
+	for (int i=0; i<src.mapChannelNamesParam.getNumKeyframes(); i++)
+		copyKeyframeData(chunk->mapChannelNamesParam.addKeyframe(src.mapChannelNamesParam.getKeyframeTime(i)), src.mapChannelNamesParam.getKeyframeData(i));
+
+	if (src.faceMtlIDsParam.getNumKeyframes()>0) {
+		const IntList &srcFaceMtlIDs=src.faceMtlIDsParam.getKeyframeData(0);
+		IntList faceMtlIDs(int(faceIndices.size()));
+		for (int i=0; i<int(faceIndices.size()); i++)
+			faceMtlIDs[i]=srcFaceMtlIDs[faceIndices[i]];
+		chunk->faceMtlIDsParam.addKeyframe(src.faceMtlIDsParam.getKeyframeTime(0), faceMtlIDs);
+	}
+
+	return chunk;
+}
+
+void GeomAlembicReader::splitLargeMeshSources(ProgressCallback *prog) {
+	int numMeshSources=meshSources.count();
+	int maxFaces=Max(splitChunkTriangles, 1);
+
+	// The chunks of each split mesh source; empty for the ones that are not split.
+	std::unordered_map<AlembicMeshSource*, std::vector<AlembicMeshSource*> > chunks;
+	int numSplit=0, numChunks=0;
+	for (int i=0; i<numMeshSources; i++) {
+		AlembicMeshSource &meshSource=*meshSources[i];
+		if (meshSource.facesParam.getNumKeyframes()==0 || meshSource.facesParam.getKeyframeData(0).count()/3<=splitMinTriangles)
+			continue;
+
+		// Displacement and subdivision would open cracks along the chunk borders.
+		DisplacementSubdivParams displSubdivParams;
+		getDisplacementSubdivParams(meshSource.abcName, displSubdivParams);
+		if (displSubdivParams.hasDisplacementOrSubdivision() || !isSplittable(meshSource))
+			continue;
+
+		const IntList &faces=meshSource.facesParam.getKeyframeData(0);
+		const VectorList &verts=meshSource.verticesParam.getKeyframeData(0);
+		int numFaces=faces.count()/3;
+
+		std::vector<Vector> centroids(numFaces);
+		std::vector<int> faceIndices(numFaces);
+		for (int j=0; j<numFaces; j++) {
+			centroids[j]=(verts[faces[j*3+0]]+verts[faces[j*3+1]]+verts[faces[j*3+2]])/3.0f;
+			faceIndices[j]=j;
+		}
+
+		std::vector<std::pair<int, int> > ranges;
+		splitFaces(faceIndices, 0, numFaces, centroids, maxFaces, ranges);
+		if (ranges.size()<2)
+			continue;
+
+		std::vector<AlembicMeshSource*> &sourceChunks=chunks[&meshSource];
+		ChunkRemaps remaps;
+		for (int j=0; j<int(ranges.size()); j++) {
+			std::vector<int> chunkFaces(faceIndices.begin()+ranges[j].first, faceIndices.begin()+ranges[j].second);
+			sourceChunks.push_back(createChunk(meshSource, chunkFaces, j, remaps));
+		}
+
+		numSplit++;
+		numChunks+=int(ranges.size());
+	}
+
+	if (numSplit==0)
+		return;
+
+	// Give each instance of a split mesh one instance per chunk, with the same transformations and name.
+	int numInstances=meshInstances.count();
+	for (int i=0; i<numInstances; i++) {
+		AlembicMeshInstance *meshInstance=meshInstances[i];
+		auto it=chunks.find(meshInstance->meshSource);
+		if (it==chunks.end())
+			continue;
+
+		const std::vector<AlembicMeshSource*> &sourceChunks=it->second;
+		meshInstance->meshSource=sourceChunks[0];
+		for (int j=1; j<int(sourceChunks.size()); j++) {
+			AlembicMeshInstance *chunkInstance=new AlembicMeshInstance;
+			chunkInstance->meshSource=sourceChunks[j];
+			chunkInstance->tms.copy(meshInstance->tms);
+			chunkInstance->times.copy(meshInstance->times);
+			chunkInstance->abcName=meshInstance->abcName;
+			chunkInstance->meshIndex=meshInstances.count();
+			meshInstances+=chunkInstance;
+		}
+	}
+
+	// Replace the split mesh sources with their chunks, keeping the order of the objects.
+	Table<AlembicMeshSource*, -1> oldMeshSources;
+	oldMeshSources.copy(meshSources);
+	meshSources.clear();
+	for (int i=0; i<numMeshSources; i++) {
+		AlembicMeshSource *meshSource=oldMeshSources[i];
+		auto it=chunks.find(meshSource);
+		if (it==chunks.end()) {
+			meshSources+=meshSource;
+			continue;
+		}
+
+		for (AlembicMeshSource *chunk : it->second)
+			meshSources+=chunk;
+		delete meshSource;
+	}
+
+	if (prog) {
+		prog->info("Split %i large meshes into %i chunks", numSplit, numChunks);
+	}
+}
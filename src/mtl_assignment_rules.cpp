@@ -2,15 +2,133 @@
 #include "pxml.h"
 #include "vraysceneplugman.h"
 #include "parse.h"
+#include "hash_utils.h"
+
+#include <ctype.h>
 
 using namespace VR;
 
+// Parse a boolean value from an XML tag; accepts 0/1 as well as false/true, no/yes and off/on.
+static int parseBool(const tchar *str, int defaultValue) {
+	if (!str)
+		return defaultValue;
+
+	if (0==stricmp(str, "true") || 0==stricmp(str, "yes") || 0==stricmp(str, "on"))
+		return true;
+	if (0==stricmp(str, "false") || 0==stricmp(str, "no") || 0==stricmp(str, "off"))
+		return false;
+
+	return atoi(str)!=0;
+}
+
+// Return true if the object name matches any of the given patterns.
+static int matchAnyPattern(const Table<CharString, -1> &patterns, const CharString &objName) {
+	for (int i=0; i<patterns.count(); i++) {
+		const CharString &pattern=patterns[i];
+		if (!pattern.empty() && matchWildcard(pattern.ptr(), objName.ptr()))
+			return true;
+	}
+	return false;
+}
+
+// Parse a comma-separated list of mesh channels from a <channels> tag into the given rule. Recognized names are
+// "normals", "velocities", "uvs" (all UV/color sets), "uvN" (mapping channel N), "all" and "positions"/"none"
+// (nothing besides the positions); any other name is taken as the name of a UV/color set. A "name:" prefix selects the
+// UV/color set with the rest of the token as its name, e.g. for sets literally named "uvs" or "uv1".
+static void parseChannels(const tchar *str, ChannelsAssignmentRule &rule) {
+	if (!str)
+		return;
+
+	const tchar *pos=str;
+	while (*pos) {
+		// Extract the next name from the list.
+		while (*pos==',' || isspace((unsigned char) *pos))
+			pos++;
+		tchar token[256];
+		int len=0;
+		while (*pos && *pos!=',' && !isspace((unsigned char) *pos)) {
+			if (len<int(sizeof(token))-1)
+				token[len++]=*pos;
+			pos++;
+		}
+		token[len]='\0';
+		if (len==0)
+			continue;
+
+		int idx=0;
+		tchar dummy=0;
+		if (0==strncmp(token, "name:", 5)) {
+			if (len>5)
+				*rule.mapChannelNames.newElement()=token+5;
+		} else if (0==stricmp(token, "normals")) {
+			rule.normals=true;
+		} else if (0==stricmp(token, "velocities")) {
+			rule.velocities=true;
+		} else if (0==stricmp(token, "uvs")) {
+			rule.allMapChannels=true;
+		} else if (0==stricmp(token, "all")) {
+			rule.normals=rule.velocities=rule.allMapChannels=true;
+		} else if (0==stricmp(token, "positions") || 0==stricmp(token, "none")) {
+			// Positions are always read.
+		} else if (len>2 && tolower(token[0])=='u' && tolower(token[1])=='v' && 1==sscanf(token+2, "%i%c", &idx, &dummy)) {
+			*rule.mapChannels.newElement()=idx;
+		} else {
+			*rule.mapChannelNames.newElement()=token;
+		}
+	}
+}
+
+int ChannelsAssignmentRule::readMapChannel(int idx, const tchar *setName) const {
+	if (allMapChannels)
+		return true;
+
+	for (int i=0; i<mapChannels.count(); i++) {
+		if (mapChannels[i]==idx)
+			return true;
+	}
+
+	if (setName && setName[0]) {
+		for (int i=0; i<mapChannelNames.count(); i++) {
+			if (0==strcmp(mapChannelNames[i].ptr(), setName))
+				return true;
+		}
+	}
+
+	return false;
+}
+
 ErrorCode MtlAssignmentRulesTable::readFromXML(PXML &pxml, VR::VRayScene &vrayScene, const CharString &mtlPrefix, ProgressCallback *prog) {
 	mtlAssignmentRulesTable.clear();
+	displacementAssignmentRulesTable.clear();
+	subdivAssignmentRulesTable.clear();
+	visibilityAssignmentRulesTable.clear();
+	lodAssignmentRulesTable.clear();
+	dynamicGeometryAssignmentRulesTable.clear();
+	tessellationAssignmentRulesTable.clear();
+	channelsAssignmentRulesTable.clear();
+	includePatterns.clear();
+	excludePatterns.clear();
 
 	// Create all material assignment rules
 	int mtlAssignmentsNodeIdx=pxml.FindFullTag("materialAssignmentRules");
 	if (mtlAssignmentsNodeIdx>=0) {
+		// Read the include/exclude object filters.
+		int includeNodeIdx=pxml.FindChild(mtlAssignmentsNodeIdx, "include", -1);
+		while (includeNodeIdx>=0) {
+			const tchar *patternStr=pxml[includeNodeIdx].getData();
+			if (patternStr)
+				*includePatterns.newElement()=patternStr;
+			includeNodeIdx=pxml.FindChild(mtlAssignmentsNodeIdx, "include", includeNodeIdx);
+		}
+
+		int excludeNodeIdx=pxml.FindChild(mtlAssignmentsNodeIdx, "exclude", -1);
+		while (excludeNodeIdx>=0) {
+			const tchar *patternStr=pxml[excludeNodeIdx].getData();
+			if (patternStr)
+				*excludePatterns.newElement()=patternStr;
+			excludeNodeIdx=pxml.FindChild(mtlAssignmentsNodeIdx, "exclude", excludeNodeIdx);
+		}
+
 		int patternRuleNode=pxml.FindChild(mtlAssignmentsNodeIdx, "patternRule", -1);
 		while (patternRuleNode>=0) {
 			// Find a material tag for this rule
@@ -22,6 +140,21 @@ ErrorCode MtlAssignmentRulesTable::readFromXML(PXML &pxml, VR::VRayScene &vraySc
 			// Find the subdivision tag for this rule.
 			int subdivNodeIdx=pxml.FindFullSubTag(patternRuleNode, "subdivision");
 
+			// Find the visibility tag for this rule.
+			int visibleNodeIdx=pxml.FindFullSubTag(patternRuleNode, "visible");
+
+			// Find the level of detail tag for this rule.
+			int lodNodeIdx=pxml.FindFullSubTag(patternRuleNode, "lod");
+
+			// Find the static/dynamic geometry tag for this rule.
+			int dynamicGeometryNodeIdx=pxml.FindFullSubTag(patternRuleNode, "dynamicGeometry");
+
+			// Find the displacement/subdivision tessellation tag for this rule.
+			int tessellationNodeIdx=pxml.FindFullSubTag(patternRuleNode, "tessellation");
+
+			// Find the mesh channels tag for this rule.
+			int channelsNodeIdx=pxml.FindFullSubTag(patternRuleNode, "channels");
+
 			// Enumerate all patterns in the rule and create entries for them in the respective tables.
 			int patternNodeIdx=pxml.FindChild(patternRuleNode, "pattern", -1);
 			while (patternNodeIdx>=0) {
@@ -66,6 +199,74 @@ ErrorCode MtlAssignmentRulesTable::readFromXML(PXML &pxml, VR::VRayScene &vraySc
 					}
 				}
 
+				// If there is a visibility tag, create a visibility entry.
+				if (visibleNodeIdx>=0) {
+					const NODEI &visibleNode=pxml[visibleNodeIdx];
+					VisibilityAssignmentRule &rule=*visibilityAssignmentRulesTable.newElement();
+					rule.objNamePattern=patternNode.getData();
+					rule.visible=parseBool(visibleNode.getData(), true);
+				}
+
+				// If there is a level of detail tag, create a LOD entry.
+				if (lodNodeIdx>=0) {
+					NODEI &lodNode=pxml[lodNodeIdx];
+					LodAssignmentRule &rule=*lodAssignmentRulesTable.newElement();
+					rule.objNamePattern=patternNode.getData();
+
+					PStrPairList *lodParams=lodNode.getPairs();
+					if (lodParams) {
+						for (int i=0; i<lodParams->count(); i++) {
+							const StrPair &strPair=(*lodParams)[i];
+							if (!strPair.par || !strPair.val)
+								continue;
+							if (0==stricmp(strPair.par, "pixels")) {
+								sscanf(strPair.val, "%f", &rule.maxPixels);
+							} else if (0==stricmp(strPair.par, "cellSize")) {
+								sscanf(strPair.val, "%f", &rule.cellPixels);
+							}
+						}
+					}
+				}
+
+				// If there is a dynamic geometry tag, create a dynamic geometry entry.
+				if (dynamicGeometryNodeIdx>=0) {
+					const NODEI &dynamicGeometryNode=pxml[dynamicGeometryNodeIdx];
+					DynamicGeometryAssignmentRule &rule=*dynamicGeometryAssignmentRulesTable.newElement();
+					rule.objNamePattern=patternNode.getData();
+					rule.dynamic=parseBool(dynamicGeometryNode.getData(), true);
+				}
+
+				// If there is a tessellation tag, create a tessellation entry.
+				if (tessellationNodeIdx>=0) {
+					NODEI &tessellationNode=pxml[tessellationNodeIdx];
+					TessellationAssignmentRule &rule=*tessellationAssignmentRulesTable.newElement();
+					rule.objNamePattern=patternNode.getData();
+
+					PStrPairList *tessellationParams=tessellationNode.getPairs();
+					if (tessellationParams) {
+						for (int i=0; i<tessellationParams->count(); i++) {
+							const StrPair &strPair=(*tessellationParams)[i];
+							if (!strPair.par || !strPair.val)
+								continue;
+							if (0==stricmp(strPair.par, "edgeLength")) {
+								sscanf(strPair.val, "%f", &rule.edgeLength);
+							} else if (0==stricmp(strPair.par, "maxSubdivs")) {
+								sscanf(strPair.val, "%i", &rule.maxSubdivs);
+							} else if (0==stricmp(strPair.par, "static")) {
+								rule.staticTessellation=parseBool(strPair.val, true);
+							}
+						}
+					}
+				}
+
+				// If there is a channels tag, create a channels entry.
+				if (channelsNodeIdx>=0) {
+					const NODEI &channelsNode=pxml[channelsNodeIdx];
+					ChannelsAssignmentRule &rule=*channelsAssignmentRulesTable.newElement();
+					rule.objNamePattern=patternNode.getData();
+					parseChannels(channelsNode.getData(), rule);
+				}
+
 				// Find the next pattern in the rule.
 				patternNodeIdx=pxml.FindChild(patternRuleNode, "pattern", patternNodeIdx);
 			}
@@ -166,3 +367,153 @@ int MtlAssignmentRulesTable::getSubdivisionEnabled(const VR::CharString &objName
 
 	return res;
 }
+
+int MtlAssignmentRulesTable::isObjectVisible(const VR::CharString &objName) {
+	if (objName.empty())
+		return includePatterns.count()==0;
+
+	if (includePatterns.count()>0 && !matchAnyPattern(includePatterns, objName))
+		return false;
+
+	if (matchAnyPattern(excludePatterns, objName))
+		return false;
+
+	for (int i=0; i<visibilityAssignmentRulesTable.count(); i++) {
+		const VisibilityAssignmentRule &rule=visibilityAssignmentRulesTable[i];
+		if (!rule.objNamePattern.empty() && matchWildcard(rule.objNamePattern.ptr(), objName.ptr()))
+			return rule.visible;
+	}
+
+	return true;
+}
+
+int MtlAssignmentRulesTable::getLodSettings(const VR::CharString &objName, float &maxPixels, float &cellPixels) {
+	if (objName.empty())
+		return false;
+
+	for (int i=0; i<lodAssignmentRulesTable.count(); i++) {
+		const LodAssignmentRule &rule=lodAssignmentRulesTable[i];
+		if (!rule.objNamePattern.empty() && matchWildcard(rule.objNamePattern.ptr(), objName.ptr())) {
+			maxPixels=rule.maxPixels;
+			cellPixels=rule.cellPixels;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int MtlAssignmentRulesTable::getDynamicGeometry(const VR::CharString &objName, int &dynamic) {
+	if (objName.empty())
+		return false;
+
+	for (int i=0; i<dynamicGeometryAssignmentRulesTable.count(); i++) {
+		const DynamicGeometryAssignmentRule &rule=dynamicGeometryAssignmentRulesTable[i];
+		if (!rule.objNamePattern.empty() && matchWildcard(rule.objNamePattern.ptr(), objName.ptr())) {
+			dynamic=rule.dynamic;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+const TessellationAssignmentRule* MtlAssignmentRulesTable::getTessellationRule(const VR::CharString &objName) {
+	if (objName.empty())
+		return nullptr;
+
+	for (int i=0; i<tessellationAssignmentRulesTable.count(); i++) {
+		const TessellationAssignmentRule &rule=tessellationAssignmentRulesTable[i];
+		if (!rule.objNamePattern.empty() && matchWildcard(rule.objNamePattern.ptr(), objName.ptr()))
+			return &rule;
+	}
+
+	return nullptr;
+}
+
+const ChannelsAssignmentRule* MtlAssignmentRulesTable::getChannelsRule(const VR::CharString &objName) {
+	if (objName.empty())
+		return nullptr;
+
+	for (int i=0; i<channelsAssignmentRulesTable.count(); i++) {
+		const ChannelsAssignmentRule &rule=channelsAssignmentRulesTable[i];
+		if (!rule.objNamePattern.empty() && matchWildcard(rule.objNamePattern.ptr(), objName.ptr()))
+			return &rule;
+	}
+
+	return nullptr;
+}
+
+// Add a string to the given hash, including its length so that consecutive strings are not ambiguous.
+static uint64 hashString(const CharString &str, uint64 hash) {
+	int len=str.empty()? 0 : str.length();
+	hash=hashMemory(&len, sizeof(len), hash);
+	if (len>0)
+		hash=hashMemory(str.ptr(), size_t(len), hash);
+	return hash;
+}
+
+uint64 MtlAssignmentRulesTable::getVisibilityHash(void) const {
+	uint64 hash=hashSeed;
+
+	int numIncludes=includePatterns.count();
+	hash=hashMemory(&numIncludes, sizeof(numIncludes), hash);
+	for (int i=0; i<numIncludes; i++)
+		hash=hashString(includePatterns[i], hash);
+
+	int numExcludes=excludePatterns.count();
+	hash=hashMemory(&numExcludes, sizeof(numExcludes), hash);
+	for (int i=0; i<numExcludes; i++)
+		hash=hashString(excludePatterns[i], hash);
+
+	int numRules=visibilityAssignmentRulesTable.count();
+	hash=hashMemory(&numRules, sizeof(numRules), hash);
+	for (int i=0; i<numRules; i++) {
+		const VisibilityAssignmentRule &rule=visibilityAssignmentRulesTable[i];
+		hash=hashString(rule.objNamePattern, hash);
+		hash=hashMemory(&rule.visible, sizeof(rule.visible), hash);
+	}
+
+	return hash;
+}
+
+uint64 MtlAssignmentRulesTable::getChannelsHash(void) const {
+	uint64 hash=hashSeed;
+
+	int numRules=channelsAssignmentRulesTable.count();
+	hash=hashMemory(&numRules, sizeof(numRules), hash);
+	for (int i=0; i<numRules; i++) {
+		const ChannelsAssignmentRule &rule=channelsAssignmentRulesTable[i];
+		hash=hashString(rule.objNamePattern, hash);
+		hash=hashMemory(&rule.normals, sizeof(rule.normals), hash);
+		hash=hashMemory(&rule.velocities, sizeof(rule.velocities), hash);
+		hash=hashMemory(&rule.allMapChannels, sizeof(rule.allMapChannels), hash);
+
+		int numMapChannels=rule.mapChannels.count();
+		hash=hashMemory(&numMapChannels, sizeof(numMapChannels), hash);
+		if (numMapChannels>0)
+			hash=hashMemory(&rule.mapChannels[0], numMapChannels*sizeof(int), hash);
+
+		int numNames=rule.mapChannelNames.count();
+		hash=hashMemory(&numNames, sizeof(numNames), hash);
+		for (int j=0; j<numNames; j++)
+			hash=hashString(rule.mapChannelNames[j], hash);
+	}
+
+	return hash;
+}
+
+uint64 MtlAssignmentRulesTable::getLodHash(void) const {
+	uint64 hash=hashSeed;
+
+	int numRules=lodAssignmentRulesTable.count();
+	hash=hashMemory(&numRules, sizeof(numRules), hash);
+	for (int i=0; i<numRules; i++) {
+		const LodAssignmentRule &rule=lodAssignmentRulesTable[i];
+		hash=hashString(rule.objNamePattern, hash);
+		hash=hashMemory(&rule.maxPixels, sizeof(rule.maxPixels), hash);
+		hash=hashMemory(&rule.cellPixels, sizeof(rule.cellPixels), hash);
+	}
+
+	return hash;
+}
@@ -33,6 +33,61 @@ struct SubdivAssignmentRule {
 	SubdivAssignmentRule(void):subdivide(true) {}
 };
 
+/// A structure that describes a visibility rule from an object name. Objects that are not visible
+/// are skipped before any of their data is read from the Alembic file.
+struct VisibilityAssignmentRule {
+	VR::CharString objNamePattern; ///< A pattern for the object names that this rule applies to.
+	int visible; ///< true if the objects should be loaded and false otherwise.
+
+	VisibilityAssignmentRule(void):visible(true) {}
+};
+
+/// A structure that describes a level of detail rule from an object name.
+struct LodAssignmentRule {
+	VR::CharString objNamePattern; ///< A pattern for the object names that this rule applies to.
+	float maxPixels; ///< Objects with a projected size below this number of pixels are decimated.
+	float cellPixels; ///< The size in pixels of the vertex clustering cells for decimated objects.
+
+	LodAssignmentRule(void):maxPixels(0.0f), cellPixels(1.0f) {}
+};
+
+/// A structure that describes the tessellation settings for displaced or subdivided objects with a given name.
+struct TessellationAssignmentRule {
+	VR::CharString objNamePattern; ///< A pattern for the object names that this rule applies to.
+	float edgeLength; ///< The target edge length of the tessellated triangles, in pixels.
+	int maxSubdivs; ///< The maximum number of subdivisions of an original triangle edge.
+	int staticTessellation; ///< true to tessellate the object before rendering and false to tessellate it on demand.
+
+	TessellationAssignmentRule(void):edgeLength(4.0f), maxSubdivs(256), staticTessellation(true) {}
+};
+
+/// A structure that describes a rule that forces static or dynamic geometry for objects with a given name.
+struct DynamicGeometryAssignmentRule {
+	VR::CharString objNamePattern; ///< A pattern for the object names that this rule applies to.
+	int dynamic; ///< true if the objects should use dynamic geometry and false for static geometry.
+
+	DynamicGeometryAssignmentRule(void):dynamic(true) {}
+};
+
+/// A structure that describes which optional mesh channels are read for objects with a given name. The vertex
+/// positions and the faces are always read. The voxel of the object is still decoded as a whole; channels that are not
+/// selected are only not copied from it or stored.
+struct ChannelsAssignmentRule {
+	VR::CharString objNamePattern; ///< A pattern for the object names that this rule applies to.
+	int normals; ///< true if the vertex and face normals should be read.
+	int velocities; ///< true if the vertex velocities should be read (only used with motion blur).
+	int allMapChannels; ///< true if all UV/color sets should be read.
+	VR::Table<int, -1> mapChannels; ///< The indices of the mapping channels to read, if not all of them are read.
+	VR::Table<VR::CharString, -1> mapChannelNames; ///< The names of the UV/color sets to read, if not all of them are read.
+
+	ChannelsAssignmentRule(void):normals(false), velocities(false), allMapChannels(false) {}
+
+	/// Return true if the given mapping channel should be read.
+	/// @param idx The index of the mapping channel.
+	/// @param setName The name of the UV/color set for the channel (may be NULL).
+	int readMapChannel(int idx, const tchar *setName) const;
+};
+
 /// A table of material assignment rules.
 struct MtlAssignmentRulesTable {
 	/// Read the material assignment rules from the given XML file.
@@ -55,8 +110,56 @@ struct MtlAssignmentRulesTable {
 
 	/// Return true if the specified object should have view-dependent subdivision enabled.
 	int getSubdivisionEnabled(const VR::CharString &objName);
+
+	/// Return true if the specified object should be loaded at all. An object is visible if it matches
+	/// at least one <include> pattern (or there are no such patterns), does not match any <exclude>
+	/// pattern, and the first pattern rule with a <visible> tag that matches it (if any) does not hide it.
+	int isObjectVisible(const VR::CharString &objName);
+
+	/// Find the level of detail settings for the specified object.
+	/// @param objName The object name (coming from the Alembic file).
+	/// @param[out] maxPixels The projected size in pixels below which the object should be decimated.
+	/// @param[out] cellPixels The size in pixels of a vertex clustering cell when decimating.
+	/// @retval true if there is a LOD rule for this object and false otherwise.
+	int getLodSettings(const VR::CharString &objName, float &maxPixels, float &cellPixels);
+
+	/// Find out if the specified object is forced to use static or dynamic geometry.
+	/// @param objName The object name (coming from the Alembic file).
+	/// @param[out] dynamic true if the object should use dynamic geometry and false for static geometry.
+	/// @retval true if there is a rule for this object and false otherwise.
+	int getDynamicGeometry(const VR::CharString &objName, int &dynamic);
+
+	/// Find the tessellation settings for the specified displaced or subdivided object.
+	/// @param objName The object name (coming from the Alembic file).
+	/// @retval The first matching tessellation rule, or nullptr if there is no rule for this object.
+	const TessellationAssignmentRule* getTessellationRule(const VR::CharString &objName);
+
+	/// Find the mesh channels that should be read for the specified object.
+	/// @param objName The object name (coming from the Alembic file).
+	/// @retval The first matching channels rule, or nullptr if all channels should be read for this object.
+	const ChannelsAssignmentRule* getChannelsRule(const VR::CharString &objName);
+
+	/// Return a hash of the <include>, <exclude> and <visible> rules, i.e. of everything that
+	/// determines which objects are loaded; used to identify geometry read with the same rules.
+	VR::uint64 getVisibilityHash(void) const;
+
+	/// Return a hash of the <channels> rules, i.e. of everything that determines which mesh channels are read.
+	VR::uint64 getChannelsHash(void) const;
+
+	/// Return a hash of the <lod> rules, i.e. of everything that determines how objects are decimated.
+	VR::uint64 getLodHash(void) const;
+
+	/// Return true if there are any <lod> rules, i.e. if the decimation of objects depends on the camera.
+	int hasLodRules(void) const { return lodAssignmentRulesTable.count()>0; }
 protected:
 	VR::Table<MtlAssignmentRule, -1> mtlAssignmentRulesTable;
 	VR::Table<DisplacementAssignmentRule, -1> displacementAssignmentRulesTable;
 	VR::Table<SubdivAssignmentRule, -1> subdivAssignmentRulesTable;
+	VR::Table<VisibilityAssignmentRule, -1> visibilityAssignmentRulesTable;
+	VR::Table<LodAssignmentRule, -1> lodAssignmentRulesTable;
+	VR::Table<DynamicGeometryAssignmentRule, -1> dynamicGeometryAssignmentRulesTable;
+	VR::Table<TessellationAssignmentRule, -1> tessellationAssignmentRulesTable;
+	VR::Table<ChannelsAssignmentRule, -1> channelsAssignmentRulesTable;
+	VR::Table<VR::CharString, -1> includePatterns; ///< Patterns from the <include> tags.
+	VR::Table<VR::CharString, -1> excludePatterns; ///< Patterns from the <exclude> tags.
 };
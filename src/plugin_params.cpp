@@ -0,0 +1,53 @@
+#include "plugin_params.h"
+
+using namespace VR;
+
+SharedPluginParams::SharedPluginParams(void):
+	dynamicGeometryOn("dynamic_geometry", true),
+	dynamicGeometryOff("dynamic_geometry", false),
+	staticDisplacementOn("static_displacement", true),
+	staticDisplacementOff("static_displacement", false),
+	staticSubdivOn("static_subdiv", true),
+	staticSubdivOff("static_subdiv", false),
+	useGlobals("use_globals", false)
+{}
+
+SharedPluginParams::~SharedPluginParams(void) {
+	freeValueParams();
+}
+
+void SharedPluginParams::freeValueParams(void) {
+	for (int i=0; i<edgeLengthParams.count(); i++)
+		delete edgeLengthParams[i];
+	edgeLengthParams.clear();
+	edgeLengths.clear();
+
+	for (int i=0; i<maxSubdivsParams.count(); i++)
+		delete maxSubdivsParams[i];
+	maxSubdivsParams.clear();
+	maxSubdivsValues.clear();
+}
+
+DefFloatParam* SharedPluginParams::getEdgeLength(float edgeLength) {
+	for (int i=0; i<edgeLengthParams.count(); i++) {
+		if (edgeLengths[i]==edgeLength)
+			return edgeLengthParams[i];
+	}
+
+	DefFloatParam *param=new DefFloatParam("edge_length", edgeLength);
+	edgeLengthParams+=param;
+	edgeLengths+=edgeLength;
+	return param;
+}
+
+DefIntParam* SharedPluginParams::getMaxSubdivs(int maxSubdivs) {
+	for (int i=0; i<maxSubdivsParams.count(); i++) {
+		if (maxSubdivsValues[i]==maxSubdivs)
+			return maxSubdivsParams[i];
+	}
+
+	DefIntParam *param=new DefIntParam("max_subdivs", maxSubdivs);
+	maxSubdivsParams+=param;
+	maxSubdivsValues+=maxSubdivs;
+	return param;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "utils.h"
+#include "defparams.h"
+#include "vrayplugins.h"
+
+/// A list parameter with plugins, f.e. the materials of a MtlMulti plugin. The list is not animated.
+struct PluginListParam: VR::VRayPluginParameter {
+	VR::Table<VR::VRayPlugin*, -1> plugins; ///< The plugins in the list.
+
+	/// Constructor.
+	/// @param name The name of the parameter; the string must outlive the parameter.
+	PluginListParam(const tchar *name): paramName(name) {}
+
+	const tchar* getName(void) VRAY_OVERRIDE { return paramName; }
+
+	int getCount(double time) VRAY_OVERRIDE { return plugins.count(); }
+
+	VR::PluginBase* getObject(int index, double time) VRAY_OVERRIDE {
+		return (index>=0 && index<plugins.count())? plugins[index] : nullptr;
+	}
+
+	VR::VRayParameterType getType(int index, double time=0.0) VRAY_OVERRIDE {
+		return VR::paramtype_object;
+	}
+
+protected:
+	const tchar *paramName;
+};
+
+/// Parameters of the mesh and displacement/subdivision plugins whose value is the same for many objects. Each value
+/// is created once and the same parameter object is set on all plugins that use it, instead of every AlembicMeshSource
+/// having its own copy. The parameters must outlive all plugins they are set on, and are never modified once created.
+struct SharedPluginParams {
+	/// Constructor.
+	SharedPluginParams(void);
+
+	/// Destructor.
+	~SharedPluginParams(void);
+
+	/// Return the dynamic_geometry parameter of GeomStaticMesh with the given value.
+	VR::DefBoolParam* getDynamicGeometry(int dynamic) { return dynamic? &dynamicGeometryOn : &dynamicGeometryOff; }
+
+	/// Return the static_displacement parameter of GeomDisplacedMesh with the given value.
+	VR::DefBoolParam* getStaticDisplacement(int staticDispl) { return staticDispl? &staticDisplacementOn : &staticDisplacementOff; }
+
+	/// Return the static_subdiv parameter of GeomStaticSmoothedMesh with the given value.
+	VR::DefBoolParam* getStaticSubdiv(int staticSubdiv) { return staticSubdiv? &staticSubdivOn : &staticSubdivOff; }
+
+	/// Return the use_globals parameter for displacement/subdivision, which is always disabled.
+	VR::DefBoolParam* getUseGlobals(void) { return &useGlobals; }
+
+	/// Return the edge_length parameter for displacement/subdivision with the given value.
+	VR::DefFloatParam* getEdgeLength(float edgeLength);
+
+	/// Return the max_subdivs parameter for displacement/subdivision with the given value.
+	VR::DefIntParam* getMaxSubdivs(int maxSubdivs);
+
+	/// Delete the edge_length and max_subdivs parameters. Must be called only when no plugin uses them any more,
+	/// f.e. after all plugins are deleted at the end of the render.
+	void freeValueParams(void);
+
+protected:
+	VR::DefBoolParam dynamicGeometryOn, dynamicGeometryOff;
+	VR::DefBoolParam staticDisplacementOn, staticDisplacementOff;
+	VR::DefBoolParam staticSubdivOn, staticSubdivOff;
+	VR::DefBoolParam useGlobals;
+
+	/// The edge_length parameters created so far, one per value in edgeLengths. There are only a few distinct
+	/// values (one per tessellation rule and budget scale, which is quantized), so they are searched linearly;
+	/// they are deleted at the end of each render.
+	VR::Table<VR::DefFloatParam*, -1> edgeLengthParams;
+	VR::Table<float, -1> edgeLengths;
+
+	/// The max_subdivs parameters created so far, one per value in maxSubdivsValues.
+	VR::Table<VR::DefIntParam*, -1> maxSubdivsParams;
+	VR::Table<int, -1> maxSubdivsValues;
+};
@@ -0,0 +1,235 @@
+#include "geomalembicreader.h"
+#include "mesh_lod.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace VR;
+
+// A voxel to read, with its estimated size on screen.
+struct VoxelImportance {
+	int voxelIndex; // The index of the voxel.
+	float projectedSize; // The projected size in pixels, or -1 if the voxel has no metadata.
+};
+
+// Return the world-space bounding box of the given voxel, as far as the Alembic transformation goes.
+static Box getVoxelBBox(const AbcVoxelInfo &voxelInfo) {
+	Box bbox;
+	bbox.init();
+	if (voxelInfo.bbox.isEmpty())
+		return bbox;
+
+	for (int i=0; i<8; i++) {
+		Vector p(
+			(i&1)? voxelInfo.bbox.pmax.x : voxelInfo.bbox.pmin.x,
+			(i&2)? voxelInfo.bbox.pmax.y : voxelInfo.bbox.pmin.y,
+			(i&4)? voxelInfo.bbox.pmax.z : voxelInfo.bbox.pmin.z
+		);
+		bbox+=voxelInfo.tm*p;
+	}
+	return bbox;
+}
+
+void GeomAlembicReader::sortVoxelsByImportance(Table<int, -1> &voxelIndices, const LodCamera &camera) {
+	std::vector<VoxelImportance> voxels(voxelIndices.count());
+	for (int i=0; i<voxelIndices.count(); i++) {
+		VoxelImportance &voxel=voxels[i];
+		voxel.voxelIndex=voxelIndices[i];
+		voxel.projectedSize=-1.0f;
+
+		int voxelIndex=voxelIndices[i];
+		if (voxelIndex<archiveIndex.getNumVoxels()) {
+			const AbcVoxelInfo &voxelInfo=archiveIndex.getVoxelInfo(voxelIndex);
+			if (voxelInfo.hasMetadata)
+				voxel.projectedSize=estimateProjectedSize(getVoxelBBox(voxelInfo), camera);
+		}
+	}
+
+	// The voxels without metadata go last, in file order.
+	std::stable_sort(voxels.begin(), voxels.end(), [](const VoxelImportance &a, const VoxelImportance &b) {
+		return a.projectedSize>b.projectedSize;
+	});
+
+	for (int i=0; i<voxelIndices.count(); i++)
+		voxelIndices[i]=voxels[i].voxelIndex;
+}
+
+void GeomAlembicReader::startProgressiveLoading(int frameNumber, VRayRenderer *vray, const AlembicReadParams &readParams, float fps, const AlembicParams &abcParams) {
+	// Remember the settings, so that the thread can be started again after a pause.
+	progressiveData.frameNumber=frameNumber;
+	progressiveData.fps=fps;
+	progressiveData.abcParams=abcParams;
+	progressiveData.readParams=readParams;
+	progressiveData.readParams.vray=vray;
+	progressiveData.readParams.meshSets=nullptr;
+	progressiveData.readParams.boundarySamples=nullptr;
+	progressiveData.readParams.archiveIndex=nullptr;
+	progressiveData.readParams.voxelVisibility=nullptr;
+
+	resumeProgressiveLoading();
+}
+
+void GeomAlembicReader::resumeProgressiveLoading(void) {
+	if (progressiveThread.joinable() || progressiveData.pendingVoxels.count()==0)
+		return;
+
+	CharString progressiveFileName(fileName);
+	std::vector<int> voxelIndices(&progressiveData.pendingVoxels[0], &progressiveData.pendingVoxels[0]+progressiveData.pendingVoxels.count());
+
+	// The objects are added to the current frame, so they are read with the same sample times.
+	const AlembicReadParams &readParams=progressiveData.readParams;
+	int nsamples=readParams.nsamples;
+	std::vector<double> sampleTimes(nsamples);
+	for (int i=0; i<nsamples; i++)
+		sampleTimes[i]=readParams.sampleTimes[i];
+
+	VRayRenderer *vray=readParams.vray;
+	int readVelocities=readParams.readVelocities;
+	float frame=readParams.frame;
+	LodCamera lodCamera=readParams.lodCamera;
+	int detectRigidMotion=readParams.detectRigidMotion;
+	float rigidMotionTolerance=readParams.rigidMotionTolerance;
+	int computeGeometryHash=readParams.computeGeometryHash;
+	int frameNumber=progressiveData.frameNumber;
+	float fps=progressiveData.fps;
+	AlembicParams abcParams=progressiveData.abcParams;
+
+	// The metadata index is only read here; the main thread keeps updating it while the frame renders.
+	int indexPreviewVoxel=archiveIndex.isValidFor(fileName)? archiveIndex.getPreviewVoxelIndex() : -1;
+
+	progressiveData.numRead=0;
+	progressiveData.finished=false;
+	progressiveThread=std::thread([=]() {
+		// Don't use the V-Ray thread manager; it is busy rendering the current frame.
+		const tchar *fname=progressiveFileName.ptr();
+		AlembicParams progressiveAbcParams=abcParams;
+		MeshFile *alembicFile=fname? openMeshFile(fname, frameNumber, fps, progressiveAbcParams, vray, nullptr, nullptr) : nullptr;
+		if (alembicFile) {
+			// The voxels are already known to be visible, so the voxel visibility is neither needed nor updated.
+			AlembicReadParams progressiveParams;
+			progressiveParams.vray=vray;
+			progressiveParams.readVelocities=readVelocities;
+			progressiveParams.lodCamera=lodCamera;
+			progressiveParams.frame=frame;
+			progressiveParams.detectRigidMotion=detectRigidMotion;
+			progressiveParams.rigidMotionTolerance=rigidMotionTolerance;
+			progressiveParams.computeGeometryHash=computeGeometryHash;
+			progressiveParams.nsamples=nsamples;
+			progressiveParams.sampleTimes.setCount(nsamples);
+			for (int i=0; i<nsamples; i++)
+				progressiveParams.sampleTimes[i]=sampleTimes[i];
+
+			int previewVoxelIndex=(indexPreviewVoxel>=0)? indexPreviewVoxel : AbcArchiveIndex::findPreviewVoxel(*alembicFile);
+
+			DefaultMeshSetsData setsData;
+			readMeshSetsData(*alembicFile, previewVoxelIndex, nsamples, setsData);
+			progressiveParams.meshSets=&setsData;
+
+			for (size_t i=0; i<voxelIndices.size() && !progressiveData.cancel; i++) {
+				AlembicMeshInstance *abcMeshInstance=new AlembicMeshInstance;
+				AlembicMeshSource *abcMeshSource=readMeshSource(progressiveParams, *alembicFile, voxelIndices[i], *abcMeshInstance);
+				if (abcMeshSource) {
+					if (computeGeometryHash)
+						computeGeometryHashes(*abcMeshSource, *abcMeshInstance);
+					applyLod(*abcMeshSource, *abcMeshInstance, progressiveParams);
+
+					abcMeshInstance->meshSource=abcMeshSource;
+
+					std::lock_guard<std::mutex> lock(progressiveData.mutex);
+					progressiveData.meshSources+=abcMeshSource;
+					progressiveData.meshInstances+=abcMeshInstance;
+				} else {
+					delete abcMeshInstance;
+				}
+				progressiveData.numRead=int(i+1);
+			}
+
+			progressiveParams.meshSets=nullptr;
+			deleteDefaultMeshFile(alembicFile);
+		}
+		progressiveData.finished=true;
+	});
+}
+
+void GeomAlembicReader::pauseProgressiveLoading(void) {
+	progressiveData.cancel=true;
+	if (progressiveThread.joinable())
+		progressiveThread.join();
+	progressiveData.cancel=false;
+
+	// Forget the voxels that were read; the rest are read when the loading is resumed.
+	Table<int, -1> &pendingVoxels=progressiveData.pendingVoxels;
+	int numRead=Min(int(progressiveData.numRead), pendingVoxels.count());
+	for (int i=numRead; i<pendingVoxels.count(); i++)
+		pendingVoxels[i-numRead]=pendingVoxels[i];
+	pendingVoxels.setCount(pendingVoxels.count()-numRead);
+	progressiveData.numRead=0;
+}
+
+void GeomAlembicReader::stopProgressiveLoading(void) {
+	pauseProgressiveLoading();
+
+	std::lock_guard<std::mutex> lock(progressiveData.mutex);
+	progressiveData.freeMem();
+}
+
+int GeomAlembicReader::hasPendingProgressiveObjects(void) {
+	std::lock_guard<std::mutex> lock(progressiveData.mutex);
+	return progressiveData.numRead<progressiveData.pendingVoxels.count() || progressiveData.meshInstances.count()>0;
+}
+
+int GeomAlembicReader::addProgressiveObjects(void) {
+	if (!vrayRenderer || !plugman)
+		return 0;
+
+	// Once all the objects of this frame are read, the next frame can be read in the background.
+	startDeferredPrefetch();
+
+	// Take the objects read so far; the sources are reached through the instances.
+	Table<AlembicMeshInstance*, -1> newInstances;
+	{
+		std::lock_guard<std::mutex> lock(progressiveData.mutex);
+		if (progressiveData.meshInstances.count()==0)
+			return 0;
+
+		newInstances.copy(progressiveData.meshInstances);
+		progressiveData.meshSources.clear();
+		progressiveData.meshInstances.clear();
+	}
+
+	// The new objects go through the same choices as the objects read before the frame started.
+	ProgressCallback *prog=vrayRenderer->getSequenceData().progress;
+	Table<AlembicMeshSource*, -1> newSources;
+	for (int i=0; i<newInstances.count(); i++)
+		newSources+=newInstances[i]->meshSource;
+	applyGeometryPolicy(newSources, newInstances, progressiveData.readParams.lodCamera, prog);
+
+	// Create the plugins for the new objects and instance them in all Nodes.
+	int numAdded=0;
+	for (int i=0; i<newInstances.count(); i++) {
+		AlembicMeshInstance *abcMeshInstance=newInstances[i];
+		AlembicMeshSource *abcMeshSource=abcMeshInstance->meshSource;
+
+		if (!createMeshPlugins(*abcMeshSource, meshSources.count())) {
+			deleteMeshPlugins(*abcMeshSource);
+			delete abcMeshSource;
+			delete abcMeshInstance;
+			continue;
+		}
+
+		abcMeshInstance->meshIndex=meshInstances.count();
+		meshSources+=abcMeshSource;
+		meshInstances+=abcMeshInstance;
+
+		for (int j=0; j<readerInstances.count(); j++)
+			readerInstances[j]->recreateMeshInstance(*abcMeshInstance);
+
+		numAdded++;
+	}
+
+	if (prog && numAdded>0) {
+		prog->info("Progressive loading: added %i objects", numAdded);
+	}
+
+	return numAdded;
+}
@@ -0,0 +1,150 @@
+#include "shared_geometry.h"
+
+using namespace VR;
+
+// Add keyframes to dst that reference the vector lists of src.
+static void shareKeyframes(AnimatedVectorListParam &dst, AnimatedVectorListParam &src) {
+	for (int i=0; i<src.getNumKeyframes(); i++) {
+		VectorList &data=src.getKeyframeData(i);
+		dst.addKeyframe(src.getKeyframeTime(i), VectorList(data.count()>0? &data[0] : nullptr, data.count()));
+	}
+}
+
+// Add keyframes to dst that reference the integer lists of src.
+static void shareKeyframes(AnimatedIntListParam &dst, AnimatedIntListParam &src) {
+	for (int i=0; i<src.getNumKeyframes(); i++) {
+		IntList &data=src.getKeyframeData(i);
+		dst.addKeyframe(src.getKeyframeTime(i), IntList(data.count()>0? &data[0] : nullptr, data.count()));
+	}
+}
+
+// Add keyframes to dst with UV/color sets that reference the lists of src.
+static void shareKeyframes(AnimatedMapChannelsParam &dst, AnimatedMapChannelsParam &src) {
+	for (int i=0; i<src.getNumKeyframes(); i++) {
+		AbcMapChannelsList &srcChannels=src.getKeyframeData(i);
+		AbcMapChannelsList &mapChannels=dst.addKeyframe(src.getKeyframeTime(i));
+		mapChannels.setCount(srcChannels.count());
+		for (int j=0; j<srcChannels.count(); j++) {
+			AbcMapChannel &srcChannel=srcChannels[j];
+			mapChannels[j].idx=srcChannel.idx;
+			mapChannels[j].verts=VectorList(srcChannel.verts.count()>0? &srcChannel.verts[0] : nullptr, srcChannel.verts.count());
+			mapChannels[j].faces=IntList(srcChannel.faces.count()>0? &srcChannel.faces[0] : nullptr, srcChannel.faces.count());
+		}
+	}
+}
+
+// Add keyframes to dst with copies of the data of src.
+template<class T>
+static void copyKeyframes(AnimatedParam<T> &dst, AnimatedParam<T> &src) {
+	for (int i=0; i<src.getNumKeyframes(); i++) {
+		T &data=dst.addKeyframe(src.getKeyframeTime(i));
+		copyKeyframeData(data, src.getKeyframeData(i));
+	}
+}
+
+SharedGeometry::~SharedGeometry(void) {
+	for (int i=0; i<meshInstances.count(); i++)
+		delete meshInstances[i];
+	meshInstances.clear();
+
+	for (int i=0; i<meshSources.count(); i++)
+		delete meshSources[i];
+	meshSources.clear();
+}
+
+int SharedGeometry::matches(const CharString &fname, const FileStamp &stamp, int frame, uint64 hash) const {
+	return frameNumber==frame && settingsHash==hash && fileStamp==stamp && fileName==fname;
+}
+
+AlembicMeshSource* SharedGeometry::add(AlembicMeshSource *meshSource, AlembicMeshInstance *meshInstance, AlembicMeshInstance *&readerInstance) {
+	meshInstance->meshSource=meshSource;
+	meshSources+=meshSource;
+	meshInstances+=meshInstance;
+	return createSharedCopy(meshSources.count()-1, readerInstance);
+}
+
+AlembicMeshSource* SharedGeometry::createSharedCopy(int index, AlembicMeshInstance *&readerInstance) {
+	AlembicMeshSource &src=*meshSources[index];
+	const AlembicMeshInstance &srcInstance=*meshInstances[index];
+
+	AlembicMeshSource *meshSource=new AlembicMeshSource;
+	meshSource->setNumTimeSteps(src.nsamples);
+	meshSource->voxelIndex=src.voxelIndex;
+	meshSource->abcName=src.abcName;
+	meshSource->usesMappedData=true;
+
+	shareKeyframes(meshSource->verticesParam, src.verticesParam);
+	shareKeyframes(meshSource->facesParam, src.facesParam);
+	shareKeyframes(meshSource->normalsParam, src.normalsParam);
+	shareKeyframes(meshSource->faceNormalsParam, src.faceNormalsParam);
+	shareKeyframes(meshSource->velocitiesParam, src.velocitiesParam);
+	shareKeyframes(meshSource->mapChannelsParam, src.mapChannelsParam);
+	copyKeyframes(meshSource->mapChannelNamesParam, src.mapChannelNamesParam);
+	shareKeyframes(meshSource->faceMtlIDsParam, src.faceMtlIDsParam);
+	meshSource->faceSetNames.copy(src.faceSetNames);
+
+	readerInstance=new AlembicMeshInstance;
+	readerInstance->tms.copy(srcInstance.tms);
+	readerInstance->times.copy(srcInstance.times);
+	readerInstance->abcName=srcInstance.abcName;
+	readerInstance->meshSource=meshSource;
+
+	return meshSource;
+}
+
+SharedGeometryRegistry& SharedGeometryRegistry::getInstance(void) {
+	static SharedGeometryRegistry registry;
+	return registry;
+}
+
+SharedGeometry* SharedGeometryRegistry::acquire(const CharString &fileName, const FileStamp &fileStamp, int frameNumber, uint64 settingsHash) {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (int i=0; i<entries.count(); i++) {
+		SharedGeometry *geometry=entries[i];
+		if (geometry->matches(fileName, fileStamp, frameNumber, settingsHash)) {
+			geometry->refCount++;
+			return geometry;
+		}
+	}
+	return nullptr;
+}
+
+SharedGeometry* SharedGeometryRegistry::create(const CharString &fileName, const FileStamp &fileStamp, int frameNumber, uint64 settingsHash) {
+	SharedGeometry *geometry=new SharedGeometry;
+	geometry->fileName=fileName;
+	geometry->fileStamp=fileStamp;
+	geometry->frameNumber=frameNumber;
+	geometry->settingsHash=settingsHash;
+	geometry->refCount=1;
+	return geometry;
+}
+
+void SharedGeometryRegistry::publish(SharedGeometry *geometry) {
+	if (!geometry)
+		return;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	for (int i=0; i<entries.count(); i++) {
+		if (entries[i]==geometry || entries[i]->matches(geometry->fileName, geometry->fileStamp, geometry->frameNumber, geometry->settingsHash))
+			return;
+	}
+	entries+=geometry;
+}
+
+void SharedGeometryRegistry::release(SharedGeometry *geometry) {
+	if (!geometry)
+		return;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (--geometry->refCount>0)
+		return;
+
+	for (int i=0; i<entries.count(); i++) {
+		if (entries[i]==geometry) {
+			entries[i]=entries.last();
+			entries.setCount(entries.count()-1);
+			break;
+		}
+	}
+	delete geometry;
+}
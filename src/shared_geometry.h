@@ -0,0 +1,74 @@
+#pragma once
+
+#include "geomalembicreader.h"
+
+#include <mutex>
+
+/// Geometry decoded from an archive for one frame, shared between all GeomAlembicReader plugins that read the
+/// same file with the same settings. The mesh sources here are never modified or given plugins; each reader
+/// creates its own mesh sources that reference the vertex and face data of these (see createSharedCopy()).
+struct SharedGeometry {
+	VR::CharString fileName; ///< The archive file name.
+	FileStamp fileStamp; ///< The size and the modification time of the archive file when it was read.
+	int frameNumber; ///< The frame that the geometry was read for.
+	VR::uint64 settingsHash; ///< A hash of the settings that affect the decoded geometry.
+
+	VR::Table<AlembicMeshSource*, -1> meshSources; ///< The decoded meshes.
+	VR::Table<AlembicMeshInstance*, -1> meshInstances; ///< The instance of each mesh, with the Alembic transformations.
+
+	/// Constructor.
+	SharedGeometry(void): frameNumber(0), settingsHash(0), refCount(0) {}
+
+	/// Destructor; deletes all the meshes.
+	~SharedGeometry(void);
+
+	/// Return true if this geometry was read from the given file with the given settings.
+	int matches(const VR::CharString &fname, const FileStamp &stamp, int frame, VR::uint64 hash) const;
+
+	/// Take ownership of a decoded mesh and its instance, and return a new mesh and instance for the
+	/// calling reader that reference the data of the shared one.
+	/// @param meshSource The decoded mesh; it is owned by the shared geometry after the call.
+	/// @param meshInstance The instance of the mesh; it is owned by the shared geometry after the call.
+	/// @param[out] readerInstance The instance for the calling reader is returned here.
+	/// @retval The mesh source for the calling reader.
+	AlembicMeshSource* add(AlembicMeshSource *meshSource, AlembicMeshInstance *meshInstance, AlembicMeshInstance *&readerInstance);
+
+	/// Create a mesh source and an instance for a reader that reference the data of the given shared mesh.
+	/// The vertex, face, normal, velocity, face material ID and UV/color set lists point to the shared data, so they must
+	/// not be modified in place (replacing them is fine).
+	/// @param index The index of the shared mesh.
+	/// @param[out] readerInstance The instance for the calling reader is returned here.
+	/// @retval The mesh source for the calling reader.
+	AlembicMeshSource* createSharedCopy(int index, AlembicMeshInstance *&readerInstance);
+
+protected:
+	friend struct SharedGeometryRegistry;
+	int refCount; ///< The number of readers that use this geometry.
+};
+
+/// A process-wide registry of the geometry currently used by GeomAlembicReader plugins, so that several readers
+/// that reference the same archive decode it only once. Entries are reference counted and deleted when the last
+/// reader releases them.
+struct SharedGeometryRegistry {
+	/// Return the registry for the process.
+	static SharedGeometryRegistry& getInstance(void);
+
+	/// Find the geometry read from the given file with the given settings and add a reference to it.
+	/// @retval The shared geometry or nullptr if no reader has read it.
+	SharedGeometry* acquire(const VR::CharString &fileName, const FileStamp &fileStamp, int frameNumber, VR::uint64 settingsHash);
+
+	/// Create a new empty geometry entry for the given file and settings, with one reference. The entry
+	/// is not visible to other readers until it is filled in and published with publish().
+	SharedGeometry* create(const VR::CharString &fileName, const FileStamp &fileStamp, int frameNumber, VR::uint64 settingsHash);
+
+	/// Make a geometry entry created with create() available to other readers. The entry is registered only
+	/// if there is no matching one already (f.e. read by another reader at the same time).
+	void publish(SharedGeometry *geometry);
+
+	/// Remove a reference to the given geometry; it is deleted when there are no more references.
+	void release(SharedGeometry *geometry);
+
+protected:
+	std::mutex mutex; ///< Protects the entries and the reference counts.
+	VR::Table<SharedGeometry*, -1> entries; ///< The registered geometry.
+};